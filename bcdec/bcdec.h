@@ -60,19 +60,30 @@
 #define BCDEC_BC6H_COMPRESSED_SIZE(w, h)    ((((w)>>2)*((h)>>2))*BCDEC_BC6H_BLOCK_SIZE)
 #define BCDEC_BC7_COMPRESSED_SIZE(w, h)     ((((w)>>2)*((h)>>2))*BCDEC_BC7_BLOCK_SIZE)
 
-#ifdef __cplusplus
+/*  Define BCDEC_STATIC before including this file to get all functions with static linkage,
+    this allows to compile the implementation into several translation units (or with different
+    code generation settings) without symbols clashing                                            */
+#ifndef BCDECDEF
+#ifdef BCDEC_STATIC
+#define BCDECDEF static
+#else
+#define BCDECDEF extern
+#endif
+#endif
+
+#if defined(__cplusplus) && !defined(BCDEC_STATIC)
 extern "C" {
 #endif /* __cplusplus */
 
-void bcdec_bc1(const void* compressedBlock, void* decompressedBlock, int destinationPitch);
-void bcdec_bc2(const void* compressedBlock, void* decompressedBlock, int destinationPitch);
-void bcdec_bc3(const void* compressedBlock, void* decompressedBlock, int destinationPitch);
-void bcdec_bc4(const void* compressedBlock, void* decompressedBlock, int destinationPitch);
-void bcdec_bc5(const void* compressedBlock, void* decompressedBlock, int destinationPitch);
-void bcdec_bc6h(const void* compressedBlock, void* decompressedBlock, int destinationPitch, int isSigned);
-void bcdec_bc7(const void* compressedBlock, void* decompressedBlock, int destinationPitch);
+BCDECDEF void bcdec_bc1(const void* compressedBlock, void* decompressedBlock, int destinationPitch);
+BCDECDEF void bcdec_bc2(const void* compressedBlock, void* decompressedBlock, int destinationPitch);
+BCDECDEF void bcdec_bc3(const void* compressedBlock, void* decompressedBlock, int destinationPitch);
+BCDECDEF void bcdec_bc4(const void* compressedBlock, void* decompressedBlock, int destinationPitch);
+BCDECDEF void bcdec_bc5(const void* compressedBlock, void* decompressedBlock, int destinationPitch);
+BCDECDEF void bcdec_bc6h(const void* compressedBlock, void* decompressedBlock, int destinationPitch, int isSigned);
+BCDECDEF void bcdec_bc7(const void* compressedBlock, void* decompressedBlock, int destinationPitch);
 
-#ifdef __cplusplus
+#if defined(__cplusplus) && !defined(BCDEC_STATIC)
 }
 #endif /* __cplusplus */
 
@@ -83,7 +94,7 @@ typedef struct bcdec__rgba {
     unsigned char r, g, b, a;
 } bcdec__rgba_t;
 
-void bcdec__color_block(const void* compressedBlock, void* decompressedBlock, int destinationPitch, int onlyOpaqueMode) {
+BCDECDEF void bcdec__color_block(const void* compressedBlock, void* decompressedBlock, int destinationPitch, int onlyOpaqueMode) {
     unsigned short c0, c1;
     bcdec__rgba_t refColors[4];
     unsigned char* dstColors;
@@ -141,7 +152,7 @@ void bcdec__color_block(const void* compressedBlock, void* decompressedBlock, in
     }
 }
 
-void bcdec__sharp_alpha_block(const void* compressedBlock, void* decompressedBlock, int destinationPitch) {
+BCDECDEF void bcdec__sharp_alpha_block(const void* compressedBlock, void* decompressedBlock, int destinationPitch) {
     unsigned short* alpha;
     unsigned char* decompressed;
     int i, j;
@@ -158,7 +169,7 @@ void bcdec__sharp_alpha_block(const void* compressedBlock, void* decompressedBlo
     }
 }
 
-void bcdec__smooth_alpha_block(const void* compressedBlock, void* decompressedBlock, int destinationPitch, int pixelSize) {
+BCDECDEF void bcdec__smooth_alpha_block(const void* compressedBlock, void* decompressedBlock, int destinationPitch, int pixelSize) {
     unsigned char* block;
     unsigned char* decompressed;
     unsigned char alpha[8];
@@ -211,7 +222,7 @@ typedef struct bcdec__bitstream {
     int             bitPos;
 } bcdec__bitstream_t;
 
-int bcdec__bitstream_read_bit(bcdec__bitstream_t* bstream) {
+BCDECDEF int bcdec__bitstream_read_bit(bcdec__bitstream_t* bstream) {
     int i, b;
 
     i = bstream->bitPos >> 3;
@@ -220,7 +231,7 @@ int bcdec__bitstream_read_bit(bcdec__bitstream_t* bstream) {
     return b;
 }
 
-int bcdec__bitstream_read_bits(bcdec__bitstream_t* bstream, int numBits) {
+BCDECDEF int bcdec__bitstream_read_bits(bcdec__bitstream_t* bstream, int numBits) {
     int result = 0, i = numBits;
     while (i) {
         result |= (bcdec__bitstream_read_bit(bstream) << (numBits - i));
@@ -231,7 +242,7 @@ int bcdec__bitstream_read_bits(bcdec__bitstream_t* bstream, int numBits) {
 
 /*  reversed bits pulling, used in BC6H decoding
     why Microsoft ?? just why ???                   */
-int bcdec__bitstream_read_bits_r(bcdec__bitstream_t* bstream, int numBits) {
+BCDECDEF int bcdec__bitstream_read_bits_r(bcdec__bitstream_t* bstream, int numBits) {
     int result = 0;
     while (numBits--) {
         result <<= 1;
@@ -242,35 +253,35 @@ int bcdec__bitstream_read_bits_r(bcdec__bitstream_t* bstream, int numBits) {
 
 
 
-void bcdec_bc1(const void* compressedBlock, void* decompressedBlock, int destinationPitch) {
+BCDECDEF void bcdec_bc1(const void* compressedBlock, void* decompressedBlock, int destinationPitch) {
     bcdec__color_block(compressedBlock, decompressedBlock, destinationPitch, 0);
 }
 
-void bcdec_bc2(const void* compressedBlock, void* decompressedBlock, int destinationPitch) {
+BCDECDEF void bcdec_bc2(const void* compressedBlock, void* decompressedBlock, int destinationPitch) {
     bcdec__color_block(((char*)compressedBlock) + 8, decompressedBlock, destinationPitch, 1);
     bcdec__sharp_alpha_block(compressedBlock, ((char*)decompressedBlock) + 3, destinationPitch);
 }
 
-void bcdec_bc3(const void* compressedBlock, void* decompressedBlock, int destinationPitch) {
+BCDECDEF void bcdec_bc3(const void* compressedBlock, void* decompressedBlock, int destinationPitch) {
     bcdec__color_block(((char*)compressedBlock) + 8, decompressedBlock, destinationPitch, 1);
     bcdec__smooth_alpha_block(compressedBlock, ((char*)decompressedBlock) + 3, destinationPitch, 4);
 }
 
-void bcdec_bc4(const void* compressedBlock, void* decompressedBlock, int destinationPitch) {
+BCDECDEF void bcdec_bc4(const void* compressedBlock, void* decompressedBlock, int destinationPitch) {
     bcdec__smooth_alpha_block(compressedBlock, decompressedBlock, destinationPitch, 1);
 }
 
-void bcdec_bc5(const void* compressedBlock, void* decompressedBlock, int destinationPitch) {
+BCDECDEF void bcdec_bc5(const void* compressedBlock, void* decompressedBlock, int destinationPitch) {
     bcdec__smooth_alpha_block(compressedBlock, decompressedBlock, destinationPitch, 2);
     bcdec__smooth_alpha_block(((char*)compressedBlock) + 8, ((char*)decompressedBlock) + 1, destinationPitch, 2);
 }
 
 /* http://graphics.stanford.edu/~seander/bithacks.html#VariableSignExtend */
-int bcdec__extend_sign(int val, int bits) {
+BCDECDEF int bcdec__extend_sign(int val, int bits) {
     return (val << (32 - bits)) >> (32 - bits);
 }
 
-int bcdec__transform_inverse(int val, int a0, int bits, int isSigned) {
+BCDECDEF int bcdec__transform_inverse(int val, int a0, int bits, int isSigned) {
     /* If the precision of A0 is "p" bits, then the transform algorithm is:
        B0 = (B0 + A0) & ((1 << p) - 1) */
     val = (val + a0) & ((1 << bits) - 1);
@@ -281,7 +292,7 @@ int bcdec__transform_inverse(int val, int a0, int bits, int isSigned) {
 }
 
 /* pretty much copy-paste from documentation */
-int bcdec__unquantize(int val, int bits, int isSigned) {
+BCDECDEF int bcdec__unquantize(int val, int bits, int isSigned) {
     int unq, s = 0;
 
     if (!isSigned) {
@@ -319,11 +330,11 @@ int bcdec__unquantize(int val, int bits, int isSigned) {
     return unq;
 }
 
-int bcdec__interpolate(int a, int b, int* weights, int index) {
+BCDECDEF int bcdec__interpolate(int a, int b, int* weights, int index) {
     return (a * (64 - weights[index]) + b * weights[index] + 32) >> 6;
 }
 
-unsigned short bcdec__finish_unquantize(int val, int isSigned) {
+BCDECDEF unsigned short bcdec__finish_unquantize(int val, int isSigned) {
     int s;
 
     if (!isSigned) {
@@ -340,7 +351,7 @@ unsigned short bcdec__finish_unquantize(int val, int isSigned) {
 }
 
 /* https://fgiesen.wordpress.com/2012/03/28/half-to-float-done-quic/ */
-float bcdec__half_to_float_quick(unsigned short half) {
+BCDECDEF float bcdec__half_to_float_quick(unsigned short half) {
     static unsigned int magic = (254 - 15) << 23;
     static unsigned int was_infnan = (127 + 16) << 23;
     unsigned int o;
@@ -354,7 +365,7 @@ float bcdec__half_to_float_quick(unsigned short half) {
     return *((float*)&o);
 }
 
-void bcdec_bc6h(const void* compressedBlock, void* decompressedBlock, int destinationPitch, int isSigned) {
+BCDECDEF void bcdec_bc6h(const void* compressedBlock, void* decompressedBlock, int destinationPitch, int isSigned) {
     static char actual_bits_count[4][14] = {
         { 10, 7, 11, 11, 11, 9, 8, 8, 8, 6, 10, 11, 12, 16 },   /*  W */
         {  5, 6,  5,  4,  4, 5, 6, 5, 5, 6, 10,  9,  8,  4 },   /* dR */
@@ -867,11 +878,11 @@ void bcdec_bc6h(const void* compressedBlock, void* decompressedBlock, int destin
     }
 }
 
-void bcdec__swap_values(int* a, int* b) {
+BCDECDEF void bcdec__swap_values(int* a, int* b) {
     a[0] ^= b[0], b[0] ^= a[0], a[0] ^= b[0];
 }
 
-void bcdec_bc7(const void* compressedBlock, void* decompressedBlock, int destinationPitch) {
+BCDECDEF void bcdec_bc7(const void* compressedBlock, void* decompressedBlock, int destinationPitch) {
     static char actual_bits_count[2][8] = {
         { 4, 6, 5, 7, 5, 7, 7, 5 },     /* RGBA  */
         { 0, 0, 0, 0, 6, 8, 7, 5 },     /* Alpha */
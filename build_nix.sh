@@ -1 +1,23 @@
-g++ ./src/bumpx.cpp -std=c++17 -lstdc++fs -O2 -s -DNDEBUG -o ./_build/bumpx
+#!/bin/sh
+set -e
+
+CXXFLAGS="-std=c++17 -O2 -DNDEBUG"
+# kernels must produce bit-exact results in every variant, hence no fp contraction
+KERNELS_FLAGS="$CXXFLAGS -fno-math-errno -ffp-contract=off"
+
+case "$(uname -m)" in
+    x86_64|amd64|i?86)
+        g++ -c ./src/kernels.cpp $KERNELS_FLAGS -DBUMPX_ISA=sse2 -msse2 -o ./_build/kernels_sse2.o
+        g++ -c ./src/kernels.cpp $KERNELS_FLAGS -DBUMPX_ISA=sse41 -msse4.1 -o ./_build/kernels_sse41.o
+        g++ -c ./src/kernels.cpp $KERNELS_FLAGS -DBUMPX_ISA=avx2 -mavx2 -mbmi -mbmi2 -o ./_build/kernels_avx2.o
+        g++ -c ./src/kernels.cpp $KERNELS_FLAGS -DBUMPX_ISA=avx512 -mavx512f -mavx512dq -mavx512bw -mavx512vl -mbmi -mbmi2 -o ./_build/kernels_avx512.o
+        ;;
+    *)
+        g++ -c ./src/kernels.cpp $KERNELS_FLAGS -DBUMPX_ISA=generic -o ./_build/kernels_generic.o
+        ;;
+esac
+
+g++ ./src/bumpx.cpp ./_build/kernels_*.o $CXXFLAGS -pthread -lstdc++fs -s -o ./_build/bumpx
+# the bench runs bumpx.cpp built as the library, without its main (see bumpx_internal.h)
+g++ ./src/bench.cpp ./src/bumpx.cpp ./_build/kernels_*.o $CXXFLAGS -DBUMPX_CORE_LIBRARY -pthread -lstdc++fs -s -o ./_build/bumpx_bench
+rm -f ./_build/kernels_*.o
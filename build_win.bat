@@ -1,2 +1,13 @@
 @echo off
-cl /EHsc /GS /GL /W3 /Gy /Zc:wchar_t /Qspectre /Gm- /O2 /sdl /Zc:inline /fp:precise /D "NDEBUG" /D "_CONSOLE" /D "_UNICODE" /D "UNICODE" /WX- /Zc:forScope /Gd /Oi /MD /std:c++17 ".\src\bumpx.cpp" /link /out:".\_build\bumpx.exe"
+set CL_FLAGS=/EHsc /GS /W3 /Gy /Zc:wchar_t /Qspectre /Gm- /O2 /sdl /Zc:inline /fp:precise /D "NDEBUG" /D "_CONSOLE" /D "_UNICODE" /D "UNICODE" /WX- /Zc:forScope /Gd /Oi /MD /std:c++17
+
+rem hot kernels are compiled once per instruction set and picked at runtime (MSVC has no separate SSE4.1 switch)
+cl %CL_FLAGS% /c /D "BUMPX_ISA=sse2" ".\src\kernels.cpp" /Fo".\_build\kernels_sse2.obj"
+cl %CL_FLAGS% /c /D "BUMPX_ISA=sse41" ".\src\kernels.cpp" /Fo".\_build\kernels_sse41.obj"
+cl %CL_FLAGS% /c /arch:AVX2 /D "BUMPX_ISA=avx2" ".\src\kernels.cpp" /Fo".\_build\kernels_avx2.obj"
+cl %CL_FLAGS% /c /arch:AVX512 /D "BUMPX_ISA=avx512" ".\src\kernels.cpp" /Fo".\_build\kernels_avx512.obj"
+
+cl %CL_FLAGS% /GL ".\src\bumpx.cpp" ".\_build\kernels_sse2.obj" ".\_build\kernels_sse41.obj" ".\_build\kernels_avx2.obj" ".\_build\kernels_avx512.obj" /Fo".\_build\bumpx.obj" /link /out:".\_build\bumpx.exe"
+rem the bench runs bumpx.cpp built as the library, without its main (see bumpx_internal.h)
+cl %CL_FLAGS% /GL /D "BUMPX_CORE_LIBRARY" ".\src\bench.cpp" ".\src\bumpx.cpp" ".\_build\kernels_sse2.obj" ".\_build\kernels_sse41.obj" ".\_build\kernels_avx2.obj" ".\_build\kernels_avx512.obj" /Fo.\_build\ /link /out:".\_build\bumpx_bench.exe"
+del ".\_build\*.obj"
@@ -0,0 +1,14 @@
+#!/bin/sh
+# perf regression gate: builds everything and runs bumpx_bench on the cases of perf/baseline.json, fails if the
+# round-trip error of any case regressed or its median encode throughput dropped, extra arguments go to bumpx_bench
+# (e.g. --tolerance:25)
+# perf/baseline.json holds the errors only, they are the same on any box, the speed is compared against
+# _build/perf_speed.json, the speed baseline of this box, the gate fails if it is missing or of another box, kernels or
+# cases, so make it on the base commit first:
+#   sh perf_gate.sh --make-speed-baseline
+# to update the errors after an intended change of the encoders:
+#   ./_build/bumpx_bench --baseline:perf/baseline.json --write-baseline:perf/baseline.json
+set -e
+
+sh ./build_nix.sh
+./_build/bumpx_bench --baseline:perf/baseline.json --speed-baseline:./_build/perf_speed.json --runs:5 -o:./_build/perf_gate.csv "$@"
@@ -0,0 +1,1065 @@
+// bumpx_bench - runs synthetic normal/gloss/height sets of different sizes through the whole pack pipeline with every
+// BC3 encoder and prints speed, peak memory and the reconstruction error as CSV, or checks them against a baseline
+// links the pipeline of bumpx.cpp (bumpx_core) through bumpx_internal.h, see build_nix.sh and build_win.bat
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <cstdlib>
+#include <limits>
+#include <thread>
+#include <functional>
+#include <unordered_set>
+
+#include "bumpx_internal.h"
+
+using namespace bumpx;
+
+#ifdef _WIN32
+struct BenchProcessMemoryCounters {     // PROCESS_MEMORY_COUNTERS
+    unsigned long   cb;
+    unsigned long   PageFaultCount;
+    size_t          PeakWorkingSetSize;
+    size_t          WorkingSetSize;
+    size_t          QuotaPeakPagedPoolUsage;
+    size_t          QuotaPagedPoolUsage;
+    size_t          QuotaPeakNonPagedPoolUsage;
+    size_t          QuotaNonPagedPoolUsage;
+    size_t          PagefileUsage;
+    size_t          PeakPagefileUsage;
+};
+extern "C" __declspec(dllimport) int __stdcall K32GetProcessMemoryInfo(void* hProcess, BenchProcessMemoryCounters* ppsmemCounters, unsigned long cb);
+#else
+#include <sys/resource.h>
+#endif // _WIN32
+
+#ifdef BUMPX_KERNELS_X86
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#endif // BUMPX_KERNELS_X86
+
+static const size_t kBenchDefaultSizes[] = { 256, 512, 1024, 2048 };    // 4096 and 8192 are for --sizes, they take a while
+static const size_t kBenchMaxSize = 8192;
+static const size_t kBenchGateRetries = 3;     // times a case that looks slower than the baseline is run again
+
+struct BenchSource {
+    Bitmap<PixelRgba>   normalmap{ 0, 0 };
+    Bitmap<PixelMono>   glossmap{ 0, 0 };
+    Bitmap<PixelMono>   heightmap{ 0, 0 };
+};
+
+struct BenchEncoder {
+    const char*                                             name;
+    std::function<void(const Bitmap<PixelRgba>&, void*)>    encode;
+};
+
+static const char* const kBenchSets[] = { "flat", "noisy", "detail", "brick" };
+
+static uint32_t BenchHash(const uint32_t x, const uint32_t y, const uint32_t seed) {
+    uint32_t h = (x * 0x8DA6B343u) ^ (y * 0xD8163841u) ^ (seed * 0xCB1AB31Fu);
+    h ^= h >> 13;
+    h *= 0x5BD1E995u;
+    h ^= h >> 15;
+    return h;
+}
+
+static float BenchNoise(const size_t x, const size_t y, const uint32_t seed) {
+    return scast<float>(BenchHash(scast<uint32_t>(x), scast<uint32_t>(y), seed) & 0xFFFF) / 65535.0f;
+}
+
+// height (0..1) and gloss (0..255) of a set at a pixel, every set is deterministic and tiles
+static void BenchSample(const char* set, const size_t x, const size_t y, const size_t size, float& height, float& gloss) {
+    const std::string name = set;
+    if (name == "flat") {
+        height = 0.5f;
+        gloss = 128.0f;
+    } else if (name == "noisy") {
+        height = BenchNoise(x, y, 1);
+        gloss = 64.0f + 128.0f * BenchNoise(x, y, 2);
+    } else if (name == "detail") {
+        // 8 and 4 pixels periods plus some noise, the worst case for the block encoders
+        const float kTwoPi = 6.28318530718f;
+        height = 0.5f + 0.2f * std::sin(kTwoPi * scast<float>(x % 8) / 8.0f) * std::cos(kTwoPi * scast<float>(y % 4) / 4.0f) +
+                 0.1f * BenchNoise(x, y, 3);
+        gloss = 100.0f + 80.0f * std::sin(kTwoPi * scast<float>((x + y) % 16) / 16.0f);
+    } else {
+        // brick: 8 x 16 bricks per texture, odd rows are shifted by half a brick, beveled edges and a bit of roughness
+        const size_t brickW = size / 8, brickH = size / 16, mortar = std::max<size_t>(1, size / 256);
+        const size_t row = y / brickH;
+        const size_t bx = (x + (row & 1) * (brickW / 2)) % brickW, by = y % brickH;
+        const size_t edge = std::min(std::min(bx, brickW - 1 - bx), std::min(by, brickH - 1 - by));
+        if (edge < mortar) {
+            height = 0.1f * BenchNoise(x, y, 4);
+            gloss = 40.0f;
+        } else {
+            const float bevel = std::min(1.0f, scast<float>(edge - mortar + 1) / scast<float>(mortar * 3));
+            height = 0.3f + 0.6f * bevel + 0.05f * BenchNoise(x, y, 5);
+            gloss = 90.0f + 30.0f * BenchNoise(x / 2, y / 2, 6);
+        }
+    }
+}
+
+static BenchSource MakeBenchSource(const char* set, const size_t size) {
+    BenchSource result;
+    result.normalmap = Bitmap<PixelRgba>(size, size);
+    result.glossmap = Bitmap<PixelMono>(size, size);
+    result.heightmap = Bitmap<PixelMono>(size, size);
+
+    std::vector<float> heights(size * size);
+    for (size_t y = 0; y < size; ++y) {
+        for (size_t x = 0; x < size; ++x) {
+            float height, gloss;
+            BenchSample(set, x, y, size, height, gloss);
+            heights[y * size + x] = height;
+            result.heightmap.pixels[y * size + x].r = scast<uint8_t>(Clamp(height * 255.0f + 0.5f, 0.0f, 255.0f));
+            result.glossmap.pixels[y * size + x].r = scast<uint8_t>(Clamp(gloss + 0.5f, 0.0f, 255.0f));
+        }
+    }
+
+    // normals from the height gradients, wrapping around as the sets tile
+    const float kStrength = 4.0f;
+    for (size_t y = 0; y < size; ++y) {
+        for (size_t x = 0; x < size; ++x) {
+            const float dx = heights[y * size + (x + 1) % size] - heights[y * size + (x + size - 1) % size];
+            const float dy = heights[((y + 1) % size) * size + x] - heights[((y + size - 1) % size) * size + x];
+            float nx = -dx * kStrength, ny = -dy * kStrength, nz = 1.0f;
+            const float invLen = 1.0f / std::sqrt(nx * nx + ny * ny + nz * nz);
+            nx *= invLen; ny *= invLen; nz *= invLen;
+
+            auto toUnorm = [](const float v) { return scast<uint8_t>(Clamp((v * 0.5f + 0.5f) * 255.0f + 0.5f, 0.0f, 255.0f)); };
+            result.normalmap.pixels[y * size + x] = { toUnorm(nx), toUnorm(ny), toUnorm(nz), 0xFF };
+        }
+    }
+
+    return result;
+}
+
+static std::vector<BenchEncoder> MakeBenchEncoders() {
+    std::vector<BenchEncoder> result = {
+        { "stb", [](const Bitmap<PixelRgba>& bmp, void* out) { CompressBC3_STB(bmp, out); } },
+        { "squish-range", [](const Bitmap<PixelRgba>& bmp, void* out) { CompressBC3_Squish(bmp, out, squish::kColourRangeFit); } },
+        { "squish-cluster", [](const Bitmap<PixelRgba>& bmp, void* out) { CompressBC3_Squish(bmp, out, squish::kColourClusterFit); } },
+        { "squish-iterative", [](const Bitmap<PixelRgba>& bmp, void* out) { CompressBC3_Squish(bmp, out, squish::kColourIterativeClusterFit); } }
+    };
+
+    static const char* const kRGBCXNames[] = { "rgbcx-0", "rgbcx-6", "rgbcx-12", "rgbcx-18" };
+    static const uint32_t kRGBCXLevels[] = { kRGBCXMinLevel, 6, 12, kRGBCXMaxLevel };
+    for (size_t i = 0; i < 4; ++i) {
+        const uint32_t level = kRGBCXLevels[i];
+        result.push_back({ kRGBCXNames[i], [level](const Bitmap<PixelRgba>& bmp, void* out) {
+            CompressBC3_RGBCX(bmp, BC1ApproxMode::NVidia, out, level);
+        } });
+    }
+
+    return result;
+}
+
+// peak resident memory since the last call, in bytes, on Windows and macOS the peak can't be reset so it's of the whole run
+static uint64_t PeakRssAndReset() {
+#if defined(_WIN32)
+    BenchProcessMemoryCounters counters = {};
+    counters.cb = sizeof(counters);
+    return K32GetProcessMemoryInfo(rcast<void*>(scast<intptr_t>(-1)), &counters, sizeof(counters)) ? counters.PeakWorkingSetSize : 0;
+#else
+    uint64_t result = 0;
+#if defined(__linux__)
+    std::ifstream status("/proc/self/status");
+    std::string line;
+    while (std::getline(status, line)) {
+        if (line.compare(0, 6, "VmHWM:") == 0) {
+            result = std::stoull(line.substr(6)) * 1024;
+            break;
+        }
+    }
+    std::ofstream("/proc/self/clear_refs") << "5";  // resets VmHWM
+#endif
+    if (!result) {
+        struct rusage usage = {};
+        getrusage(RUSAGE_SELF, &usage);
+#ifdef __APPLE__
+        result = scast<uint64_t>(usage.ru_maxrss);
+#else
+        result = scast<uint64_t>(usage.ru_maxrss) * 1024;
+#endif
+    }
+    return result;
+#endif
+}
+
+static bool IsSelected(const std::vector<String>& selection, const char* name) {
+    return selection.empty() || std::find(selection.begin(), selection.end(), String(name, name + std::strlen(name))) != selection.end();
+}
+
+struct BenchResult {
+    std::string set;
+    size_t      size = 0;
+    std::string encoder;
+    double      totalMs = 0.0;
+    double      encodeMs = 0.0;
+    double      mpixPerSecond = 0.0;
+    double      peakRssMb = 0.0;
+    double      normalMeanDeg = 0.0;
+    double      normalMaxDeg = 0.0;
+    double      glossPsnrDb = 0.0;      // infinity if lossless
+    double      heightPsnrDb = 0.0;
+};
+
+static double Median(std::vector<double> values) {
+    std::sort(values.begin(), values.end());
+    const size_t half = values.size() / 2;
+    return (values.size() & 1) ? values[half] : (values[half - 1] + values[half]) * 0.5;
+}
+
+// runs the same steps as PackBump, minus the files, numRuns times and keeps the median times, a single slow run
+// (a context switch, a page fault storm) doesn't move the median the way it moves a mean, a single fast one doesn't
+// either unlike the best time, the error is the same every run as every encoder and every kernel variant is deterministic
+static BenchResult RunBench(const BenchSource& source, const char* set, const size_t size, const BenchEncoder& encoder, const size_t numRuns) {
+    using Clock = std::chrono::steady_clock;
+
+    BenchResult result;
+    result.set = set;
+    result.size = size;
+    result.encoder = encoder.name;
+
+    std::vector<double> totalTimes, encodeTimes;
+    for (size_t run = 0; run < numRuns; ++run) {
+        Bitmap<PixelRgba> normalmap = source.normalmap;
+        std::future<Bitmap<PixelMono>> glossmapFuture = std::async(std::launch::deferred, [&source]() { return source.glossmap; });
+        std::future<Bitmap<PixelMono>> heightmapFuture = std::async(std::launch::deferred, [&source]() { return source.heightmap; });
+        PeakRssAndReset();
+
+        const auto startTime = Clock::now();
+
+        Texture<PixelRgba> normalmapWithMips(size, size);
+        Texture<PixelMono> heightmapWithMips(size, size);
+        BuildBumpMips(false, normalmap, glossmapFuture, heightmapFuture, normalmapWithMips, heightmapWithMips);
+
+        const size_t numMips = normalmapWithMips.mips.size();
+        std::vector<BytesArray> bumpMips(numMips), bumpXMips(numMips);
+        double encodeMs = 0.0;
+        for (size_t i = 0; i < numMips; ++i) {
+            const auto& mip = normalmapWithMips.mips[i];
+            bumpMips[i].resize((mip.width / 4) * (mip.height / 4) * 16);
+            bumpXMips[i].resize(bumpMips[i].size());
+            CompressBumpPairWith(encoder.encode, mip, heightmapWithMips.mips[i], bumpMips[i].data(), bumpXMips[i].data(),
+                                 encodeMs, encodeMs, scast<int>(i));
+        }
+
+        totalTimes.push_back(std::chrono::duration<double, std::milli>(Clock::now() - startTime).count());
+        encodeTimes.push_back(encodeMs);
+        result.peakRssMb = std::max(result.peakRssMb, scast<double>(PeakRssAndReset()) / (1024.0 * 1024.0));
+
+        if (run == 0) {
+            RoundtripStats stats;
+            for (size_t i = 0; i < numMips; ++i) {
+                MeasureRoundtrip(normalmapWithMips.mips[i], heightmapWithMips.mips[i], bumpMips[i].data(), bumpXMips[i].data(), stats);
+            }
+            result.normalMeanDeg = stats.normalErrorSum / scast<double>(std::max<size_t>(1, stats.numPixels));
+            result.normalMaxDeg = stats.normalErrorMax;
+            result.glossPsnrDb = PSNR(stats.glossSquaredError, stats.numPixels);
+            result.heightPsnrDb = PSNR(stats.heightSquaredError, stats.numPixels);
+        }
+    }
+
+    result.totalMs = Median(totalTimes);
+    result.encodeMs = Median(encodeTimes);
+    result.mpixPerSecond = scast<double>(size * size) / (result.totalMs * 1000.0);
+    return result;
+}
+
+
+// baselines for the perf gate (perf_gate.sh), json objects with one result per line, of two kinds:
+// - the quality baseline (perf/baseline.json): the cases the gate runs and their round-trip errors, the same on any box
+//   as every encoder and every kernel variant is deterministic, so the corpus is defined by the baseline file itself
+// - the speed baseline: the median encode time of every case, only comparable on the box and with the kernels it was
+//   made with, so it is never checked in, the gate makes one on its first run and compares against it afterwards
+struct BenchBaseline {
+    std::string                 kernels;    // speed baselines only
+    std::string                 host;
+    std::vector<BenchResult>    results;
+};
+
+// the cpu brand string and the number of hardware threads
+static std::string BenchHost() {
+    std::string cpu;
+#ifdef BUMPX_KERNELS_X86
+    uint32_t brand[13] = { 0 };     // 48 chars and the terminator
+#ifdef _MSC_VER
+    int regs[4];
+    __cpuid(regs, scast<int>(0x80000000u));
+    if (scast<uint32_t>(regs[0]) >= 0x80000004u) {
+        for (uint32_t i = 0; i < 3; ++i) {
+            __cpuid(regs, scast<int>(0x80000002u + i));
+            std::memcpy(&brand[i * 4], regs, sizeof(regs));
+        }
+    }
+#else
+    for (uint32_t i = 0; i < 3; ++i) {
+        __get_cpuid(0x80000002u + i, &brand[i * 4], &brand[i * 4 + 1], &brand[i * 4 + 2], &brand[i * 4 + 3]);
+    }
+#endif
+    cpu = rcast<const char*>(brand);
+#endif // BUMPX_KERNELS_X86
+
+    // it goes into the json as is
+    std::replace_if(cpu.begin(), cpu.end(), [](const char c) { return c == '"' || c == '\\'; }, ' ');
+    cpu.erase(0, std::min(cpu.length(), cpu.find_first_not_of(' ')));
+    cpu.erase(cpu.find_last_not_of(' ') + 1);
+    return (cpu.empty() ? std::string("unknown cpu") : cpu) + ", " + std::to_string(std::thread::hardware_concurrency()) + " threads";
+}
+
+static std::string BenchJsonNumber(const double v) {
+    if (!std::isfinite(v)) {
+        return "null";      // lossless PSNR
+    }
+    std::ostringstream result;
+    result << std::fixed << std::setprecision(3) << v;
+    return result.str();
+}
+
+// speed - a speed baseline of this box and kernels, otherwise a quality baseline
+static bool WriteBenchBaseline(const fs::path& path, const std::vector<BenchResult>& results, const bool speed) {
+    std::ofstream file(path);
+    file << "{\n";
+    if (speed) {
+        file << "  \"kernels\": \"" << gKernels->name << "\",\n  \"host\": \"" << BenchHost() << "\",\n";
+    }
+    file << "  \"results\": [\n";
+    for (size_t i = 0; i < results.size(); ++i) {
+        const BenchResult& r = results[i];
+        file << "    { \"set\": \"" << r.set << "\", \"size\": " << r.size << ", \"encoder\": \"" << r.encoder << "\"";
+        if (speed) {
+            file << ", \"encode_ms\": " << BenchJsonNumber(r.encodeMs);
+        } else {
+            file << ", \"normal_mean_deg\": " << BenchJsonNumber(r.normalMeanDeg) << ", \"normal_max_deg\": " << BenchJsonNumber(r.normalMaxDeg)
+                 << ", \"gloss_psnr_db\": " << BenchJsonNumber(r.glossPsnrDb) << ", \"height_psnr_db\": " << BenchJsonNumber(r.heightPsnrDb);
+        }
+        file << " }" << (i + 1 < results.size() ? "," : "") << "\n";
+    }
+    file << "  ]\n}\n";
+    return file.good();
+}
+
+// the value of "key" in a line written by WriteBenchBaseline, strings without the quotes
+static bool BenchJsonField(const std::string& line, const char* key, std::string& value) {
+    const std::string pattern = std::string("\"") + key + "\":";
+    size_t pos = line.find(pattern);
+    if (pos == std::string::npos) {
+        return false;
+    }
+    pos = line.find_first_not_of(' ', pos + pattern.length());
+    if (pos == std::string::npos) {
+        return false;
+    }
+    if (line[pos] == '"') {
+        const size_t end = line.find('"', pos + 1);
+        value = line.substr(pos + 1, end - pos - 1);
+        return end != std::string::npos;
+    }
+    value = line.substr(pos, line.find_first_of(", }", pos) - pos);
+    return !value.empty();
+}
+
+static bool BenchJsonDouble(const std::string& line, const char* key, double& value) {
+    std::string str;
+    if (!BenchJsonField(line, key, str)) {
+        return false;
+    }
+    if (str == "null") {
+        value = std::numeric_limits<double>::infinity();
+        return true;
+    }
+    char* end = nullptr;
+    value = std::strtod(str.c_str(), &end);
+    return end && *end == 0;
+}
+
+static bool ReadBenchBaseline(const fs::path& path, const bool speed, BenchBaseline& baseline) {
+    std::ifstream file(path);
+    if (!file.good()) {
+        return false;
+    }
+
+    std::string line;
+    while (std::getline(file, line)) {
+        if (line.find("\"encoder\":") == std::string::npos) {
+            std::string value;
+            if (BenchJsonField(line, "kernels", value)) {
+                baseline.kernels = value;
+            } else if (BenchJsonField(line, "host", value)) {
+                baseline.host = value;
+            }
+            continue;
+        }
+        BenchResult r;
+        double size = 0.0;
+        if (!BenchJsonField(line, "set", r.set) || !BenchJsonDouble(line, "size", size) || !BenchJsonField(line, "encoder", r.encoder)) {
+            return false;
+        }
+        if (speed ? !BenchJsonDouble(line, "encode_ms", r.encodeMs) :
+                    (!BenchJsonDouble(line, "normal_mean_deg", r.normalMeanDeg) || !BenchJsonDouble(line, "normal_max_deg", r.normalMaxDeg) ||
+                     !BenchJsonDouble(line, "gloss_psnr_db", r.glossPsnrDb) || !BenchJsonDouble(line, "height_psnr_db", r.heightPsnrDb))) {
+            return false;
+        }
+        r.size = scast<size_t>(size);
+        baseline.results.push_back(r);
+    }
+    return !baseline.results.empty() && (!speed || (!baseline.kernels.empty() && !baseline.host.empty()));
+}
+
+static bool SameBenchCases(const std::vector<BenchResult>& a, const std::vector<BenchResult>& b) {
+    return std::equal(a.begin(), a.end(), b.begin(), b.end(), [](const BenchResult& x, const BenchResult& y) {
+        return x.set == y.set && x.size == y.size && x.encoder == y.encoder;
+    });
+}
+
+static double EncodeMpixPerSecond(const BenchResult& r) {
+    return scast<double>(r.size * r.size) / (r.encodeMs * 1000.0);
+}
+
+static void ReportRegression(const BenchResult& result, const Char* what, const double value, const double baselineValue) {
+    ConsoleErr << _T("REGRESSION ") << result.set.c_str() << _T(" ") << result.size << _T(" ") << result.encoder.c_str() << _T(": ")
+               << what << _T(" ") << value << _T(" vs baseline ") << baselineValue << std::endl;
+}
+
+// prints every regression to ConsoleErr, the errors may grow by errorTolerance percents
+static size_t CompareQuality(const BenchResult& result, const BenchResult& baseline, const int errorTolerance) {
+    const double errorScale = 1.0 + scast<double>(errorTolerance) / 100.0;
+
+    size_t numRegressions = 0;
+    auto report = [&](const Char* what, const double value, const double baselineValue) {
+        ReportRegression(result, what, value, baselineValue);
+        ++numRegressions;
+    };
+
+    if (result.normalMeanDeg > baseline.normalMeanDeg * errorScale + 1e-3) {
+        report(_T("normal mean deg"), result.normalMeanDeg, baseline.normalMeanDeg);
+    }
+    if (result.normalMaxDeg > baseline.normalMaxDeg * errorScale + 1e-3) {
+        report(_T("normal max deg"), result.normalMaxDeg, baseline.normalMaxDeg);
+    }
+    if (result.glossPsnrDb < baseline.glossPsnrDb / errorScale - 1e-3) {
+        report(_T("gloss PSNR dB"), result.glossPsnrDb, baseline.glossPsnrDb);
+    }
+    if (result.heightPsnrDb < baseline.heightPsnrDb / errorScale - 1e-3) {
+        report(_T("height PSNR dB"), result.heightPsnrDb, baseline.heightPsnrDb);
+    }
+    return numRegressions;
+}
+
+// the encode throughput may drop by speedTolerance percents
+static size_t CompareSpeed(const BenchResult& result, const BenchResult& baseline, const int speedTolerance, const bool report) {
+    const double speedScale = 1.0 - scast<double>(speedTolerance) / 100.0;
+    if (EncodeMpixPerSecond(result) >= EncodeMpixPerSecond(baseline) * speedScale) {
+        return 0;
+    }
+    if (report) {
+        ReportRegression(result, _T("encode MPix/s"), EncodeMpixPerSecond(result), EncodeMpixPerSecond(baseline));
+    }
+    return 1;
+}
+
+// writes the selected sets as name_size_normal.png, name_size_gloss.png and name_size_height.png, to run bumpx itself on them
+// (e.g. the PGO training of the CMake build) or to extract a corpus from them
+static int WriteBenchSets(const fs::path& folder, const std::vector<String>& setsList, const std::vector<size_t>& sizes) {
+    std::error_code errorCode;
+    fs::create_directories(folder, errorCode);
+
+    for (const char* set : kBenchSets) {
+        if (!IsSelected(setsList, set)) {
+            continue;
+        }
+        for (const size_t size : sizes) {
+            const BenchSource source = MakeBenchSource(set, size);
+            const String base = String(set, set + std::strlen(set)) + _T("_") + ToString(size);
+            if (!WritePng(folder / (base + _T("_normal.png")), rcast<const uint8_t*>(source.normalmap.pixels.data()), size, size, 4) ||
+                !WritePng(folder / (base + _T("_gloss.png")), rcast<const uint8_t*>(source.glossmap.pixels.data()), size, size, 1) ||
+                !WritePng(folder / (base + _T("_height.png")), rcast<const uint8_t*>(source.heightmap.pixels.data()), size, size, 1)) {
+                Cerr << _T("Failed to write ") << base << _T(" to ") << folder << std::endl;
+                return -1;
+            }
+        }
+    }
+    return 0;
+}
+
+
+// block corpus: the swizzled 4x4 bump and bump# blocks of real textures, exactly what the BC3 encoders get in PackBump,
+// deduplicated and sampled per variance stratum, so the encoders can be timed and tuned on real data in isolation
+// file: "BXBC", version, number of blocks, then the blocks
+static const uint32_t kCorpusSignature = 0x43425842;    // "BXBC"
+static const uint32_t kCorpusVersion = 1;
+static const size_t kCorpusNumStrata = 8;
+static const size_t kCorpusDefaultMaxBlocks = 8192;     // per kind and stratum
+
+enum CorpusBlockKind : uint8_t {
+    kCorpusBump     = 0,
+    kCorpusBumpX    = 1,
+
+    kCorpusNumKinds
+};
+
+static const char* const kCorpusKindsNames[kCorpusNumKinds] = { "bump", "bump#" };
+
+struct CorpusBlock {
+    uint8_t kind;
+    uint8_t stratum;
+    uint8_t pixels[16 * 4];     // rgba, row by row
+};
+static_assert(sizeof(CorpusBlock) == 66, "CorpusBlock is written to the corpus as is");
+
+// stratum 0 - flat blocks (the variance of every channel summed up is under 1), then every next one is 4 times the variance
+static uint8_t CorpusBlockStratum(const uint8_t* pixels) {
+    double variance = 0.0;
+    for (size_t c = 0; c < 4; ++c) {
+        double sum = 0.0, sumSq = 0.0;
+        for (size_t i = 0; i < 16; ++i) {
+            const double v = scast<double>(pixels[i * 4 + c]);
+            sum += v;
+            sumSq += v * v;
+        }
+        variance += sumSq / 16.0 - (sum / 16.0) * (sum / 16.0);
+    }
+
+    uint8_t stratum = 0;
+    while (scast<size_t>(stratum) + 1 < kCorpusNumStrata && variance >= scast<double>(1ull << (2 * stratum))) {
+        ++stratum;
+    }
+    return stratum;
+}
+
+class CorpusBuilder {
+public:
+    explicit CorpusBuilder(const size_t maxBlocksPerStratum) : mMaxBlocks(maxBlocksPerStratum) {}
+
+    void AddMip(const CorpusBlockKind kind, const Bitmap<PixelRgba>& mip) {
+        const uint8_t* src = rcast<const uint8_t*>(mip.pixels.data());
+        for (size_t y = 0; y < mip.height; y += 4) {
+            for (size_t x = 0; x < mip.width; x += 4) {
+                CorpusBlock block;
+                block.kind = kind;
+                for (size_t i = 0; i < 4; ++i) {
+                    std::memcpy(&block.pixels[i * 16], src + ((y + i) * mip.width + x) * 4, 16);
+                }
+                this->AddBlock(block);
+            }
+        }
+    }
+
+    // reservoir sampling per stratum with BenchHash as the random source, so the result is the same every time
+    void AddBlock(CorpusBlock& block) {
+        if (!mHashes.insert(HashBytes(block.pixels, sizeof(block.pixels), HashBytes(&block.kind, 1))).second) {
+            return;
+        }
+
+        block.stratum = CorpusBlockStratum(block.pixels);
+        Stratum& stratum = mStrata[block.kind][block.stratum];
+        ++stratum.numUnique;
+        if (stratum.blocks.size() < mMaxBlocks) {
+            stratum.blocks.push_back(block);
+        } else {
+            const uint64_t n = stratum.numUnique;
+            const uint64_t j = BenchHash(scast<uint32_t>(n), scast<uint32_t>(n >> 32), block.kind * kCorpusNumStrata + block.stratum) % n;
+            if (j < mMaxBlocks) {
+                stratum.blocks[scast<size_t>(j)] = block;
+            }
+        }
+    }
+
+    bool Write(const fs::path& path) const {
+        uint32_t numBlocks = 0;
+        for (const auto& kind : mStrata) {
+            for (const Stratum& stratum : kind) {
+                numBlocks += scast<uint32_t>(stratum.blocks.size());
+            }
+        }
+
+        std::ofstream file(path, std::ios::binary);
+        file.write(rcast<const char*>(&kCorpusSignature), sizeof(kCorpusSignature));
+        file.write(rcast<const char*>(&kCorpusVersion), sizeof(kCorpusVersion));
+        file.write(rcast<const char*>(&numBlocks), sizeof(numBlocks));
+        for (const auto& kind : mStrata) {
+            for (const Stratum& stratum : kind) {
+                file.write(rcast<const char*>(stratum.blocks.data()), scast<std::streamsize>(stratum.blocks.size() * sizeof(CorpusBlock)));
+            }
+        }
+        return file.good();
+    }
+
+    void PrintSummary() const {
+        for (size_t kind = 0; kind < kCorpusNumKinds; ++kind) {
+            for (size_t i = 0; i < kCorpusNumStrata; ++i) {
+                const Stratum& stratum = mStrata[kind][i];
+                ConsoleErr << kCorpusKindsNames[kind] << _T(" stratum ") << i << _T(": ") << stratum.blocks.size()
+                           << _T(" of ") << stratum.numUnique << _T(" unique blocks") << std::endl;
+            }
+        }
+    }
+
+private:
+    struct Stratum {
+        std::vector<CorpusBlock>    blocks;
+        uint64_t                    numUnique = 0;
+    };
+
+    size_t                          mMaxBlocks;
+    std::unordered_set<uint64_t>    mHashes;
+    Stratum                         mStrata[kCorpusNumKinds][kCorpusNumStrata];
+};
+
+static bool ReadCorpus(const fs::path& path, std::vector<CorpusBlock>& blocks) {
+    std::ifstream file(path, std::ios::binary);
+    uint32_t signature = 0, version = 0, numBlocks = 0;
+    file.read(rcast<char*>(&signature), sizeof(signature));
+    file.read(rcast<char*>(&version), sizeof(version));
+    file.read(rcast<char*>(&numBlocks), sizeof(numBlocks));
+    if (!file.good() || signature != kCorpusSignature || version != kCorpusVersion) {
+        return false;
+    }
+
+    blocks.resize(numBlocks);
+    file.read(rcast<char*>(blocks.data()), scast<std::streamsize>(blocks.size() * sizeof(CorpusBlock)));
+    return file.good() && std::all_of(blocks.begin(), blocks.end(), [](const CorpusBlock& b) {
+        return b.kind < kCorpusNumKinds && b.stratum < kCorpusNumStrata;
+    });
+}
+
+// the normalmaps to extract from: the files as is, the folders are searched for name_normal.ext, the way UnpackBump names them,
+// name_gloss.ext and name_height.ext next to a normalmap are its glossmap and heightmap
+static std::vector<fs::path> FindCorpusNormalmaps(const std::vector<String>& inputs) {
+    static const String kImageExtensions[] = { _T(".png"), _T(".tga"), _T(".jpg"), _T(".jpeg"), _T(".bmp"), _T(".psd") };
+
+    std::vector<fs::path> result;
+    for (const String& input : inputs) {
+        std::error_code errorCode;
+        if (!fs::is_directory(input, errorCode)) {
+            result.push_back(input);
+            continue;
+        }
+
+        for (fs::recursive_directory_iterator it(input, errorCode), end; !errorCode && it != end; it.increment(errorCode)) {
+            const fs::path& path = it->path();
+            const String extension = StrToLower(path.extension().native());
+            if (it->is_regular_file(errorCode) && StrEndsWith(path.stem().native(), _T("_normal")) &&
+                std::find(std::begin(kImageExtensions), std::end(kImageExtensions), extension) != std::end(kImageExtensions)) {
+                result.push_back(path);
+            }
+        }
+    }
+    std::sort(result.begin(), result.end());
+    return result;
+}
+
+static int ExtractCorpus(const fs::path& corpusPath, const std::vector<String>& inputs, const BenchEncoder& residualEncoder, const size_t maxBlocks) {
+    const std::vector<fs::path> normalmaps = FindCorpusNormalmaps(inputs);
+    if (normalmaps.empty()) {
+        Cerr << _T("No normalmaps to extract the blocks from") << std::endl;
+        return -1;
+    }
+
+    CorpusBuilder corpus(maxBlocks);
+    size_t numTextures = 0;
+    for (const fs::path& normalmapPath : normalmaps) {
+        Bitmap<PixelRgba> normalmap = LoadBitmap<PixelRgba>(normalmapPath);
+        if (normalmap.empty() || normalmap.width < kMinMipSize || normalmap.height < kMinMipSize ||
+            !IsPowerOfTwo(normalmap.width) || !IsPowerOfTwo(normalmap.height)) {
+            ConsoleErr << _T("Skipping ") << normalmapPath << _T(", not an image with power of two dimensions") << std::endl;
+            continue;
+        }
+
+        String base = normalmapPath.stem().native();
+        if (StrEndsWith(base, _T("_normal"))) {
+            base.resize(base.length() - 7);
+        }
+        const fs::path glossmapPath = normalmapPath.parent_path() / (base + _T("_gloss") + normalmapPath.extension().native());
+        const fs::path heightmapPath = normalmapPath.parent_path() / (base + _T("_height") + normalmapPath.extension().native());
+        std::future<Bitmap<PixelMono>> glossmapFuture = std::async(std::launch::deferred, [&]() {
+            return (base != normalmapPath.stem().native()) ? LoadBitmap<PixelMono>(glossmapPath) : Bitmap<PixelMono>(0, 0);
+        });
+        std::future<Bitmap<PixelMono>> heightmapFuture = std::async(std::launch::deferred, [&]() {
+            return (base != normalmapPath.stem().native()) ? LoadBitmap<PixelMono>(heightmapPath) : Bitmap<PixelMono>(0, 0);
+        });
+
+        ConsoleErr << _T("Extracting blocks of ") << normalmapPath << std::endl;
+        Texture<PixelRgba> normalmapWithMips(normalmap.width, normalmap.height);
+        Texture<PixelMono> heightmapWithMips(normalmap.width, normalmap.height);
+        BuildBumpMips(false, normalmap, glossmapFuture, heightmapFuture, normalmapWithMips, heightmapWithMips);
+
+        for (size_t i = 0; i < normalmapWithMips.mips.size(); ++i) {
+            const Bitmap<PixelRgba>& bumpMip = normalmapWithMips.mips[i];
+            BytesArray compressedBump((bumpMip.width / 4) * (bumpMip.height / 4) * 16);
+            residualEncoder.encode(bumpMip, compressedBump.data());
+
+            Bitmap<PixelRgba> bumpXMip(bumpMip.width, bumpMip.height);
+            MakeBumpXMip(bumpMip, heightmapWithMips.mips[i], compressedBump.data(), bumpXMip);
+
+            corpus.AddMip(kCorpusBump, bumpMip);
+            corpus.AddMip(kCorpusBumpX, bumpXMip);
+        }
+        ++numTextures;
+    }
+
+    corpus.PrintSummary();
+    if (!corpus.Write(corpusPath)) {
+        Cerr << _T("Failed to write corpus ") << corpusPath << std::endl;
+        return -1;
+    }
+    ConsoleErr << _T("Extracted ") << numTextures << _T(" of ") << normalmaps.size() << _T(" textures to ") << corpusPath << std::endl;
+    return 0;
+}
+
+// the encoders entry points on a single block, no row gathering and no allocations around them
+struct BlockEncoder {
+    std::string name;
+    void        (*encode)(const uint8_t* rgba, uint8_t* outBlock, int param);
+    int         param;
+};
+
+static std::vector<BlockEncoder> MakeBlockEncoders() {
+    std::vector<BlockEncoder> result = {
+        { "stb", [](const uint8_t* rgba, uint8_t* out, int) { gKernels->CompressBC3_STB(rgba, 4, 4, out); }, 0 },
+        { "squish-range", [](const uint8_t* rgba, uint8_t* out, int fit) { squish::Compress(rgba, out, squish::kDxt5 | fit); }, squish::kColourRangeFit },
+        { "squish-cluster", [](const uint8_t* rgba, uint8_t* out, int fit) { squish::Compress(rgba, out, squish::kDxt5 | fit); }, squish::kColourClusterFit },
+        { "squish-iterative", [](const uint8_t* rgba, uint8_t* out, int fit) { squish::Compress(rgba, out, squish::kDxt5 | fit); }, squish::kColourIterativeClusterFit }
+    };
+    for (uint32_t level = kRGBCXMinLevel; level <= kRGBCXMaxLevel; ++level) {
+        result.push_back({ "rgbcx-" + std::to_string(level), [](const uint8_t* rgba, uint8_t* out, int level) {
+            gKernels->CompressBC3_RGBCX(rgba, 4, 4, out, BC1ApproxMode::NVidia, scast<uint32_t>(level));
+        }, scast<int>(level) });
+    }
+    return result;
+}
+
+// times every selected encoder on every kind and stratum of the corpus (the best of numRuns) and measures its rgba rmse
+static int RunCorpusBench(const fs::path& corpusPath, const std::vector<String>& encodersList, const size_t numRuns, std::ostream& csv) {
+    std::vector<CorpusBlock> blocks;
+    if (!ReadCorpus(corpusPath, blocks)) {
+        Cerr << _T("Failed to read corpus ") << corpusPath << std::endl;
+        return -1;
+    }
+
+    // the blocks of a kind and stratum together, then the source pixels of every group are contiguous
+    std::stable_sort(blocks.begin(), blocks.end(), [](const CorpusBlock& a, const CorpusBlock& b) {
+        return a.kind != b.kind ? a.kind < b.kind : a.stratum < b.stratum;
+    });
+
+    csv << "encoder,kernels,kind,stratum,blocks,ns_per_block,mpix_per_s,rmse" << std::endl;
+    csv << std::fixed << std::setprecision(3);
+
+    BytesArray compressed(blocks.size() * 16);
+    for (const BlockEncoder& encoder : MakeBlockEncoders()) {
+        if (!IsSelected(encodersList, encoder.name.c_str())) {
+            continue;
+        }
+        ConsoleErr << encoder.name.c_str() << _T("...") << std::endl;
+
+        for (size_t first = 0; first < blocks.size();) {
+            size_t last = first;
+            while (last < blocks.size() && blocks[last].kind == blocks[first].kind && blocks[last].stratum == blocks[first].stratum) {
+                ++last;
+            }
+
+            double bestNs = std::numeric_limits<double>::max();
+            for (size_t run = 0; run < numRuns; ++run) {
+                const auto startTime = std::chrono::steady_clock::now();
+                for (size_t i = first; i < last; ++i) {
+                    encoder.encode(blocks[i].pixels, compressed.data() + i * 16, encoder.param);
+                }
+                bestNs = std::min(bestNs, std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - startTime).count());
+            }
+
+            double squaredError = 0.0;
+            uint8_t decoded[16 * 4];
+            for (size_t i = first; i < last; ++i) {
+                gKernels->DecompressBC3(compressed.data() + i * 16, decoded, 4, 4);
+                for (size_t j = 0; j < sizeof(decoded); ++j) {
+                    const double d = scast<double>(decoded[j]) - scast<double>(blocks[i].pixels[j]);
+                    squaredError += d * d;
+                }
+            }
+
+            const size_t numBlocks = last - first;
+            csv << encoder.name << ',' << gKernels->name << ',' << kCorpusKindsNames[blocks[first].kind] << ','
+                << scast<int>(blocks[first].stratum) << ',' << numBlocks << ','
+                << bestNs / scast<double>(numBlocks) << ',' << scast<double>(numBlocks * 16) * 1000.0 / bestNs << ','
+                << std::sqrt(squaredError / scast<double>(numBlocks * 16 * 4)) << std::endl;
+            first = last;
+        }
+    }
+    return 0;
+}
+
+static void PrintBenchUsage() {
+    Cerr << _T("Usage:") << std::endl;
+    Cerr << _T("  bumpx_bench --sizes:256,1024 --sets:flat,noisy,detail,brick --encoders:stb,rgbcx-18 --cpu:kernels --runs:3 -o:results.csv") << std::endl;
+    Cerr << _T("    every option can be omitted, by default all the sets and encoders are run at 256 to 2048, sizes go up to 8192") << std::endl;
+    Cerr << _T("    encoders: stb, squish-range, squish-cluster, squish-iterative, rgbcx-0, rgbcx-6, rgbcx-12, rgbcx-18") << std::endl;
+    Cerr << _T("    --runs:n - run every case n times and keep the median times (1 by default)") << std::endl;
+    Cerr << _T("    CSV goes to stdout if no output file provided, progress goes to stderr") << std::endl;
+    Cerr << _T("  bumpx_bench ... --write-baseline:baseline.json") << std::endl;
+    Cerr << _T("    also writes the cases and their errors as the quality baseline of the perf gate") << std::endl;
+    Cerr << _T("  bumpx_bench --baseline:baseline.json --speed-baseline:speed.json --tolerance:15 --error-tolerance:1 --runs:5") << std::endl;
+    Cerr << _T("    perf gate: runs the cases of the baseline and fails if any error grows by more than --error-tolerance percents (1),") << std::endl;
+    Cerr << _T("    --sizes, --sets and --encoders are ignored") << std::endl;
+    Cerr << _T("    and if the median encode throughput drops by more than --tolerance percents (15) against --speed-baseline,") << std::endl;
+    Cerr << _T("    the speed baseline is of this box only: a missing one or one of other kernels, another cpu or other cases fails") << std::endl;
+    Cerr << _T("    the gate, --make-speed-baseline writes it from this run instead of checking the speed (run it on the base commit)") << std::endl;
+    Cerr << _T("  bumpx_bench --write-sets:folder --sizes:512 --sets:brick") << std::endl;
+    Cerr << _T("    writes the sets as png files (name_size_normal.png, name_size_gloss.png, name_size_height.png)") << std::endl;
+    Cerr << _T("  bumpx_bench --extract:corpus.bxc --residual:rgbcx-18 --max-blocks:8192 path_to_normalmap_or_folder ...") << std::endl;
+    Cerr << _T("    extracts the bump and bump# blocks the encoders get from real textures to a corpus, deduplicated and up to") << std::endl;
+    Cerr << _T("    --max-blocks per kind and variance stratum, folders are searched for *_normal.* (+ *_gloss.*, *_height.*)") << std::endl;
+    Cerr << _T("    --residual is the encoder the bump is compressed with to get the bump#, as -q:2 does by default") << std::endl;
+    Cerr << _T("  bumpx_bench --corpus:corpus.bxc --encoders:stb,rgbcx-18 --runs:3 -o:results.csv") << std::endl;
+    Cerr << _T("    times every encoder entry point on the blocks of the corpus per kind and stratum, rgbcx at every level 0 to 18") << std::endl;
+}
+
+int Main(int argc, Char** argv) {
+    String paramCpu, paramOutput, paramBaseline, paramSpeedBaseline, paramWriteBaseline, paramExtract, paramCorpus, paramWriteSets, paramResidual = _T("rgbcx-18");
+    std::vector<String> sizesList, setsList, encodersList, inputs;
+    int numRuns = 1, speedTolerance = 15, errorTolerance = 1, maxBlocks = scast<int>(kCorpusDefaultMaxBlocks);
+    bool makeSpeedBaseline = false;
+    for (int i = 1; i < argc; ++i) {
+        const String s = argv[i];
+        bool good = true;
+        if (StrStartsWith(s, _T("--cpu:"))) {
+            paramCpu = s.substr(6);
+        } else if (StrStartsWith(s, _T("--sizes:"))) {
+            sizesList = StrSplit(s.substr(8), _T(','));
+        } else if (StrStartsWith(s, _T("--sets:"))) {
+            setsList = StrSplit(s.substr(7), _T(','));
+        } else if (StrStartsWith(s, _T("--encoders:"))) {
+            encodersList = StrSplit(s.substr(11), _T(','));
+        } else if (StrStartsWith(s, _T("--runs:"))) {
+            good = StrToInt(s.substr(7), numRuns) && numRuns > 0;
+        } else if (StrStartsWith(s, _T("--baseline:"))) {
+            paramBaseline = s.substr(11);
+        } else if (StrStartsWith(s, _T("--speed-baseline:"))) {
+            paramSpeedBaseline = s.substr(17);
+        } else if (s == _T("--make-speed-baseline")) {
+            makeSpeedBaseline = true;
+        } else if (StrStartsWith(s, _T("--write-baseline:"))) {
+            paramWriteBaseline = s.substr(17);
+        } else if (StrStartsWith(s, _T("--tolerance:"))) {
+            good = StrToInt(s.substr(12), speedTolerance) && speedTolerance < 100;
+        } else if (StrStartsWith(s, _T("--error-tolerance:"))) {
+            good = StrToInt(s.substr(18), errorTolerance);
+        } else if (StrStartsWith(s, _T("--extract:"))) {
+            paramExtract = s.substr(10);
+        } else if (StrStartsWith(s, _T("--residual:"))) {
+            paramResidual = s.substr(11);
+        } else if (StrStartsWith(s, _T("--max-blocks:"))) {
+            good = StrToInt(s.substr(13), maxBlocks) && maxBlocks > 0;
+        } else if (StrStartsWith(s, _T("--corpus:"))) {
+            paramCorpus = s.substr(9);
+        } else if (StrStartsWith(s, _T("--write-sets:"))) {
+            paramWriteSets = s.substr(13);
+        } else if (StrStartsWith(s, _T("-o:"))) {
+            paramOutput = s.substr(3);
+        } else if (!StrStartsWith(s, _T("-"))) {
+            inputs.push_back(s);
+        } else {
+            good = false;
+        }
+
+        if (!good) {
+            PrintBenchUsage();
+            return -1;
+        }
+    }
+
+    if (inputs.empty() == !paramExtract.empty() || (!paramSpeedBaseline.empty() && paramBaseline.empty()) ||
+        (makeSpeedBaseline && paramSpeedBaseline.empty())) {
+        PrintBenchUsage();
+        return -1;
+    }
+
+    std::vector<size_t> sizes(std::begin(kBenchDefaultSizes), std::end(kBenchDefaultSizes));
+    if (!sizesList.empty()) {
+        sizes.clear();
+        for (const String& v : sizesList) {
+            int size = 0;
+            if (!StrToInt(v, size) || size < 16 || scast<size_t>(size) > kBenchMaxSize || !IsPowerOfTwo(scast<size_t>(size))) {
+                Cerr << _T("Bad size \"") << v << _T("\", must be a power of two from 16 to ") << kBenchMaxSize << std::endl;
+                return -1;
+            }
+            sizes.push_back(scast<size_t>(size));
+        }
+    }
+
+    if (!SelectKernels(paramCpu)) {
+        return -1;
+    }
+
+    const std::vector<BenchEncoder> encoders = MakeBenchEncoders();
+    auto findEncoder = [&encoders](const std::string& name)->const BenchEncoder* {
+        auto it = std::find_if(encoders.begin(), encoders.end(), [&name](const BenchEncoder& e) { return name == e.name; });
+        return it == encoders.end() ? nullptr : &(*it);
+    };
+    auto findSet = [](const std::string& name)->const char* {
+        auto it = std::find_if(std::begin(kBenchSets), std::end(kBenchSets), [&name](const char* set) { return name == set; });
+        return it == std::end(kBenchSets) ? nullptr : *it;
+    };
+
+    // the pipeline itself only reports its errors
+    SetLogLevel(LogLevel::Error);
+
+    if (!paramWriteSets.empty()) {
+        return WriteBenchSets(fs::path(paramWriteSets), setsList, sizes);
+    }
+
+    if (!paramExtract.empty()) {
+        auto residualEncoder = std::find_if(encoders.begin(), encoders.end(), [&paramResidual](const BenchEncoder& e) {
+            return IsSelected({ paramResidual }, e.name);
+        });
+        if (residualEncoder == encoders.end()) {
+            Cerr << _T("Unknown residual encoder ") << paramResidual << std::endl;
+            return -1;
+        }
+        return ExtractCorpus(fs::path(paramExtract), inputs, *residualEncoder, scast<size_t>(maxBlocks));
+    }
+
+    // the cases to run, either all the selected ones or the ones of the baseline
+    BenchBaseline baseline;
+    std::vector<BenchResult> cases;
+    if (!paramBaseline.empty()) {
+        if (!ReadBenchBaseline(fs::path(paramBaseline), false, baseline)) {
+            Cerr << _T("Failed to read baseline ") << paramBaseline << std::endl;
+            return -1;
+        }
+        for (const BenchResult& b : baseline.results) {
+            if (!findSet(b.set) || !findEncoder(b.encoder) || b.size < 16 || b.size > kBenchMaxSize || !IsPowerOfTwo(b.size)) {
+                Cerr << _T("Unknown case in the baseline: ") << b.set.c_str() << _T(" ") << b.size << _T(" ") << b.encoder.c_str() << std::endl;
+                return -1;
+            }
+        }
+        cases = baseline.results;
+    } else {
+        for (const char* set : kBenchSets) {
+            for (const size_t size : sizes) {
+                for (const BenchEncoder& encoder : encoders) {
+                    if (IsSelected(setsList, set) && IsSelected(encodersList, encoder.name)) {
+                        BenchResult c;
+                        c.set = set;
+                        c.size = size;
+                        c.encoder = encoder.name;
+                        cases.push_back(c);
+                    }
+                }
+            }
+        }
+    }
+
+    // the speed is only compared against a baseline of the same box, kernels and cases, a gate that can't compare
+    // fails rather than passes unchecked, the baseline is only ever made on request (--make-speed-baseline)
+    BenchBaseline speedBaseline;
+    const bool checkSpeed = !paramSpeedBaseline.empty() && !makeSpeedBaseline;
+    if (checkSpeed) {
+        const std::string host = BenchHost();
+        const Char* mismatch = nullptr;
+        std::error_code errorCode;
+        if (!fs::exists(fs::path(paramSpeedBaseline), errorCode)) {
+            mismatch = _T("is missing");
+        } else if (!ReadBenchBaseline(fs::path(paramSpeedBaseline), true, speedBaseline)) {
+            Cerr << _T("Failed to read speed baseline ") << paramSpeedBaseline << std::endl;
+            return -1;
+        } else if (speedBaseline.kernels != gKernels->name) {
+            mismatch = _T("is of other kernels");
+        } else if (speedBaseline.host != host) {
+            mismatch = _T("is of another box");
+        } else if (!SameBenchCases(speedBaseline.results, cases)) {
+            mismatch = _T("has other cases");
+        }
+
+        if (mismatch) {
+            ConsoleErr << _T("FAILED, speed baseline ") << paramSpeedBaseline << _T(" ") << mismatch << _T(" (") << gKernels->name
+                       << _T(" kernels on ") << host.c_str() << _T("), make one with --make-speed-baseline on the base commit") << std::endl;
+            return 1;
+        }
+    }
+
+    // the CSV gets stdout
+    std::ofstream outputFile;
+    if (!paramOutput.empty()) {
+        outputFile.open(fs::path(paramOutput));
+        if (!outputFile.good()) {
+            Cerr << _T("Failed to open ") << paramOutput << std::endl;
+            return -1;
+        }
+    }
+    std::ostream csv(paramOutput.empty() ? std::cout.rdbuf() : outputFile.rdbuf());
+
+    // one block with every encoder first, so the lazily built tables (e.g. rgbcx contexts) are not in the timings
+    for (const BenchEncoder& encoder : encoders) {
+        uint8_t block[16];
+        encoder.encode(Bitmap<PixelRgba>(4, 4, { 128, 128, 255, 255 }), block);
+    }
+
+    if (!paramCorpus.empty()) {
+        return RunCorpusBench(fs::path(paramCorpus), encodersList, scast<size_t>(numRuns), csv);
+    }
+
+    csv << "set,size,encoder,kernels,total_ms,encode_ms,mpix_per_s,peak_rss_mb,normal_mean_deg,normal_max_deg,gloss_psnr_db,height_psnr_db" << std::endl;
+    csv << std::fixed << std::setprecision(3);
+
+    std::vector<BenchResult> results;
+    BenchSource source;
+    size_t numRegressions = 0;
+    for (size_t i = 0; i < cases.size(); ++i) {
+        const char* set = findSet(cases[i].set);
+        const size_t size = cases[i].size;
+        const BenchEncoder& encoder = *findEncoder(cases[i].encoder);
+        if (i == 0 || cases[i].set != cases[i - 1].set || size != cases[i - 1].size) {
+            source = MakeBenchSource(set, size);
+        }
+
+        ConsoleErr << set << _T(" ") << size << _T("x") << size << _T(" ") << encoder.name << _T("...") << std::endl;
+        BenchResult r = RunBench(source, set, size, encoder, scast<size_t>(numRuns));
+        // a slowdown has to be confirmed by the retries, any background load on the box looks like one
+        for (size_t retry = 0; retry < kBenchGateRetries && checkSpeed && CompareSpeed(r, speedBaseline.results[i], speedTolerance, false); ++retry) {
+            const BenchResult again = RunBench(source, set, size, encoder, scast<size_t>(numRuns));
+            if (again.encodeMs < r.encodeMs) {
+                r = again;
+            }
+        }
+        results.push_back(r);
+
+        csv << r.set << ',' << r.size << ',' << r.encoder << ',' << gKernels->name << ','
+            << r.totalMs << ',' << r.encodeMs << ',' << r.mpixPerSecond << ',' << r.peakRssMb << ','
+            << r.normalMeanDeg << ',' << r.normalMaxDeg << ',' << r.glossPsnrDb << ',' << r.heightPsnrDb << std::endl;
+
+        if (!baseline.results.empty()) {
+            numRegressions += CompareQuality(r, baseline.results[i], errorTolerance);
+        }
+        if (checkSpeed) {
+            numRegressions += CompareSpeed(r, speedBaseline.results[i], speedTolerance, true);
+        }
+    }
+
+    if (!paramWriteBaseline.empty() && !WriteBenchBaseline(fs::path(paramWriteBaseline), results, false)) {
+        Cerr << _T("Failed to write baseline ") << paramWriteBaseline << std::endl;
+        return -1;
+    }
+    if (makeSpeedBaseline) {
+        if (!WriteBenchBaseline(fs::path(paramSpeedBaseline), results, true)) {
+            Cerr << _T("Failed to write speed baseline ") << paramSpeedBaseline << std::endl;
+            return -1;
+        }
+        ConsoleErr << _T("Made speed baseline ") << paramSpeedBaseline << _T(", the speed is not checked in this run") << std::endl;
+    }
+
+    if (!baseline.results.empty()) {
+        ConsoleErr << (numRegressions ? _T("FAILED, ") : _T("PASSED, ")) << numRegressions << _T(" regressions in ")
+                   << cases.size() << _T(" cases") << std::endl;
+        return numRegressions ? 1 : 0;
+    }
+
+    return 0;
+}
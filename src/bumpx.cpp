@@ -11,32 +11,70 @@
 #include <cmath>        // std::sqrt
 #include <cstring>      // std::memcpy
 #include <memory>       // std::unique_ptr
+#include <chrono>
+#include <iomanip>      // std::setw
+#include <limits>
+#include <thread>
+#include <atomic>
+#include <sstream>
+#include <mutex>
+#include <condition_variable>
+#include <future>
+#include <map>
+#include <cstdlib>      // std::malloc
+
+
+// stb_image allocations go through these, so LoadBitmap can let stb_image decode right into the Bitmap storage:
+// the first allocation of exactly the registered size is served from the registered buffer
+struct StbiTargetBuffer {
+    void*   ptr = nullptr;
+    size_t  size = 0;
+    bool    taken = false;
+};
+static thread_local StbiTargetBuffer tStbiTarget;
 
-namespace fs = std::filesystem;
+static void* StbiMalloc(const size_t size) {
+    if (tStbiTarget.ptr && !tStbiTarget.taken && size == tStbiTarget.size) {
+        tStbiTarget.taken = true;
+        return tStbiTarget.ptr;
+    }
+    return std::malloc(size);
+}
 
-using BytesArray = std::vector<uint8_t>;
+static void* StbiRealloc(void* ptr, const size_t newSize) {
+    if (ptr && ptr == tStbiTarget.ptr) {
+        void* result = std::malloc(newSize);
+        if (result) {
+            std::memcpy(result, ptr, std::min(newSize, tStbiTarget.size));
+        }
+        return result;
+    }
+    return std::realloc(ptr, newSize);
+}
 
+static void StbiFree(void* ptr) {
+    if (ptr != tStbiTarget.ptr) {
+        std::free(ptr);
+    }
+}
 
 #define STB_IMAGE_IMPLEMENTATION
+#define STB_IMAGE_STATIC
+#define STBI_MALLOC(sz)         StbiMalloc(sz)
+#define STBI_REALLOC(p, newsz)  StbiRealloc(p, newsz)
+#define STBI_FREE(p)            StbiFree(p)
 #define STBI_NO_GIF
 #define STBI_NO_HDR
 #include "stb_image.h"
 
 #define STB_IMAGE_WRITE_IMPLEMENTATION
+#define STB_IMAGE_WRITE_STATIC
 #define STBIW_WINDOWS_UTF8
 #ifdef _WIN32
 #define __STDC_LIB_EXT1__
 #endif
 #include "stb_image_write.h"
 
-#define STB_IMAGE_RESIZE_IMPLEMENTATION
-#define STBIR_DEFAULT_FILTER_DOWNSAMPLE  STBIR_FILTER_KAISER
-#define STBIR_ASSERT(boolval)
-#include "stb_image_resize.h"
-
-#define STB_DXT_IMPLEMENTATION
-#include "stb_dxt.h"
-
 
 #define SQUISH_USE_SSE 2
 #include "squish/squish.h"
@@ -50,56 +88,263 @@ using BytesArray = std::vector<uint8_t>;
 #include "squish/singlecolourfit.cpp"
 #include "squish/squish.cpp"
 
-
-#define RGBCX_IMPLEMENTATION
-#include "rgbcx.h"
-
-// My own BCDEC library to decompress BC blocks :)
-#define BCDEC_IMPLEMENTATION
-#include "../bcdec/bcdec.h"
-
-#ifdef _WIN32
-using Char = wchar_t;
-using String = std::wstring;
-#define _T(str) L ## str
-#define Cout std::wcout
-#define Cerr std::wcerr
-#define Main wmain
-#define ENABLE_NVTT3 1
-#else
-using Char = char;
-using String = std::string;
-#define _T(str) str
-#define Cout std::cout
-#define Cerr std::cerr
-#define Main main
-#endif //  _WIN32
+// stb_image_resize, stb_dxt, rgbcx and bcdec are compiled per instruction set in kernels.cpp
+#include "kernels.h"
+#include "bumpx.h"
+#include "bumpx_internal.h"
 
 #ifdef ENABLE_NVTT3
 #include "../nvtt3/nvtt.h"
 #include "../nvtt3/nvtt_lowlevel.h"
 #include "../nvtt3/nvtt_wrapper.h"
-NvttCPUInputBuffer*(*func_nvttCreateCPUInputBuffer)(const NvttRefImage*, NvttValueType, int, int, int, float, float, float, float, NvttTimingContext*, unsigned*);
-void(*func_nvttDestroyCPUInputBuffer)(NvttCPUInputBuffer*);
-void(*func_nvttEncodeBC3CPU)(const NvttCPUInputBuffer*, NvttBoolean, void*, NvttBoolean, NvttBoolean, NvttTimingContext*);
+static NvttCPUInputBuffer*(*func_nvttCreateCPUInputBuffer)(const NvttRefImage*, NvttValueType, int, int, int, float, float, float, float, NvttTimingContext*, unsigned*);
+static void(*func_nvttDestroyCPUInputBuffer)(NvttCPUInputBuffer*);
+static void(*func_nvttEncodeBC3CPU)(const NvttCPUInputBuffer*, NvttBoolean, void*, NvttBoolean, NvttBoolean, NvttTimingContext*);
 
 extern "C" __declspec(dllimport) void* __stdcall LoadLibraryW(const wchar_t* lpLibFileName);
 extern "C" __declspec(dllimport) void* __stdcall GetProcAddress(void* hModule, const char* lpProcName);
 #endif // ENABLE_NVTT3
 
-#ifdef __GNUC__
-#define PACKED_STRUCT_BEGIN
-#define PACKED_STRUCT_END __attribute__((__packed__))
+// for MappedFile, ReadFileHead and ProcessCpuTimeMs
+#ifdef _WIN32
+extern "C" __declspec(dllimport) void* __stdcall CreateFileW(const wchar_t* lpFileName, unsigned long dwDesiredAccess, unsigned long dwShareMode, void* lpSecurityAttributes, unsigned long dwCreationDisposition, unsigned long dwFlagsAndAttributes, void* hTemplateFile);
+extern "C" __declspec(dllimport) int __stdcall GetFileSizeEx(void* hFile, long long* lpFileSize);
+extern "C" __declspec(dllimport) void* __stdcall CreateFileMappingW(void* hFile, void* lpFileMappingAttributes, unsigned long flProtect, unsigned long dwMaximumSizeHigh, unsigned long dwMaximumSizeLow, const wchar_t* lpName);
+extern "C" __declspec(dllimport) void* __stdcall MapViewOfFile(void* hFileMappingObject, unsigned long dwDesiredAccess, unsigned long dwFileOffsetHigh, unsigned long dwFileOffsetLow, size_t dwNumberOfBytesToMap);
+extern "C" __declspec(dllimport) int __stdcall UnmapViewOfFile(const void* lpBaseAddress);
+extern "C" __declspec(dllimport) int __stdcall CloseHandle(void* hObject);
+extern "C" __declspec(dllimport) int __stdcall GetProcessTimes(void* hProcess, uint64_t* lpCreationTime, uint64_t* lpExitTime, uint64_t* lpKernelTime, uint64_t* lpUserTime);
+extern "C" __declspec(dllimport) int __stdcall ReadFile(void* hFile, void* lpBuffer, unsigned long nNumberOfBytesToRead, unsigned long* lpNumberOfBytesRead, void* lpOverlapped);
+#include <io.h>         // _setmode for --stream
+#include <fcntl.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>         // clock_gettime
+#ifdef __linux__
+#include <linux/perf_event.h>   // --counters
+#include <sys/syscall.h>
+#endif
+#endif // _WIN32
+
+#ifdef BUMPX_KERNELS_X86
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#endif // BUMPX_KERNELS_X86
+
+// everything but the C interface and BumpxMain, so bumpx_core exports nothing a host could clash with
+namespace bumpx {
+
+// the log: every thread writes into its own line buffers, finished lines go to the shared sink that filters them by level
+// and writes them out in big chunks (line by line if stdout is a terminal), errors flush everything before them right away
+static const Char* const kLogLevelsNames[] = { _T("error"), _T("info"), _T("verbose") };
+
+static String JsonEscape(const Char* str, const size_t length) {
+    static const Char kHexDigits[] = _T("0123456789abcdef");
+
+    String result;
+    result.reserve(length + 2);
+    for (size_t i = 0; i < length; ++i) {
+        const Char c = str[i];
+        if (c == _T('"') || c == _T('\\')) {
+            result.push_back(_T('\\'));
+            result.push_back(c);
+        } else if (c == _T('\t')) {
+            result += _T("\\t");
+        } else if (c == _T('\r')) {
+            result += _T("\\r");
+        } else if (scast<uint32_t>(c) < 0x20) {
+            result += _T("\\u00");
+            result.push_back(kHexDigits[c >> 4]);
+            result.push_back(kHexDigits[c & 15]);
+        } else {
+            result.push_back(c);
+        }
+    }
+    return result;
+}
+
+class LogSink {
+public:
+    static const size_t kBufferSize = 64 * 1024;
+
+    LogSink()
+        : mStartTime(std::chrono::steady_clock::now()) {
+#ifdef _WIN32
+        mInteractive = _isatty(_fileno(stdout)) != 0;
 #else
-#define PACKED_STRUCT_BEGIN __pragma(pack(push, 1))
-#define PACKED_STRUCT_END __pragma(pack(pop))
+        mInteractive = isatty(fileno(stdout)) != 0;
 #endif
+        mBuffer.reserve(kBufferSize);
+    }
+    ~LogSink() {
+        this->Flush();
+    }
+
+    // the options are set up once in Main, before any worker thread starts
+    void SetLevel(const LogLevel level) {
+        mLevel = level;
+    }
+    void SetJson(const bool json) {
+        mJson = json;
+    }
+    // --stream keeps stdout for the results
+    void RedirectToStderr() {
+        this->Flush();
+        mToStderr = true;
+        mInteractive = false;
+    }
+
+    void Write(const LogLevel level, const size_t threadIndex, const Char* line, const size_t length) {
+        if (scast<int>(level) > scast<int>(mLevel)) {
+            return;
+        }
+
+        std::lock_guard<std::mutex> lock(mMutex);
+        if (mJson) {
+            // one stream of json lines, errors included
+            const double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - mStartTime).count();
+            std::basic_ostringstream<Char> json;
+            json << std::fixed << std::setprecision(3);
+            json << _T("{\"t_ms\":") << ms << _T(",\"level\":\"") << kLogLevelsNames[scast<size_t>(level)] << _T("\",\"thread\":") << threadIndex
+                 << _T(",\"msg\":\"") << JsonEscape(line, length) << _T("\"}\n");
+            mBuffer += json.str();
+        } else if (level == LogLevel::Error && !mToStderr) {
+            // whatever was written before the error goes out first
+            this->FlushLocked();
+            ConsoleErr.write(line, scast<std::streamsize>(length)) << _T('\n');
+            ConsoleErr.flush();
+            return;
+        } else {
+            mBuffer.append(line, length);
+            mBuffer.push_back(_T('\n'));
+        }
+
+        if (mInteractive || level == LogLevel::Error || mBuffer.length() >= kBufferSize) {
+            this->FlushLocked();
+        }
+    }
+
+    void Flush() {
+        std::lock_guard<std::mutex> lock(mMutex);
+        this->FlushLocked();
+    }
+
+private:
+    void FlushLocked() {
+        if (!mBuffer.empty()) {
+            std::basic_ostream<Char>& out = mToStderr ? ConsoleErr : ConsoleOut;
+            out.write(mBuffer.data(), scast<std::streamsize>(mBuffer.length()));
+            out.flush();
+            mBuffer.clear();
+        }
+    }
+
+private:
+    std::mutex                              mMutex;
+    String                                  mBuffer;
+    LogLevel                                mLevel = LogLevel::Info;
+    bool                                    mJson = false;
+    bool                                    mToStderr = false;
+    bool                                    mInteractive = false;
+    std::chrono::steady_clock::time_point   mStartTime;
+};
+
+static LogSink& GetLogSink() {
+    static LogSink sink;
+    return sink;
+}
+
+// collects a thread's output of one level and passes it to the sink a line at a time
+class LogBuffer : public std::basic_streambuf<Char> {
+public:
+    LogBuffer(const LogLevel level, const size_t threadIndex)
+        : mLevel(level)
+        , mThreadIndex(threadIndex) {
+    }
+    ~LogBuffer() override {
+        this->Commit(true);
+    }
+
+protected:
+    int_type overflow(const int_type c) override {
+        if (!traits_type::eq_int_type(c, traits_type::eof())) {
+            mLine.push_back(traits_type::to_char_type(c));
+        }
+        return traits_type::not_eof(c);
+    }
+    std::streamsize xsputn(const Char* s, const std::streamsize n) override {
+        mLine.append(s, scast<size_t>(n));
+        return n;
+    }
+    int sync() override {
+        this->Commit(false);
+        return 0;
+    }
+
+private:
+    // passes all the finished lines, the unfinished one too if asked
+    void Commit(const bool all) {
+        size_t start = 0;
+        for (size_t end = mLine.find(_T('\n')); end != String::npos; end = mLine.find(_T('\n'), start)) {
+            GetLogSink().Write(mLevel, mThreadIndex, mLine.data() + start, end - start);
+            start = end + 1;
+        }
+        if (all && start < mLine.length()) {
+            GetLogSink().Write(mLevel, mThreadIndex, mLine.data() + start, mLine.length() - start);
+            start = mLine.length();
+        }
+        mLine.erase(0, start);
+    }
 
+private:
+    LogLevel    mLevel;
+    size_t      mThreadIndex;
+    String      mLine;
+};
+
+static std::atomic<size_t> gLogNextThreadIndex{ 0 };
+
+struct ThreadLog {
+    size_t                      threadIndex = gLogNextThreadIndex++;
+    LogBuffer                   errorBuffer{ LogLevel::Error, threadIndex };
+    LogBuffer                   infoBuffer{ LogLevel::Info, threadIndex };
+    LogBuffer                   verboseBuffer{ LogLevel::Verbose, threadIndex };
+    std::basic_ostream<Char>    error{ &errorBuffer };
+    std::basic_ostream<Char>    info{ &infoBuffer };
+    std::basic_ostream<Char>    verbose{ &verboseBuffer };
+};
+
+// set while a call of the C interface (see bumpx.h) runs on the thread and on the threads it starts (see
+// ParallelForBands), all its messages are dropped
+static thread_local bool tLogMuted = false;
+
+std::basic_ostream<Char>& LogStream(const LogLevel level) {
+    static thread_local ThreadLog tLog;
+    static thread_local std::basic_ostream<Char> tNull{ nullptr };  // no buffer, every write just fails
+    if (tLogMuted) {
+        return tNull;
+    }
+    return (level == LogLevel::Error) ? tLog.error : ((level == LogLevel::Info) ? tLog.info : tLog.verbose);
+}
 
-#define scast static_cast
-#define rcast reinterpret_cast
+void SetLogLevel(const LogLevel level) {
+    GetLogSink().SetLevel(level);
+}
+
+class LogMuteScope {
+public:
+    LogMuteScope() : mWasMuted(tLogMuted) { tLogMuted = true; }
+    ~LogMuteScope() { tLogMuted = mWasMuted; }
 
-static const size_t kMinMipSize = 4;    // 4 because the result is always BC compressed
+private:
+    bool mWasMuted;
+};
 
 #ifdef ENABLE_NVTT3
 constexpr size_t kNumCompressors = 4;
@@ -116,26 +361,558 @@ static const String kCompressorsNames[kNumCompressors] = {
 #endif
 };
 
-static size_t Log2I(size_t v) {
-    size_t result = 0;
-    while (v >>= 1) {
-        ++result;
+// indexed by BC1ApproxMode
+static const String kBC1ApproxModesNames[scast<size_t>(BC1ApproxMode::Count)] = {
+    _T("ideal"),
+    _T("nvidia"),
+    _T("amd"),
+    _T("idealround4")
+};
+
+// -q:auto picks the compressor per mip by its size - the fastest one for huge mips where it dominates the encode time,
+// the best (and slowest) one for the small mips where it costs next to nothing
+static const size_t kAutoQualityFastMinPixels = 1024 * 1024;    // STB
+static const size_t kAutoQualityMediumMinPixels = 256 * 256;    // Squish, smaller mips get RGBCX
+
+// -j:passes, 0 is the classic (open loop) compression
+static const int kMaxClosedLoopPasses = 16;
+
+// big images are decoded in bands of block rows on several threads, each thread gets at least that many blocks
+static const size_t kMinBlocksPerDecodeThread = 16 * 1024;
+// the same for unpacking - decoding both bump and bump# plus the normal rebuild per pixel
+static const size_t kMinPixelsPerUnpackThread = 128 * 1024;
+// bulk unpacking - at most that many threads read or write files at once
+static const size_t kMaxConcurrentIo = 4;
+
+// --counters: hardware performance counters of the stages (linux only), counted for the whole process like the cpu time,
+// the threads started by a stage are included once they are joined
+enum HwCounter : size_t {
+    kHwCycles,
+    kHwInstructions,
+    kHwL1DMisses,
+    kHwLLCMisses,
+    kHwBranchMisses,
+    kHwDTLBMisses,
+
+    kNumHwCounters
+};
+
+static const char* const kHwCountersNames[kNumHwCounters] = {
+    "cycles", "instructions", "l1d_misses", "llc_misses", "branch_misses", "dtlb_misses"
+};
+
+class HwCounters {
+public:
+    ~HwCounters() {
+        this->Close();
     }
-    return result;
+
+    // false if none of the counters is available (not linux, no PMU in a vm, perf_event_paranoid, seccomp in containers)
+    bool Open(String& error) {
+#ifdef __linux__
+        auto cacheMiss = [](const uint64_t cache) {
+            return cache | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+        };
+        const uint32_t types[kNumHwCounters] = {
+            PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE, PERF_TYPE_HW_CACHE, PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE, PERF_TYPE_HW_CACHE
+        };
+        const uint64_t configs[kNumHwCounters] = {
+            PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS, cacheMiss(PERF_COUNT_HW_CACHE_L1D),
+            PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_HW_BRANCH_MISSES, cacheMiss(PERF_COUNT_HW_CACHE_DTLB)
+        };
+
+        bool anyOpened = false;
+        for (size_t i = 0; i < kNumHwCounters; ++i) {
+            perf_event_attr attr;
+            std::memset(&attr, 0, sizeof(attr));
+            attr.size = sizeof(attr);
+            attr.type = types[i];
+            attr.config = configs[i];
+            attr.exclude_kernel = 1;    // allowed with perf_event_paranoid 2, the default
+            attr.exclude_hv = 1;
+            attr.inherit = 1;           // the threads started afterwards are counted too
+            attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+            mFds[i] = scast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+            if (mFds[i] >= 0) {
+                anyOpened = true;
+            } else if (error.empty()) {
+                const std::string reason = std::strerror(errno);
+                error = _T("perf_event_open: ") + String(reason.begin(), reason.end());
+            }
+        }
+        return anyOpened;
+#else
+        error = _T("not supported on this platform");
+        return false;
+#endif
+    }
+
+    void Close() {
+        for (int& fd : mFds) {
+            if (fd >= 0) {
+#ifdef __linux__
+                close(fd);
+#endif
+                fd = -1;
+            }
+        }
+    }
+
+    bool IsAvailable(const size_t counter) const {
+        return mFds[counter] >= 0;
+    }
+
+    // the counts so far, scaled up if the kernel had to multiplex the counters, unavailable ones are 0
+    void Read(double (&values)[kNumHwCounters]) const {
+        for (size_t i = 0; i < kNumHwCounters; ++i) {
+            values[i] = 0.0;
+#ifdef __linux__
+            uint64_t data[3];   // value, time enabled, time running
+            if (mFds[i] >= 0 && read(mFds[i], data, sizeof(data)) == scast<ssize_t>(sizeof(data)) && data[2] > 0) {
+                values[i] = scast<double>(data[0]) * (scast<double>(data[1]) / scast<double>(data[2]));
+            }
+#endif
+        }
+    }
+
+private:
+    int mFds[kNumHwCounters] = { -1, -1, -1, -1, -1, -1 };
+};
+
+static bool gCountersEnabled = false;
+static HwCounters gHwCounters;
+
+
+// --stats: every stage of a run is timed and reported at the end, stages with the same name and mip are summed up
+// (e.g. the textures of a folder), the cpu time is of the whole process, so it includes the stages running alongside
+struct StageStats {
+    const Char* name;
+    int         mip;        // -1 if the stage is not per mip
+    size_t      count;
+    double      wallMs;
+    double      cpuMs;
+    uint64_t    pixels;
+    uint64_t    bytesIn;
+    uint64_t    bytesOut;
+    double      counters[kNumHwCounters];   // with --counters
+};
+
+static bool gStatsEnabled = false;
+static std::mutex gStatsMutex;
+static std::vector<StageStats> gStats;
+
+static double ProcessCpuTimeMs() {
+#ifdef _WIN32
+    uint64_t creationTime, exitTime, kernelTime, userTime;  // in 100ns
+    if (GetProcessTimes(rcast<void*>(scast<intptr_t>(-1)) /*GetCurrentProcess()*/, &creationTime, &exitTime, &kernelTime, &userTime)) {
+        return scast<double>(kernelTime + userTime) / 10000.0;
+    }
+    return 0.0;
+#else
+    timespec ts;
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+    return scast<double>(ts.tv_sec) * 1000.0 + scast<double>(ts.tv_nsec) / 1000000.0;
+#endif
 }
 
-template <typename T>
-static T Clamp(const T& v, const T& left, const T& right) {
-    return std::min(std::max(left, v), right);
+
+// --trace:file.json: begin/end of every stage, mip and parallel band in the chrome trace event format (load it into
+// perfetto or chrome://tracing), every thread records into its own ring buffer without any locking, the oldest events
+// get overwritten if a thread records more than kTraceRingSize of them
+struct TraceEvent {
+    const Char* name;       // string literals only, the events outlive the scopes
+    int         mip;        // -1 if not per mip
+    uint64_t    first;      // the range of a parallel band (rows, chunks), count = 0 if not a band
+    uint64_t    count;
+    int64_t     startNs;
+    int64_t     durationNs;
+};
+
+static const size_t kTraceRingSize = 64 * 1024;    // power of 2
+
+struct TraceRing {
+    std::unique_ptr<TraceEvent[]>   events{ new TraceEvent[kTraceRingSize] };
+    std::atomic<uint64_t>           head{ 0 };
+    size_t                          threadIndex = 0;
+};
+
+static bool gTraceEnabled = false;
+static const std::chrono::steady_clock::time_point gTraceStartTime = std::chrono::steady_clock::now();
+// the rings are owned here, so the events of the finished threads are still there at the end, a finished thread's
+// ring goes to the free list and the next new thread records into it, with the same tid, so the threads every
+// parallel loop starts don't add a ring (and a track of the trace) each
+static std::mutex gTraceRingsMutex;
+static std::vector<std::unique_ptr<TraceRing>> gTraceRings;
+static std::vector<TraceRing*> gTraceFreeRings;
+
+static int64_t TraceNowNs() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - gTraceStartTime).count();
+}
+
+// hands the ring of the thread back to the free list when the thread exits
+struct ThreadTraceRingLease {
+    TraceRing* ring = nullptr;
+
+    ~ThreadTraceRingLease() {
+        if (ring) {
+            std::lock_guard<std::mutex> lock(gTraceRingsMutex);
+            gTraceFreeRings.push_back(ring);
+        }
+    }
+};
+
+static TraceRing& ThreadTraceRing() {
+    static thread_local ThreadTraceRingLease tLease;
+    if (!tLease.ring) {
+        std::lock_guard<std::mutex> lock(gTraceRingsMutex);
+        if (!gTraceFreeRings.empty()) {
+            tLease.ring = gTraceFreeRings.back();
+            gTraceFreeRings.pop_back();
+        } else {
+            gTraceRings.emplace_back(new TraceRing());
+            tLease.ring = gTraceRings.back().get();
+            tLease.ring->threadIndex = gTraceRings.size() - 1;
+        }
+    }
+    return *tLease.ring;
+}
+
+// records an event from its construction to its destruction, does nothing without --trace
+class TraceScope {
+public:
+    TraceScope(const Char* name, const int mip = -1, const uint64_t first = 0, const uint64_t count = 0)
+        : mEvent{ name, mip, first, count, gTraceEnabled ? TraceNowNs() : 0, 0 } {
+    }
+
+    ~TraceScope() {
+        if (gTraceEnabled) {
+            mEvent.durationNs = TraceNowNs() - mEvent.startNs;
+
+            TraceRing& ring = ThreadTraceRing();
+            const uint64_t head = ring.head.load(std::memory_order_relaxed);
+            ring.events[head & (kTraceRingSize - 1)] = mEvent;
+            ring.head.store(head + 1, std::memory_order_release);
+        }
+    }
+
+private:
+    TraceEvent mEvent;
+};
+
+// times a stage from its construction to its destruction, does nothing without --stats, a trace event too with --trace
+class StageTimer {
+    using Clock = std::chrono::steady_clock;
+
+public:
+    StageTimer(const Char* name, const int mip = -1) : mStats{ name, mip, 1, 0.0, 0.0, 0, 0, 0 }, mTrace(name, mip) {
+        if (gStatsEnabled) {
+            mStartTime = Clock::now();
+            mStartCpuMs = ProcessCpuTimeMs();
+            if (gCountersEnabled) {
+                gHwCounters.Read(mStartCounters);
+            }
+        }
+    }
+
+    ~StageTimer() {
+        if (gStatsEnabled) {
+            mStats.wallMs = std::chrono::duration<double, std::milli>(Clock::now() - mStartTime).count();
+            mStats.cpuMs = ProcessCpuTimeMs() - mStartCpuMs;
+            if (gCountersEnabled) {
+                gHwCounters.Read(mStats.counters);
+                for (size_t i = 0; i < kNumHwCounters; ++i) {
+                    mStats.counters[i] -= mStartCounters[i];
+                }
+            }
+
+            std::lock_guard<std::mutex> lock(gStatsMutex);
+            auto it = std::find_if(gStats.begin(), gStats.end(), [this](const StageStats& s) {
+                return s.mip == mStats.mip && String(s.name) == mStats.name;
+            });
+            if (it == gStats.end()) {
+                gStats.push_back(mStats);
+            } else {
+                it->count += mStats.count;
+                it->wallMs += mStats.wallMs;
+                it->cpuMs += mStats.cpuMs;
+                it->pixels += mStats.pixels;
+                it->bytesIn += mStats.bytesIn;
+                it->bytesOut += mStats.bytesOut;
+                for (size_t i = 0; i < kNumHwCounters; ++i) {
+                    it->counters[i] += mStats.counters[i];
+                }
+            }
+        }
+    }
+
+    void SetVolume(const uint64_t pixels, const uint64_t bytesIn, const uint64_t bytesOut) {
+        mStats.pixels = pixels;
+        mStats.bytesIn = bytesIn;
+        mStats.bytesOut = bytesOut;
+    }
+
+private:
+    StageStats          mStats;
+    Clock::time_point   mStartTime;
+    double              mStartCpuMs = 0.0;
+    double              mStartCounters[kNumHwCounters];
+    TraceScope          mTrace;
+};
+
+static uint64_t FileSizeOrZero(const fs::path& path) {
+    std::error_code errorCode;
+    const uintmax_t size = fs::file_size(path, errorCode);
+    return errorCode ? 0 : scast<uint64_t>(size);
+}
+
+// prints the table to Cout or, if jsonPath is not empty, writes the stats there as json
+static bool ReportStats(const double totalWallMs, const fs::path& jsonPath) {
+    const double totalCpuMs = ProcessCpuTimeMs();
+    auto mpixPerSecond = [](const StageStats& s) {
+        return s.wallMs > 0.0 ? scast<double>(s.pixels) / (s.wallMs * 1000.0) : 0.0;
+    };
+
+    if (!jsonPath.empty()) {
+        std::ofstream file(jsonPath);
+        if (!file.good()) {
+            Cerr << _T("Failed to write stats to ") << jsonPath << std::endl;
+            return false;
+        }
+
+        file << std::fixed << std::setprecision(3);
+        file << "{\n  \"wall_ms\": " << totalWallMs << ",\n  \"cpu_ms\": " << totalCpuMs << ",\n  \"stages\": [";
+        for (size_t i = 0; i < gStats.size(); ++i) {
+            const StageStats& s = gStats[i];
+            std::string name;
+            for (const Char* c = s.name; *c; ++c) {
+                name += scast<char>(*c);    // stage names are ascii
+            }
+            file << (i ? "," : "") << "\n    { \"stage\": \"" << name << "\", \"mip\": " << s.mip
+                 << ", \"count\": " << s.count << ", \"wall_ms\": " << s.wallMs << ", \"cpu_ms\": " << s.cpuMs
+                 << ", \"pixels\": " << s.pixels << ", \"mpix_per_s\": " << mpixPerSecond(s)
+                 << ", \"bytes_in\": " << s.bytesIn << ", \"bytes_out\": " << s.bytesOut;
+            if (gCountersEnabled) {
+                file << ", \"counters\": {";
+                const char* separator = " ";
+                for (size_t j = 0; j < kNumHwCounters; ++j) {
+                    if (gHwCounters.IsAvailable(j)) {
+                        file << separator << "\"" << kHwCountersNames[j] << "\": " << std::setprecision(0) << s.counters[j] << std::setprecision(3);
+                        separator = ", ";
+                    }
+                }
+                if (gHwCounters.IsAvailable(kHwCycles) && gHwCounters.IsAvailable(kHwInstructions) && s.counters[kHwCycles] > 0.0) {
+                    file << separator << "\"ipc\": " << s.counters[kHwInstructions] / s.counters[kHwCycles];
+                }
+                file << " }";
+            }
+            file << " }";
+        }
+        file << "\n  ]\n}\n";
+        return file.good();
+    }
+
+    const auto coutFlags = Cout.flags();
+    const auto coutPrecision = Cout.precision();
+    Cout << _T("Stats:") << std::endl;
+    Cout << _T("  stage                   mip  count     wall ms      cpu ms    MPix/s      bytes in     bytes out") << std::endl;
+    for (const StageStats& s : gStats) {
+        Cout << _T("  ") << std::left << std::setw(22) << s.name << std::right << std::setw(5);
+        if (s.mip < 0) {
+            Cout << _T("-");
+        } else {
+            Cout << s.mip;
+        }
+        Cout << std::setw(7) << s.count << std::fixed << std::setprecision(2)
+             << std::setw(12) << s.wallMs << std::setw(12) << s.cpuMs << std::setw(10) << mpixPerSecond(s)
+             << std::setw(14) << s.bytesIn << std::setw(14) << s.bytesOut << std::endl;
+    }
+    Cout << _T("  total wall ") << totalWallMs << _T(" ms, cpu ") << totalCpuMs << _T(" ms") << std::endl;
+
+    if (gCountersEnabled) {
+        // "-" where a counter is not available or the stage has no pixels
+        auto column = [](const bool valid, const double value, const int precision) {
+            Cout << std::setw(12);
+            if (valid) {
+                Cout << std::setprecision(precision) << value;
+            } else {
+                Cout << _T("-");
+            }
+        };
+
+        Cout << _T("Counters:") << std::endl;
+        Cout << _T("  stage                   mip         IPC   cycles/px  L1D miss/px LLC miss/px  br miss/px dTLB miss/px") << std::endl;
+        for (const StageStats& s : gStats) {
+            Cout << _T("  ") << std::left << std::setw(22) << s.name << std::right << std::setw(5);
+            if (s.mip < 0) {
+                Cout << _T("-");
+            } else {
+                Cout << s.mip;
+            }
+
+            const double pixels = scast<double>(s.pixels);
+            column(gHwCounters.IsAvailable(kHwCycles) && gHwCounters.IsAvailable(kHwInstructions) && s.counters[kHwCycles] > 0.0,
+                   s.counters[kHwInstructions] / s.counters[kHwCycles], 2);
+            column(gHwCounters.IsAvailable(kHwCycles) && s.pixels > 0, s.counters[kHwCycles] / pixels, 1);
+            for (const size_t counter : { kHwL1DMisses, kHwLLCMisses, kHwBranchMisses, kHwDTLBMisses }) {
+                column(gHwCounters.IsAvailable(counter) && s.pixels > 0, s.counters[counter] / pixels, 4);
+            }
+            Cout << std::endl;
+        }
+    }
+
+    Cout.flags(coutFlags);
+    Cout.precision(coutPrecision);
+    return true;
+}
+
+// writes out everything the threads have recorded, must be called when no thread records anymore
+static bool WriteTrace(const fs::path& path) {
+    std::ofstream file(path);
+    if (!file.good()) {
+        Cerr << _T("Failed to write trace to ") << path << std::endl;
+        return false;
+    }
+
+    auto ascii = [](const Char* str) {
+        std::string result;
+        for (const Char* c = str; *c; ++c) {
+            result += scast<char>(*c);      // event names are ascii
+        }
+        return result;
+    };
+
+    std::lock_guard<std::mutex> lock(gTraceRingsMutex);
+    file << std::fixed << std::setprecision(3);
+    file << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+    file << "{\"ph\":\"M\",\"name\":\"process_name\",\"pid\":1,\"tid\":0,\"args\":{\"name\":\"bumpx\"}}";
+    uint64_t numDropped = 0;
+    for (const auto& ring : gTraceRings) {
+        const size_t tid = ring->threadIndex;
+        file << ",\n{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":1,\"tid\":" << tid << ",\"args\":{\"name\":\""
+             << (tid ? "worker " + std::to_string(tid) : std::string("main")) << "\"}}";
+
+        const uint64_t head = ring->head.load(std::memory_order_acquire);
+        const uint64_t first = head > kTraceRingSize ? head - kTraceRingSize : 0;
+        numDropped += first;
+        for (uint64_t i = first; i < head; ++i) {
+            const TraceEvent& e = ring->events[i & (kTraceRingSize - 1)];
+            file << ",\n{\"ph\":\"X\",\"name\":\"" << ascii(e.name) << "\",\"pid\":1,\"tid\":" << tid
+                 << ",\"ts\":" << scast<double>(e.startNs) / 1000.0 << ",\"dur\":" << scast<double>(e.durationNs) / 1000.0 << ",\"args\":{";
+            const char* separator = "";
+            if (e.mip >= 0) {
+                file << "\"mip\":" << e.mip;
+                separator = ",";
+            }
+            if (e.count > 0) {
+                file << separator << "\"first\":" << e.first << ",\"count\":" << e.count;
+            }
+            file << "}}";
+        }
+    }
+    file << "\n]}\n";
+
+    if (numDropped > 0) {
+        Cout << _T("Trace ring buffers overflowed, ") << numDropped << _T(" oldest events dropped") << std::endl;
+    }
+    return file.good();
+}
+
+const Kernels* gKernels = nullptr;
+
+#ifdef BUMPX_KERNELS_X86
+static void CpuId(const uint32_t leaf, const uint32_t subleaf, uint32_t regs[4]) {
+#ifdef _MSC_VER
+    int r[4];
+    __cpuidex(r, scast<int>(leaf), scast<int>(subleaf));
+    for (size_t i = 0; i < 4; ++i) {
+        regs[i] = scast<uint32_t>(r[i]);
+    }
+#else
+    __cpuid_count(leaf, subleaf, regs[0], regs[1], regs[2], regs[3]);
+#endif
+}
+
+// which register states the OS saves on context switch
+static uint64_t XGetBv() {
+#ifdef _MSC_VER
+    return _xgetbv(0);
+#else
+    uint32_t lo, hi;
+    __asm__ volatile("xgetbv" : "=a"(lo), "=d"(hi) : "c"(0));
+    return (scast<uint64_t>(hi) << 32) | lo;
+#endif
+}
+
+// returns index into the kernels table below, the higher - the better
+static size_t DetectBestKernels() {
+    uint32_t regs[4] = { 0 };
+    CpuId(0, 0, regs);
+    const uint32_t maxLeaf = regs[0];
+
+    CpuId(1, 0, regs);
+    const bool hasSSE41 = (regs[2] & (1u << 19)) != 0;
+    const bool hasOSXSAVE = (regs[2] & (1u << 27)) != 0;
+    const bool hasAVX = (regs[2] & (1u << 28)) != 0;
+
+    uint32_t ext[4] = { 0 };
+    if (maxLeaf >= 7) {
+        CpuId(7, 0, ext);
+    }
+
+    const uint64_t xcr0 = (hasOSXSAVE && hasAVX) ? XGetBv() : 0;
+    const bool osYmm = (xcr0 & 0x06) == 0x06;     // XMM | YMM
+    const bool osZmm = (xcr0 & 0xE6) == 0xE6;     // XMM | YMM | opmask | ZMM_Hi256 | Hi16_ZMM
+
+    const bool hasAVX2 = osYmm && (ext[1] & (1u << 5)) && (ext[1] & (1u << 3)) && (ext[1] & (1u << 8)); // AVX2 + BMI1 + BMI2
+    const bool hasAVX512 = hasAVX2 && osZmm &&
+                           (ext[1] & (1u << 16)) && (ext[1] & (1u << 17)) && (ext[1] & (1u << 30)) && (ext[1] & (1u << 31)); // F + DQ + BW + VL
+
+    return hasAVX512 ? 3 : (hasAVX2 ? 2 : (hasSSE41 ? 1 : 0));
 }
 
-constexpr size_t IsPowerOfTwo(const size_t v) {
-    return v != 0 && (v & (v - 1)) == 0;
+static const Kernels* (*const kKernelsGetters[])() = {
+    GetKernels_sse2,
+    GetKernels_sse41,
+    GetKernels_avx2,
+    GetKernels_avx512
+};
+#else
+static size_t DetectBestKernels() {
+    return 0;
 }
 
+static const Kernels* (*const kKernelsGetters[])() = {
+    GetKernels_generic
+};
+#endif // BUMPX_KERNELS_X86
+
+bool SelectKernels(const String& cpuOverride) {
+    const size_t numKernels = sizeof(kKernelsGetters) / sizeof(kKernelsGetters[0]);
+    const size_t best = DetectBestKernels();
+
+    size_t selected = best;
+    if (!cpuOverride.empty() && cpuOverride != _T("auto")) {
+        selected = numKernels;
+        for (size_t i = 0; i < numKernels; ++i) {
+            const std::string name = kKernelsGetters[i]()->name;
+            if (String(name.begin(), name.end()) == cpuOverride) {
+                selected = i;
+                break;
+            }
+        }
+
+        if (selected == numKernels) {
+            Cerr << _T("Unknown cpu kernels \"") << cpuOverride << _T("\"") << std::endl;
+            return false;
+        } else if (selected > best) {
+            Cerr << _T("Requested cpu kernels are not supported by this CPU, falling back to the best supported") << std::endl;
+            selected = best;
+        }
+    }
 
-inline bool StrEndsWith(const String& str, const String& ending) {
-    return str.size() >= ending.size() && str.compare(str.size() - ending.size(), ending.size(), ending) == 0;
+    gKernels = kKernelsGetters[selected]();
+    return true;
 }
 
 
@@ -145,29 +922,38 @@ static void PrintUsage() {
     Cout << _T("    bumpx -n:path_to_normalmap -g:path_to_glossmap -h:path_to_heightmap -l:g -q:quality -o:output") << std::endl;
     Cout << _T("       here glossmap and heightmap can be ommited") << std::endl;
     Cout << _T("       -q:0 - fast compression, worst quality, -q:2 - slowest compression, best quality (default)") << std::endl;
+    Cout << _T("       -q:auto - fast compression for big mips, best quality for small ones") << std::endl;
+    Cout << _T("       per mip overrides may follow the quality, e.g. -q:auto,0=1,1=1 or -q:0,2=2") << std::endl;
+    Cout << _T("       -j:passes - closed loop bump/bump# compression judged by the final reconstructed normal, 1 to 16 passes (3 is a good start), 0 - off (default)") << std::endl;
     Cout << _T("       -l:g flag forces gloss to be stored in linear rather than log") << std::endl;
+    Cout << _T("       -a:mode - BC1 approximation mode for RGBCX compressor (ideal, nvidia (default), amd, idealround4)") << std::endl;
+    Cout << _T("       --incremental - re-compress only the blocks changed since the previous run with this flag") << std::endl;
+    Cout << _T("       --roundtrip - pack and unpack in memory only, report the error and the speed per mip (all compressors if no -q)") << std::endl;
+    Cout << _T("       --stream - pack jobs from stdin and write the results to stdout, framed protocol described in bumpx.cpp") << std::endl;
     Cout << _T("       if no output path provided - the output files will have same name as source and saved to the same folder") << std::endl;
     Cout << std::endl;
     Cout << _T("  Mode 2 - Bump unpacking:") << std::endl;
-    Cout << _T("    bumpx path_to_bump.dds output_folder_path") << std::endl;
+    Cout << _T("    bumpx path_to_bump.dds output_folder_path --mips --png") << std::endl;
+    Cout << _T("       --mips - unpack every mip level, not just the top one (as name_mipN_normal.tga etc.)") << std::endl;
+    Cout << _T("       --png - save compressed png files instead of tga") << std::endl;
+    Cout << _T("    bumpx path_to_textures_folder output_folder_path --mips --png") << std::endl;
+    Cout << _T("       unpacks every *_bump.dds + *_bump#.dds pair in the folder and its subfolders, the output mirrors the folders") << std::endl;
+    Cout << std::endl;
+    Cout << _T("  Mode 3 - DDS probing:") << std::endl;
+    Cout << _T("    bumpx --probe path_to_textures_folder index_file_path") << std::endl;
+    Cout << _T("       reads only the headers of every dds in the folder and its subfolders, reports malformed files and") << std::endl;
+    Cout << _T("       bump/bump# pairs with a missing or mismatched partner, writes a tab separated index (bumpx_probe.txt by default)") << std::endl;
+    Cout << std::endl;
+    Cout << _T("  Global options (any mode):") << std::endl;
+    Cout << _T("    --cpu:kernels - force cpu kernels (sse2, sse41, avx2, avx512), autodetected by default") << std::endl;
+    Cout << _T("    --stats - print wall/cpu time, MPix/s and bytes in/out of every stage at the end, --stats:file.json writes them as json") << std::endl;
+    Cout << _T("    --counters - --stats plus IPC and cache, branch and dTLB misses per pixel of every stage (linux perf_event_open)") << std::endl;
+    Cout << _T("    --trace:file.json - record every stage, mip and parallel band per thread as a chrome trace (open in perfetto)") << std::endl;
+    Cout << _T("    --quiet - print errors only, --verbose - print per mip progress too") << std::endl;
+    Cout << _T("    --log:json - print every message as a json line (t_ms, level, thread, msg)") << std::endl;
     Cout << std::endl;
 }
 
-PACKED_STRUCT_BEGIN
-struct PixelMono {
-    uint8_t r;
-} PACKED_STRUCT_END;
-
-PACKED_STRUCT_BEGIN
-struct PixelRgb {
-    uint8_t r, g, b;
-} PACKED_STRUCT_END;
-
-PACKED_STRUCT_BEGIN
-struct PixelRgba {
-    uint8_t r, g, b, a;
-} PACKED_STRUCT_END;
-
 template <typename T>
 constexpr size_t BytesPerPixel() {
     return sizeof(T);
@@ -211,112 +997,154 @@ PixelRgba ConvertPixel(const PixelRgb& src) {
 }
 
 
-template <typename T>
-struct Bitmap {
-    using PixelType = T;
+// read-only memory mapping of a whole file, empty files can't be mapped and fail to open
+class MappedFile {
+public:
+    MappedFile() = default;
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+    ~MappedFile() { Close(); }
 
-    Bitmap() = delete;
-    Bitmap(const size_t w, const size_t h, const T& value = {0}) : width(w), height(h), pixels(w * h, value) {}
+    bool Open(const fs::path& path) {
+        Close();
+#ifdef _WIN32
+        void* const kInvalidHandle = rcast<void*>(scast<intptr_t>(-1));
+        void* hFile = CreateFileW(path.c_str(), 0x80000000 /*GENERIC_READ*/, 1 /*FILE_SHARE_READ*/, nullptr,
+                                  3 /*OPEN_EXISTING*/, 0x80 /*FILE_ATTRIBUTE_NORMAL*/, nullptr);
+        if (hFile == kInvalidHandle) {
+            return false;
+        }
 
-    inline bool empty() const { return pixels.empty(); }
-    inline void clear() { width = 0; height = 0; pixels.clear(); }
+        long long fileSize = 0;
+        void* hMapping = nullptr;
+        if (GetFileSizeEx(hFile, &fileSize) && fileSize > 0) {
+            hMapping = CreateFileMappingW(hFile, nullptr, 2 /*PAGE_READONLY*/, 0, 0, nullptr);
+        }
+        if (hMapping) {
+            mData = rcast<const uint8_t*>(MapViewOfFile(hMapping, 4 /*FILE_MAP_READ*/, 0, 0, 0));
+            CloseHandle(hMapping);
+        }
+        CloseHandle(hFile);
+#else
+        const int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            return false;
+        }
 
-    std::vector<PixelType>  pixels;
-    size_t                  width;
-    size_t                  height;
-};
+        struct stat st;
+        long long fileSize = 0;
+        if (fstat(fd, &st) == 0 && st.st_size > 0) {
+            fileSize = st.st_size;
+            void* ptr = mmap(nullptr, scast<size_t>(fileSize), PROT_READ, MAP_PRIVATE, fd, 0);
+            mData = (ptr == MAP_FAILED) ? nullptr : rcast<const uint8_t*>(ptr);
+        }
+        close(fd);
+#endif
+        mSize = mData ? scast<size_t>(fileSize) : 0;
+        return mData != nullptr;
+    }
 
-template <typename T>
-struct Texture {
-    using BitmapType = Bitmap<T>;
+    void Close() {
+        if (mData) {
+#ifdef _WIN32
+            UnmapViewOfFile(mData);
+#else
+            munmap(const_cast<uint8_t*>(mData), mSize);
+#endif
+        }
+        mData = nullptr;
+        mSize = 0;
+    }
+
+    inline const uint8_t* data() const { return mData; }
+    inline size_t size() const { return mSize; }
 
-    std::vector<BitmapType> mips;
+private:
+    const uint8_t*  mData = nullptr;
+    size_t          mSize = 0;
+};
 
-    Texture() = delete;
-    Texture(const size_t w, const size_t h) {
-        const size_t numMips = Log2I(std::max(w, h));
-        mips.reserve(numMips);
 
-        size_t mipW = w, mipH = h;
-        for (size_t i = 0; i < numMips; ++i) {
-            mips.push_back(BitmapType(mipW, mipH));
+// converts the pixels of comp channels into the result (of the same dimensions), false if the conversion is not supported
+template <typename T>
+static bool ConvertPixels(const uint8_t* src, const size_t comp, Bitmap<T>& result) {
+    const size_t desiredBpp = BytesPerPixel<T>();
+    const uint8_t* srcEnd = src + result.pixels.size() * comp;
 
-            mipW = std::max<size_t>(mipW / 2, kMinMipSize);
-            mipH = std::max<size_t>(mipH / 2, kMinMipSize);
+    if (comp == desiredBpp) {
+        std::memcpy(result.pixels.data(), src, result.pixels.size() * desiredBpp);
+    } else {
+        const size_t permutation = comp * 10 + desiredBpp;
+        switch (permutation) {
+            case 31: {
+                std::transform(rcast<const PixelRgb*>(src),
+                               rcast<const PixelRgb*>(srcEnd),
+                               rcast<PixelMono*>(result.pixels.data()),
+                               ConvertPixel<PixelRgb, PixelMono>);
+            } break;
+            case 41: {
+                std::transform(rcast<const PixelRgba*>(src),
+                               rcast<const PixelRgba*>(srcEnd),
+                               rcast<PixelMono*>(result.pixels.data()),
+                               ConvertPixel<PixelRgba, PixelMono>);
+            } break;
+            case 13: {
+                std::transform(rcast<const PixelMono*>(src),
+                               rcast<const PixelMono*>(srcEnd),
+                               rcast<PixelRgb*>(result.pixels.data()),
+                               ConvertPixel<PixelMono, PixelRgb>);
+            } break;
+            case 14: {
+                std::transform(rcast<const PixelMono*>(src),
+                               rcast<const PixelMono*>(srcEnd),
+                               rcast<PixelRgba*>(result.pixels.data()),
+                               ConvertPixel<PixelMono, PixelRgba>);
+            } break;
+            case 34: {
+                std::transform(rcast<const PixelRgb*>(src),
+                               rcast<const PixelRgb*>(srcEnd),
+                               rcast<PixelRgba*>(result.pixels.data()),
+                               ConvertPixel<PixelRgb, PixelRgba>);
+            } break;
+            case 43: {
+                std::transform(rcast<const PixelRgba*>(src),
+                               rcast<const PixelRgba*>(srcEnd),
+                               rcast<PixelRgb*>(result.pixels.data()),
+                               ConvertPixel<PixelRgba, PixelRgb>);
+            } break;
+
+            default:
+                return false;
         }
     }
-};
 
+    return true;
+}
 
+// decodes an image file in memory, if it has the same number of channels it is decoded right into the result
 template <typename T>
-Bitmap<T> LoadBitmap(const fs::path& path) {
-    std::ifstream file(path, std::ifstream::binary);
-    if (file.good()) {
-        BytesArray bytes;
-        file.seekg(0, std::ios::end);
-        bytes.resize(file.tellg());
-        file.seekg(0, std::ios::beg);
-        file.read(rcast<char*>(bytes.data()), bytes.size());
-        file.close();
+Bitmap<T> DecodeBitmap(const uint8_t* data, const size_t size) {
+    int w, h, comp;
+    if (data && stbi_info_from_memory(data, scast<int>(size), &w, &h, &comp)) {
+        Bitmap<T> result(scast<size_t>(w), scast<size_t>(h));
+
+        const size_t desiredBpp = BytesPerPixel<T>();
+        if (scast<size_t>(comp) == desiredBpp) {
+            tStbiTarget = { result.pixels.data(), result.pixels.size() * desiredBpp, false };
+        }
+        uint8_t* imgData = stbi_load_from_memory(data, scast<int>(size), &w, &h, &comp, STBI_default);
+        tStbiTarget = {};
 
-        int w, h, comp;
-        uint8_t* imgData = stbi_load_from_memory(bytes.data(), scast<int>(bytes.size()), &w, &h, &comp, STBI_default);
         if (!imgData) {
             return Bitmap<T>(0, 0);
+        } else if (imgData == rcast<uint8_t*>(result.pixels.data())) {
+            return std::move(result);
         } else {
             std::unique_ptr<uint8_t, decltype(&stbi_image_free)> autoFreeImgData(imgData, stbi_image_free);
 
-            Bitmap<T> result(scast<size_t>(w), scast<size_t>(h));
-
-            const uint8_t* srcBegin = imgData;
-            const uint8_t* srcEnd = imgData + (w * h * comp);
-
-            const size_t desiredBpp = BytesPerPixel<T>();
-            if (scast<size_t>(comp) == desiredBpp) {
-                std::memcpy(result.pixels.data(), imgData, result.pixels.size() * desiredBpp);
-            } else {
-                const size_t permutation = comp * 10 + desiredBpp;
-                switch (permutation) {
-                    case 31: {
-                        std::transform(rcast<const PixelRgb*>(srcBegin),
-                                       rcast<const PixelRgb*>(srcEnd),
-                                       rcast<PixelMono*>(result.pixels.data()),
-                                       ConvertPixel<PixelRgb, PixelMono>);
-                    } break;
-                    case 41: {
-                        std::transform(rcast<const PixelRgba*>(srcBegin),
-                                       rcast<const PixelRgba*>(srcEnd),
-                                       rcast<PixelMono*>(result.pixels.data()),
-                                       ConvertPixel<PixelRgba, PixelMono>);
-                    } break;
-                    case 13: {
-                        std::transform(rcast<const PixelMono*>(srcBegin),
-                                       rcast<const PixelMono*>(srcEnd),
-                                       rcast<PixelRgb*>(result.pixels.data()),
-                                       ConvertPixel<PixelMono, PixelRgb>);
-                    } break;
-                    case 14: {
-                        std::transform(rcast<const PixelMono*>(srcBegin),
-                                       rcast<const PixelMono*>(srcEnd),
-                                       rcast<PixelRgba*>(result.pixels.data()),
-                                       ConvertPixel<PixelMono, PixelRgba>);
-                    } break;
-                    case 34: {
-                        std::transform(rcast<const PixelRgb*>(srcBegin),
-                                       rcast<const PixelRgb*>(srcEnd),
-                                       rcast<PixelRgba*>(result.pixels.data()),
-                                       ConvertPixel<PixelRgb, PixelRgba>);
-                    } break;
-                    case 43: {
-                        std::transform(rcast<const PixelRgba*>(srcBegin),
-                                       rcast<const PixelRgba*>(srcEnd),
-                                       rcast<PixelRgb*>(result.pixels.data()),
-                                       ConvertPixel<PixelRgba, PixelRgb>);
-                    } break;
-
-                    default:
-                        return Bitmap<T>(0, 0);
-                }
+            if (scast<size_t>(w) != result.width || scast<size_t>(h) != result.height ||
+                !ConvertPixels(imgData, scast<size_t>(comp), result)) {
+                return Bitmap<T>(0, 0);
             }
 
             return std::move(result);
@@ -326,28 +1154,35 @@ Bitmap<T> LoadBitmap(const fs::path& path) {
     }
 }
 
+// the file is memory mapped, so there is no copy of it in memory besides the page cache
+template <typename T>
+Bitmap<T> LoadBitmap(const fs::path& path) {
+    MappedFile file;
+    return file.Open(path) ? DecodeBitmap<T>(file.data(), file.size()) : Bitmap<T>(0, 0);
+}
+
+// for bumpx_bench (see bumpx_internal.h)
+template Bitmap<PixelMono> LoadBitmap(const fs::path& path);
+template Bitmap<PixelRgba> LoadBitmap(const fs::path& path);
+
 template <typename T, bool normalize>
 static void MakeMip(const Bitmap<T>& src, Bitmap<T>& dst) {
-    stbir_resize_uint8(rcast<const uint8_t*>(src.pixels.data()), scast<int>(src.width), scast<int>(src.height), 0,
-                       rcast<uint8_t*>(dst.pixels.data()), scast<int>(dst.width), scast<int>(dst.height), 0,
-                       scast<int>(BytesPerPixel<T>()));
+    gKernels->Resize(rcast<const uint8_t*>(src.pixels.data()), src.width, src.height,
+                     rcast<uint8_t*>(dst.pixels.data()), dst.width, dst.height,
+                     BytesPerPixel<T>());
 
     if constexpr(normalize && BytesPerPixel<T>() >= 3) {
-        std::transform(dst.pixels.begin(), dst.pixels.end(), dst.pixels.begin(), [](const T& p)->T {
-            float x = Clamp(scast<float>(p.r) / 255.0f, 0.0f, 1.0f) * 2.0f - 1.0f;
-            float y = Clamp(scast<float>(p.g) / 255.0f, 0.0f, 1.0f) * 2.0f - 1.0f;
-            float z = Clamp(scast<float>(p.b) / 255.0f, 0.0f, 1.0f) * 2.0f - 1.0f;
-            const float il = 1.0f / std::sqrt(x * x + y * y + z * z);
-            x *= il;
-            y *= il;
-            z *= il;
-            T result = { 0 };
-            result.r = scast<uint8_t>(Clamp((x * 0.5f + 0.5f) * 255.0f, 0.0f, 255.0f));
-            result.g = scast<uint8_t>(Clamp((y * 0.5f + 0.5f) * 255.0f, 0.0f, 255.0f));
-            result.b = scast<uint8_t>(Clamp((z * 0.5f + 0.5f) * 255.0f, 0.0f, 255.0f));
-            return result;
-        });
+        gKernels->NormalizeNormals(rcast<uint8_t*>(dst.pixels.data()), dst.pixels.size(), BytesPerPixel<T>());
+    }
+}
+
+template <typename T>
+static uint64_t TexturePixels(const Texture<T>& texture) {
+    uint64_t result = 0;
+    for (const auto& mip : texture.mips) {
+        result += mip.pixels.size();
     }
+    return result;
 }
 
 template <typename T, bool isNormalmap>
@@ -356,31 +1191,16 @@ static void BuildMipchain(Texture<T>& texture) {
     for (int i = 1; i < numMips; ++i) {
         // for each subsequent mip we go as far as 3 steps up for a source for a compromise between quality and the speed
         const int srcMip = std::max(0, i - 3);
+        TraceScope trace(_T("mip build"), i);
         MakeMip<T, isNormalmap>(texture.mips[srcMip], texture.mips[i]);
     }
 }
 
 void CompressBC3_STB(const Bitmap<PixelRgba>& bmp, void* outBlocks) {
-    const uint8_t* srcPtr = rcast<const uint8_t*>(bmp.pixels.data());
-    uint8_t* dst = rcast<uint8_t*>(outBlocks);
-
-    uint8_t pixelsBlock[16 * 4] = { 0 };
-
-    for (size_t y = 0; y < bmp.height; y += 4) {
-        for (size_t x = 0; x < bmp.width; x += 4) {
-            const uint8_t* src = srcPtr + (y * bmp.width + x) * 4;
-            for (size_t i = 0; i < 4; ++i) {
-                std::memcpy(&pixelsBlock[i * 16], src, 16);
-                src += (bmp.width * 4);
-            }
-
-            stb_compress_dxt_block(dst, pixelsBlock, 1, STB_DXT_HIGHQUAL);
-            dst += 16;
-        }
-    }
+    gKernels->CompressBC3_STB(rcast<const uint8_t*>(bmp.pixels.data()), bmp.width, bmp.height, outBlocks);
 }
 
-void CompressBC3_Squish(const Bitmap<PixelRgba>& bmp, void* outBlocks) {
+void CompressBC3_Squish(const Bitmap<PixelRgba>& bmp, void* outBlocks, const int colourFit) {
     const uint8_t* srcPtr = rcast<const uint8_t*>(bmp.pixels.data());
     uint8_t* dst = rcast<uint8_t*>(outBlocks);
 
@@ -394,30 +1214,14 @@ void CompressBC3_Squish(const Bitmap<PixelRgba>& bmp, void* outBlocks) {
                 src += (bmp.width * 4);
             }
 
-            squish::Compress(pixelsBlock, dst, squish::kDxt5 | squish::kColourIterativeClusterFit);
+            squish::Compress(pixelsBlock, dst, squish::kDxt5 | colourFit);
             dst += 16;
         }
     }
 }
 
-void CompressBC3_RGBCX(const Bitmap<PixelRgba>& bmp, void* outBlocks) {
-    const uint8_t* srcPtr = rcast<const uint8_t*>(bmp.pixels.data());
-    uint8_t* dst = rcast<uint8_t*>(outBlocks);
-
-    uint8_t pixelsBlock[16 * 4] = { 0 };
-
-    for (size_t y = 0; y < bmp.height; y += 4) {
-        for (size_t x = 0; x < bmp.width; x += 4) {
-            const uint8_t* src = srcPtr + (y * bmp.width + x) * 4;
-            for (size_t i = 0; i < 4; ++i) {
-                std::memcpy(&pixelsBlock[i * 16], src, 16);
-                src += (bmp.width * 4);
-            }
-
-            rgbcx::encode_bc3(rgbcx::MAX_LEVEL, dst, pixelsBlock);
-            dst += 16;
-        }
-    }
+void CompressBC3_RGBCX(const Bitmap<PixelRgba>& bmp, const BC1ApproxMode bc1Mode, void* outBlocks, const uint32_t level) {
+    gKernels->CompressBC3_RGBCX(rcast<const uint8_t*>(bmp.pixels.data()), bmp.width, bmp.height, outBlocks, bc1Mode, level);
 }
 
 #ifdef ENABLE_NVTT3
@@ -441,38 +1245,448 @@ void CompressBC3_NVTT3(const Bitmap<PixelRgba>& bmp, void* outBlocks) {
 #endif // ENABLE_NVTT3
 
 
-void CompressBC3(const int quality, const Bitmap<PixelRgba>& bmp, void* outBlocks) {
+// parsed -q: option, a quality level (or auto policy) for all mips + optional per mip overrides
+struct QualitySettings {
+    bool                                autoPolicy = false;
+    int                                 quality = 2;
+    std::vector<std::pair<size_t, int>> overrides;  // mip index, quality
+
+    int ForMip(const size_t mipIdx, const size_t mipW, const size_t mipH) const {
+        auto it = std::find_if(overrides.rbegin(), overrides.rend(), [mipIdx](const auto& o)->bool {
+            return o.first == mipIdx;
+        });
+
+        if (it != overrides.rend()) {
+            return it->second;
+        } else if (!autoPolicy) {
+            return quality;
+        } else {
+            const size_t numPixels = mipW * mipH;
+            return numPixels >= kAutoQualityFastMinPixels ? 0 : (numPixels >= kAutoQualityMediumMinPixels ? 1 : 2);
+        }
+    }
+
+    bool Uses(const int q) const {
+        return (!autoPolicy && quality == q) || std::any_of(overrides.begin(), overrides.end(), [q](const auto& o)->bool {
+            return o.second == q;
+        });
+    }
+
+    void Replace(const int from, const int to) {
+        quality = (quality == from) ? to : quality;
+        for (auto& o : overrides) {
+            o.second = (o.second == from) ? to : o.second;
+        }
+    }
+};
+
+static bool IsValidQuality(const int quality) {
+    return quality >= 0 && quality < scast<int>(kNumCompressors);
+}
+
+// -q:quality[,mip=quality...] where the first quality may also be "auto", false if any of them is out of range
+static bool ParseQualityParam(const String& param, QualitySettings& settings) {
+    const std::vector<String> parts = StrSplit(param, _T(','));
+
+    if (parts[0] == _T("auto")) {
+        settings.autoPolicy = true;
+    } else if (!StrToInt(parts[0], settings.quality) || !IsValidQuality(settings.quality)) {
+        return false;
+    }
+
+    for (size_t i = 1; i < parts.size(); ++i) {
+        const std::vector<String> kv = StrSplit(parts[i], _T('='));
+        int mipIdx, quality;
+        if (kv.size() != 2 || !StrToInt(kv[0], mipIdx) || !StrToInt(kv[1], quality) || !IsValidQuality(quality)) {
+            return false;
+        }
+        settings.overrides.push_back({ scast<size_t>(mipIdx), quality });
+    }
+
+    return true;
+}
+
+// calls func(encode) with the BC3 encoder of quality, encode(const Bitmap<PixelRgba>& bmp, void* outBlocks) is a distinct
+// type per encoder, so the quality is switched on once and whatever func does with encode is compiled for that encoder
+template <typename Func>
+static void WithBC3Encoder(const int quality, const BC1ApproxMode bc1Mode, Func func) {
     switch (quality) {
         case 0:
-            CompressBC3_STB(bmp, outBlocks);
+            func([](const Bitmap<PixelRgba>& bmp, void* outBlocks) { CompressBC3_STB(bmp, outBlocks); });
         break;
         case 1:
-            CompressBC3_Squish(bmp, outBlocks);
+            func([](const Bitmap<PixelRgba>& bmp, void* outBlocks) { CompressBC3_Squish(bmp, outBlocks); });
         break;
 #ifdef ENABLE_NVTT3
         case 3:
-            CompressBC3_NVTT3(bmp, outBlocks);
+            func([](const Bitmap<PixelRgba>& bmp, void* outBlocks) { CompressBC3_NVTT3(bmp, outBlocks); });
         break;
 #endif
         case 2:
         default:
-            CompressBC3_RGBCX(bmp, outBlocks);
+            func([bc1Mode](const Bitmap<PixelRgba>& bmp, void* outBlocks) { CompressBC3_RGBCX(bmp, bc1Mode, outBlocks); });
         break;
     }
 }
 
 
-void DecompressBC3_MY(const void* inputBlocks, Bitmap<PixelRgba>& output) {
+// set on the threads of the bulk unpacking pool, which already keeps all the cores busy with separate textures,
+// parallel loops are run on the calling thread there
+static thread_local bool tInWorkerPool = false;
+
+static size_t MaxWorkerThreads() {
+    return tInWorkerPool ? 1 : std::max<size_t>(1, std::thread::hardware_concurrency());
+}
+
+// counting semaphore (there's none in C++17), bounds the number of threads doing file I/O at once
+class IoLimiter {
+public:
+    explicit IoLimiter(const size_t maxConcurrent) : mAvailable(maxConcurrent) {}
+
+    void Acquire() {
+        std::unique_lock<std::mutex> lock(mMutex);
+        mCondition.wait(lock, [this]() { return mAvailable > 0; });
+        --mAvailable;
+    }
+
+    void Release() {
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            ++mAvailable;
+        }
+        mCondition.notify_one();
+    }
+
+private:
+    std::mutex              mMutex;
+    std::condition_variable mCondition;
+    size_t                  mAvailable;
+};
+
+// holds the limiter for the scope, no limiter - no limits
+class IoScope {
+public:
+    explicit IoScope(IoLimiter* limiter) : mLimiter(limiter) { if (mLimiter) mLimiter->Acquire(); }
+    ~IoScope() { if (mLimiter) mLimiter->Release(); }
+
+private:
+    IoLimiter* mLimiter;
+};
+
+// splits [0, count) into contiguous bands, one per thread (as many as the hardware has, but each gets at least
+// minPerThread items) and calls func(first, num) for each band, the calling thread takes the first band itself,
+// every band is traced as name (see --trace), the threads are muted if the calling one is (see LogMuteScope)
+template <typename Func>
+static void ParallelForBands(const Char* name, const size_t count, const size_t minPerThread, Func func) {
+    const size_t numThreads = Clamp<size_t>(count / std::max<size_t>(1, minPerThread), 1, MaxWorkerThreads());
+
+    const bool muted = tLogMuted;
+    auto band = [name, muted, &func](const size_t first, const size_t num) {
+        tLogMuted = muted;
+        TraceScope trace(name, -1, first, num);
+        func(first, num);
+    };
+
+    if (numThreads == 1) {
+        band(size_t(0), count);
+    } else {
+        const size_t perThread = (count + numThreads - 1) / numThreads;
+
+        std::vector<std::thread> threads;
+        for (size_t first = perThread; first < count; first += perThread) {
+            threads.emplace_back(band, first, std::min(perThread, count - first));
+        }
+        band(size_t(0), std::min(perThread, count));
+
+        for (auto& t : threads) {
+            t.join();
+        }
+    }
+}
+
+static void DecompressBC3_MY(const void* inputBlocks, Bitmap<PixelRgba>& output) {
     const uint8_t* src = rcast<const uint8_t*>(inputBlocks);
-    uint8_t* dest = rcast<uint8_t*>(output.pixels.data());
+    uint8_t* dst = rcast<uint8_t*>(output.pixels.data());
+
+    const size_t width = output.width;
+    const size_t blocksPerRow = output.width / 4;
+    const size_t minRowsPerThread = kMinBlocksPerDecodeThread / std::max<size_t>(1, blocksPerRow);
+
+    ParallelForBands(_T("decode rows"), output.height / 4, minRowsPerThread, [=](const size_t firstRow, const size_t numRows) {
+        gKernels->DecompressBC3(src + firstRow * blocksPerRow * 16, dst + firstRow * 4 * width * 4, width, numRows * 4);
+    });
+}
+
+
+// the same maths the game (and DisassembleBump kernel in UnpackBump) uses to get the normal back from bump and bump#, not normalized
+inline void ReconstructNormal(const PixelRgba& bump, const PixelRgba& bumpX, float& nx, float& ny, float& nz) {
+    nx = scast<float>(bump.a) / 255.0f + (scast<float>(bumpX.r) / 255.0f - 1.0f);
+    ny = scast<float>(bump.b) / 255.0f + (scast<float>(bumpX.g) / 255.0f - 1.0f);
+    nz = scast<float>(bump.g) / 255.0f + (scast<float>(bumpX.b) / 255.0f - 1.0f);
+}
+
+// error of the final reconstruction of a 4x4 block: angular (1 - cos) for the normal + squared gloss error
+static float ClosedLoopBlockError(const PixelRgba* src, const PixelRgba* bump, const PixelRgba* bumpX) {
+    float error = 0.0f;
+    for (size_t i = 0; i < 16; ++i) {
+        // source normal, swizzled as in bump (a - NX, b - NY, g - NZ)
+        const float sx = scast<float>(src[i].a) / 255.0f * 2.0f - 1.0f;
+        const float sy = scast<float>(src[i].b) / 255.0f * 2.0f - 1.0f;
+        const float sz = scast<float>(src[i].g) / 255.0f * 2.0f - 1.0f;
+
+        float rx, ry, rz;
+        ReconstructNormal(bump[i], bumpX[i], rx, ry, rz);
+
+        const float len = std::sqrt((sx * sx + sy * sy + sz * sz) * (rx * rx + ry * ry + rz * rz));
+        error += (len > 0.0f) ? (1.0f - (sx * rx + sy * ry + sz * rz) / len) : 1.0f;
+
+        const float glossError = (scast<float>(src[i].r) - scast<float>(bump[i].r)) / 255.0f;
+        error += glossError * glossError;
+    }
+    return error;
+}
+
+// Closed loop bump + bump# compression, every block pair is judged by the final reconstruction (see ReconstructNormal).
+// bump# stores exactly what the reconstruction lacks after the decoded bump, then bump is re-targeted so that
+// together with the decoded bump# it lands on the source, this alternates numPasses times and the best pair wins.
+// encode is called as encode(const Bitmap<PixelRgba>& bmp, void* outBlocks) for every 4x4 block, see WithBC3Encoder
+template <typename EncodeFunc>
+static void CompressBumpClosedLoop(EncodeFunc encode, const size_t numPasses,
+                                   const Bitmap<PixelRgba>& bumpMip, const Bitmap<PixelMono>& heightMip,
+                                   uint8_t* outBump, uint8_t* outBumpX, double& bumpTime, double& bumpXTime) {
+    using Clock = std::chrono::steady_clock;
+
+    Bitmap<PixelRgba> srcBlock(4, 4), bumpTarget(4, 4), bumpXTarget(4, 4), bumpDecoded(4, 4), bumpXDecoded(4, 4);
+    uint8_t bumpBlock[16], bumpXBlock[16];
+    PixelMono heights[16];
+
+    auto residual = [](const uint8_t a, const uint8_t b)->uint8_t {
+        return scast<uint8_t>(Clamp(scast<int>(a) - scast<int>(b) + 128, 0, 255));
+    };
+
+    Clock::duration bumpDuration{}, bumpXDuration{};
+
+    for (size_t y = 0; y < bumpMip.height; y += 4) {
+        for (size_t x = 0; x < bumpMip.width; x += 4) {
+            for (size_t i = 0; i < 4; ++i) {
+                std::memcpy(&srcBlock.pixels[i * 4], &bumpMip.pixels[(y + i) * bumpMip.width + x], 4 * sizeof(PixelRgba));
+                std::memcpy(&heights[i * 4], &heightMip.pixels[(y + i) * heightMip.width + x], 4 * sizeof(PixelMono));
+            }
+
+            bumpTarget.pixels = srcBlock.pixels;
+            float bestError = std::numeric_limits<float>::max();
+
+            for (size_t pass = 0; pass < numPasses && bestError > 0.0f; ++pass) {
+                auto startTime = Clock::now();
+                encode(bumpTarget, bumpBlock);
+                bumpDuration += Clock::now() - startTime;
+                DecompressBC3_MY(bumpBlock, bumpDecoded);
+
+                for (size_t i = 0; i < 16; ++i) {
+                    const PixelRgba& sp = srcBlock.pixels[i];
+                    const PixelRgba& dp = bumpDecoded.pixels[i];
+                    bumpXTarget.pixels[i] = { residual(sp.a, dp.a), residual(sp.b, dp.b), residual(sp.g, dp.g), heights[i].r };
+                }
+
+                startTime = Clock::now();
+                encode(bumpXTarget, bumpXBlock);
+                bumpXDuration += Clock::now() - startTime;
+                DecompressBC3_MY(bumpXBlock, bumpXDecoded);
+
+                const float error = ClosedLoopBlockError(srcBlock.pixels.data(), bumpDecoded.pixels.data(), bumpXDecoded.pixels.data());
+                if (error < bestError) {
+                    bestError = error;
+                    std::memcpy(outBump, bumpBlock, 16);
+                    std::memcpy(outBumpX, bumpXBlock, 16);
+                }
+
+                // what the bump should have been for the bump# we've got
+                for (size_t i = 0; i < 16; ++i) {
+                    const PixelRgba& sp = srcBlock.pixels[i];
+                    const PixelRgba& xp = bumpXDecoded.pixels[i];
+                    bumpTarget.pixels[i] = { sp.r, residual(sp.g, xp.b), residual(sp.b, xp.g), residual(sp.a, xp.r) };
+                }
+            }
+
+            outBump += 16;
+            outBumpX += 16;
+        }
+    }
+
+    bumpTime += std::chrono::duration<double, std::milli>(bumpDuration).count();
+    bumpXTime += std::chrono::duration<double, std::milli>(bumpXDuration).count();
+}
+
+void MakeBumpXMip(const Bitmap<PixelRgba>& bumpMip, const Bitmap<PixelMono>& heightMip, const uint8_t* compressedBump, Bitmap<PixelRgba>& bumpXMip) {
+    DecompressBC3_MY(compressedBump, bumpXMip);
+    gKernels->AssembleBumpX(rcast<const uint8_t*>(bumpMip.pixels.data()),
+                            rcast<const uint8_t*>(bumpXMip.pixels.data()),
+                            rcast<const uint8_t*>(heightMip.pixels.data()),
+                            rcast<uint8_t*>(bumpXMip.pixels.data()),
+                            bumpXMip.pixels.size());
+}
+
+// the classic way with any BC3 encoder: compress the bump, decompress it and store the error * 2 with the height in bump#,
+// encode is called as encode(const Bitmap<PixelRgba>& bmp, void* outBlocks), mip is only for --stats
+template <typename EncodeFunc>
+void CompressBumpPairWith(EncodeFunc encode, const Bitmap<PixelRgba>& bumpMip, const Bitmap<PixelMono>& heightMip,
+                          uint8_t* outBump, uint8_t* outBumpX, double& bumpTime, double& bumpXTime, const int mip) {
+    using Clock = std::chrono::steady_clock;
+
+    const uint64_t numPixels = bumpMip.pixels.size();
+    const uint64_t compressedSize = numPixels;  // BC3 is a byte per pixel
+
+    {
+        StageTimer timer(_T("bump encode"), mip);
+        timer.SetVolume(numPixels, numPixels * sizeof(PixelRgba), compressedSize);
+        auto startTime = Clock::now();
+        encode(bumpMip, outBump);
+        bumpTime += std::chrono::duration<double, std::milli>(Clock::now() - startTime).count();
+    }
+
+    // decompress the bump and calculate the error, un-swizzle it back to RGB, move height to alpha
+    Bitmap<PixelRgba> bumpXMip(bumpMip.width, bumpMip.height);
+    {
+        StageTimer timer(_T("residual"), mip);
+        timer.SetVolume(numPixels, compressedSize + numPixels * (sizeof(PixelRgba) + sizeof(PixelMono)), numPixels * sizeof(PixelRgba));
+        MakeBumpXMip(bumpMip, heightMip, outBump, bumpXMip);
+    }
+
+    StageTimer timer(_T("bump# encode"), mip);
+    timer.SetVolume(numPixels, numPixels * sizeof(PixelRgba), compressedSize);
+    const auto startTime = Clock::now();
+    encode(bumpXMip, outBumpX);
+    bumpXTime += std::chrono::duration<double, std::milli>(Clock::now() - startTime).count();
+}
+
+// for bumpx_bench (see bumpx_internal.h)
+template void CompressBumpPairWith(BC3EncodeFunc encode, const Bitmap<PixelRgba>& bumpMip, const Bitmap<PixelMono>& heightMip,
+                                   uint8_t* outBump, uint8_t* outBumpX, double& bumpTime, double& bumpXTime, const int mip);
+
+// compresses bump and bump# of a mip (or of any bitmap made of whole 4x4 blocks), closedLoopPasses = 0 means
+// the classic way (see CompressBumpPairWith), mip is only for --stats
+static void CompressBumpPair(const int quality, const BC1ApproxMode bc1Mode, const size_t closedLoopPasses,
+                             const Bitmap<PixelRgba>& bumpMip, const Bitmap<PixelMono>& heightMip,
+                             uint8_t* outBump, uint8_t* outBumpX, double& bumpTime, double& bumpXTime, const int mip) {
+    WithBC3Encoder(quality, bc1Mode, [&](auto encode) {
+        if (closedLoopPasses > 0) {
+            const uint64_t numPixels = bumpMip.pixels.size();
+            StageTimer timer(_T("closed loop encode"), mip);
+            timer.SetVolume(numPixels, numPixels * (sizeof(PixelRgba) + sizeof(PixelMono)), numPixels * 2);
+            CompressBumpClosedLoop(encode, closedLoopPasses, bumpMip, heightMip, outBump, outBumpX, bumpTime, bumpXTime);
+        } else {
+            CompressBumpPairWith(encode, bumpMip, heightMip, outBump, outBumpX, bumpTime, bumpXTime, mip);
+        }
+    });
+}
+
+
+// --incremental support: every 4x4 block of every mip gets a hash of everything its encoding depends on
+// (the assembled bump pixels, the height and the compression settings), so a block with the same hash as
+// in the previous run can be taken from the previously packed files as is, but only if these are still the files
+// the hashes were saved with (see PackedFilesDigest)
+static const uint32_t kBlockHashesSignature = 0x48425842;   // "BXBH"
+static const uint32_t kBlockHashesVersion = 2;
+
+using BlockHashes = std::vector<uint64_t>;
+
+// size and hash of the bump and bump# dds files
+struct PackedFilesDigest {
+    uint64_t    bumpSize;
+    uint64_t    bumpHash;
+    uint64_t    bumpXSize;
+    uint64_t    bumpXHash;
+};
+
+uint64_t HashBytes(const void* data, const size_t size, uint64_t hash) {
+    const uint8_t* ptr = rcast<const uint8_t*>(data);
+    for (size_t i = 0; i < size; ++i) {
+        hash = (hash ^ ptr[i]) * 0x100000001b3ull;
+    }
+    return hash;
+}
+
+static BlockHashes HashMipBlocks(const Bitmap<PixelRgba>& bumpMip, const Bitmap<PixelMono>& heightMip, const uint64_t settingsHash) {
+    BlockHashes result;
+    result.reserve((bumpMip.width / 4) * (bumpMip.height / 4));
+
+    for (size_t y = 0; y < bumpMip.height; y += 4) {
+        for (size_t x = 0; x < bumpMip.width; x += 4) {
+            uint64_t hash = settingsHash;
+            for (size_t i = 0; i < 4; ++i) {
+                hash = HashBytes(&bumpMip.pixels[(y + i) * bumpMip.width + x], 4 * sizeof(PixelRgba), hash);
+                hash = HashBytes(&heightMip.pixels[(y + i) * heightMip.width + x], 4 * sizeof(PixelMono), hash);
+            }
+            result.push_back(hash);
+        }
+    }
+
+    return result;
+}
 
-    for (size_t y = 0; y < output.height; y += 4) {
-        for (size_t x = 0; x < output.width; x += 4) {
-            uint8_t* dst = dest + (y * output.width + x) * 4;
-            bcdec_bc3(src, dst, static_cast<int>(output.width * 4));
-            src += BCDEC_BC3_BLOCK_SIZE;
+// the file is: signature, version, width, height, number of mips, the digest of the dds files and then all the mips hashes
+// one after another
+static bool SaveBlockHashes(const std::vector<BlockHashes>& mipsHashes, const size_t w, const size_t h, const PackedFilesDigest& digest, const fs::path& outPath) {
+    std::ofstream file(outPath, std::ofstream::binary);
+    if (file.good()) {
+        const uint32_t header[5] = { kBlockHashesSignature, kBlockHashesVersion, scast<uint32_t>(w), scast<uint32_t>(h), scast<uint32_t>(mipsHashes.size()) };
+        file.write(rcast<const char*>(header), sizeof(header));
+        file.write(rcast<const char*>(&digest), sizeof(digest));
+        for (auto& mh : mipsHashes) {
+            file.write(rcast<const char*>(mh.data()), mh.size() * sizeof(uint64_t));
+        }
+        return file.good();
+    } else {
+        return false;
+    }
+}
+
+// succeeds only if the hashes were made for exactly the same layout as expected (dimensions and mips)
+// and saved together with the dds files that are there now
+static bool LoadBlockHashes(const fs::path& path, const std::vector<BlockHashes>& expected, const size_t w, const size_t h,
+                            const PackedFilesDigest& digest, std::vector<BlockHashes>& mipsHashes) {
+    std::ifstream file(path, std::ifstream::binary);
+    uint32_t header[5] = { 0 };
+    PackedFilesDigest savedDigest = {};
+    if (!file.read(rcast<char*>(header), sizeof(header)) ||
+        header[0] != kBlockHashesSignature || header[1] != kBlockHashesVersion ||
+        header[2] != w || header[3] != h || header[4] != expected.size() ||
+        !file.read(rcast<char*>(&savedDigest), sizeof(savedDigest)) ||
+        savedDigest.bumpSize != digest.bumpSize || savedDigest.bumpHash != digest.bumpHash ||
+        savedDigest.bumpXSize != digest.bumpXSize || savedDigest.bumpXHash != digest.bumpXHash) {
+        return false;
+    }
+
+    mipsHashes.resize(expected.size());
+    for (size_t i = 0; i < expected.size(); ++i) {
+        mipsHashes[i].resize(expected[i].size());
+        if (!file.read(rcast<char*>(mipsHashes[i].data()), mipsHashes[i].size() * sizeof(uint64_t))) {
+            mipsHashes.clear();
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// packs the listed 4x4 blocks of a mip one after another into a (4 * numBlocks) x 4 strip, so they can be fed to the encoders
+template <typename T>
+static Bitmap<T> GatherBlocks(const Bitmap<T>& mip, const std::vector<size_t>& blocks) {
+    Bitmap<T> strip(blocks.size() * 4, 4);
+    const size_t blocksPerRow = mip.width / 4;
+    for (size_t i = 0; i < blocks.size(); ++i) {
+        const size_t x = (blocks[i] % blocksPerRow) * 4, y = (blocks[i] / blocksPerRow) * 4;
+        for (size_t row = 0; row < 4; ++row) {
+            std::memcpy(&strip.pixels[row * strip.width + i * 4], &mip.pixels[(y + row) * mip.width + x], 4 * sizeof(T));
         }
     }
+    return strip;
+}
+
+static void ScatterCompressedBlocks(const uint8_t* stripBlocks, const std::vector<size_t>& blocks, uint8_t* mipBlocks) {
+    for (size_t i = 0; i < blocks.size(); ++i) {
+        std::memcpy(mipBlocks + blocks[i] * 16, stripBlocks + i * 16, 16);
+    }
 }
 
 
@@ -525,472 +1739,1968 @@ struct DDSURFACEDESC2 {
     uint32_t dwUnused1;
 };
 
-bool SaveAsDDS(const std::vector<BytesArray>& compressedMips, const size_t w, const size_t h, const fs::path& outPath) {
-    std::ofstream file(outPath, std::ofstream::binary);
-    if (file.good()) {
-        DDSURFACEDESC2 desc = {};
-        desc.dwSize = sizeof(DDSURFACEDESC2);
-        desc.dwFlags = 0x00021007; // DDSD_CAPS | DDSD_HEIGHT | DDSD_WIDTH | DDSD_PIXELFORMAT | DDSD_MIPMAPCOUNT
-        desc.dwWidth = scast<uint32_t>(w);
-        desc.dwHeight = scast<uint32_t>(h);
-        desc.dwMipMapCount = scast<uint32_t>(compressedMips.size());
-        desc.ddpfPixelFormat.dwSize = sizeof(DDPIXELFORMAT);
-        desc.ddpfPixelFormat.dwFlags = 0x00000004; // DDPF_FOURCC
-        desc.ddpfPixelFormat.dwFourCC = 0x35545844; // DXT5
-        desc.ddsCaps.dwCaps = 0x00401000;// DDSCAPS_TEXTURE | DDSCAPS_MIPMAP;
+static uint64_t DDSFileSize(const std::vector<BytesArray>& compressedMips) {
+    uint64_t result = sizeof(kDDSFileSignature) + sizeof(DDSURFACEDESC2);
+    for (auto& cm : compressedMips) {
+        result += cm.size();
+    }
+    return result;
+}
 
-        file.write(rcast<const char*>(&kDDSFileSignature), sizeof(kDDSFileSignature));
-        file.write(rcast<const char*>(&desc), sizeof(desc));
+static bool WriteDDS(const std::vector<BytesArray>& compressedMips, const size_t w, const size_t h, std::ostream& stream) {
+    DDSURFACEDESC2 desc = {};
+    desc.dwSize = sizeof(DDSURFACEDESC2);
+    desc.dwFlags = 0x00021007; // DDSD_CAPS | DDSD_HEIGHT | DDSD_WIDTH | DDSD_PIXELFORMAT | DDSD_MIPMAPCOUNT
+    desc.dwWidth = scast<uint32_t>(w);
+    desc.dwHeight = scast<uint32_t>(h);
+    desc.dwMipMapCount = scast<uint32_t>(compressedMips.size());
+    desc.ddpfPixelFormat.dwSize = sizeof(DDPIXELFORMAT);
+    desc.ddpfPixelFormat.dwFlags = 0x00000004; // DDPF_FOURCC
+    desc.ddpfPixelFormat.dwFourCC = 0x35545844; // DXT5
+    desc.ddsCaps.dwCaps = 0x00401000;// DDSCAPS_TEXTURE | DDSCAPS_MIPMAP;
+
+    stream.write(rcast<const char*>(&kDDSFileSignature), sizeof(kDDSFileSignature));
+    stream.write(rcast<const char*>(&desc), sizeof(desc));
+
+    for (auto& cm : compressedMips) {
+        stream.write(rcast<const char*>(cm.data()), cm.size());
+    }
 
-        for (auto& cm : compressedMips) {
-            file.write(rcast<const char*>(cm.data()), cm.size());
-        }
+    return stream.good();
+}
 
-        file.flush();
-        file.close();
+// written to outPath.tmp and renamed over outPath, so a crash or a failed write never leaves a half-written dds
+// (--incremental reads the previous one back)
+static bool SaveAsDDS(const std::vector<BytesArray>& compressedMips, const size_t w, const size_t h, const fs::path& outPath) {
+    fs::path tmpPath = outPath;
+    tmpPath += _T(".tmp");
 
-        return true;
-    } else {
+    std::ofstream file(tmpPath, std::ofstream::binary);
+    if (!file.good()) {
         return false;
     }
-}
 
-int PackBump(int argc, Char** argv) {
+    const bool result = WriteDDS(compressedMips, w, h, file);
+    file.flush();
+    file.close();
+
     std::error_code errorCode;
-    fs::file_status fileStatus;
+    if (result && !file.fail()) {
+        fs::rename(tmpPath, outPath, errorCode);
+        if (!errorCode) {
+            return true;
+        }
+    }
+    fs::remove(tmpPath, errorCode);
+    return false;
+}
 
-    String paramN, paramG, paramH, paramO, paramL, paramQ;
+// --roundtrip: packs and unpacks in memory, measuring the quality of the reconstruction and the speed (see RoundtripStats)
+double PSNR(const double squaredError, const size_t numSamples) {
+    const double mse = squaredError / scast<double>(std::max<size_t>(1, numSamples));
+    return mse > 0.0 ? 10.0 * std::log10(255.0 * 255.0 / mse) : std::numeric_limits<double>::infinity();
+}
 
-    std::vector<std::pair<Char, String*>> paramsMap = {
-        { _T('n'), &paramN },
-        { _T('g'), &paramG },
-        { _T('h'), &paramH },
-        { _T('o'), &paramO },
-        { _T('l'), &paramL },
-        { _T('q'), &paramQ }
-    };
+void MeasureRoundtrip(const Bitmap<PixelRgba>& bumpMip, const Bitmap<PixelMono>& heightMip,
+                      const uint8_t* compressedBump, const uint8_t* compressedBumpX, RoundtripStats& stats) {
+    using Clock = std::chrono::steady_clock;
+
+    const size_t numPixels = bumpMip.pixels.size();
+    stats.numPixels += numPixels;
+
+    Bitmap<PixelRgba> bump(bumpMip.width, bumpMip.height), bumpX(bumpMip.width, bumpMip.height);
+    std::vector<PixelRgb> normals(numPixels);
+    std::vector<uint8_t> gloss(numPixels), height(numPixels);
+    const auto startTime = Clock::now();
+    DecompressBC3_MY(compressedBump, bump);
+    DecompressBC3_MY(compressedBumpX, bumpX);
+    gKernels->DisassembleBump(rcast<const uint8_t*>(bump.pixels.data()), rcast<const uint8_t*>(bumpX.pixels.data()),
+                              rcast<uint8_t*>(normals.data()), gloss.data(), height.data(), numPixels);
+    stats.decodeMs += std::chrono::duration<double, std::milli>(Clock::now() - startTime).count();
+
+    const double kRadToDeg = 180.0 / 3.14159265358979323846;
+    for (size_t i = 0; i < numPixels; ++i) {
+        // source normal is swizzled in bump (a - NX, b - NY, g - NZ), error is measured before the output quantization
+        const PixelRgba& src = bumpMip.pixels[i];
+        const double sx = src.a / 255.0 * 2.0 - 1.0, sy = src.b / 255.0 * 2.0 - 1.0, sz = src.g / 255.0 * 2.0 - 1.0;
+
+        float rx, ry, rz;
+        ReconstructNormal(bump.pixels[i], bumpX.pixels[i], rx, ry, rz);
+
+        const double len = std::sqrt((sx * sx + sy * sy + sz * sz) * (scast<double>(rx) * rx + scast<double>(ry) * ry + scast<double>(rz) * rz));
+        const double cosAngle = len > 0.0 ? Clamp((sx * rx + sy * ry + sz * rz) / len, -1.0, 1.0) : -1.0;
+        const double angle = std::acos(cosAngle) * kRadToDeg;
+        stats.normalErrorSum += angle;
+        stats.normalErrorMax = std::max(stats.normalErrorMax, angle);
+
+        const double glossError = scast<double>(src.r) - gloss[i];
+        const double heightError = scast<double>(heightMip.pixels[i].r) - height[i];
+        stats.glossSquaredError += glossError * glossError;
+        stats.heightSquaredError += heightError * heightError;
+    }
 
-    Char** it = argv, **end = argv + argc;
-    for (; it != end; ++it) {
-        String s = *it;
+}
 
-        bool knownParam = false;
-        if (s.length() > 3 && s[2] == ':') {
-            if (s[0] == _T('-')) {
-                const Char c = s[1];
-                auto paramsIt = std::find_if(paramsMap.begin(), paramsMap.end(), [c](auto& v)->bool {
-                    return c == v.first;
-                });
+static RoundtripStats RoundtripMip(const int quality, const BC1ApproxMode bc1Mode, const size_t closedLoopPasses,
+                                   const Bitmap<PixelRgba>& bumpMip, const Bitmap<PixelMono>& heightMip, const int mip) {
+    RoundtripStats stats;
 
-                if (paramsIt != paramsMap.end()) {
-                    knownParam = true;
-                    *paramsIt->second = s.substr(3);
-                    paramsMap.erase(paramsIt);
-                } else {
-                    const size_t paramIdx = std::distance(it, end);
-                    Cerr << _T("Unknown param #") << paramIdx << _T(" \"") << s << _T("\"") << std::endl;
-                }
-            }
-        }
-    }
+    const size_t compressedMipSize = ((bumpMip.width / 4) * (bumpMip.height / 4)) * 16;
+    BytesArray compressedBump(compressedMipSize), compressedBumpX(compressedMipSize);
+    double bumpMs = 0.0, bumpXMs = 0.0;
+    CompressBumpPair(quality, bc1Mode, closedLoopPasses, bumpMip, heightMip, compressedBump.data(), compressedBumpX.data(), bumpMs, bumpXMs, mip);
+    stats.encodeMs = bumpMs + bumpXMs;
 
-    const bool linearGloss = !paramL.empty() && paramL.front() == _T('g');
-    int quality = !paramQ.empty() ? std::stoi(paramQ) : 2;
+    MeasureRoundtrip(bumpMip, heightMip, compressedBump.data(), compressedBumpX.data(), stats);
+    return stats;
+}
+
+static void RoundtripReport(const String& title, const std::vector<int>& mipsQuality, const BC1ApproxMode bc1Mode, const size_t closedLoopPasses,
+                            const Texture<PixelRgba>& bumpMips, const Texture<PixelMono>& heightMips) {
+    auto mpixPerSecond = [](const size_t numPixels, const double ms)->double {
+        return ms > 0.0 ? scast<double>(numPixels) / (ms * 1000.0) : 0.0;
+    };
 
-    if (quality < 0) {
-        quality = 0;
-    } else if (quality >= kNumCompressors) {
-        quality = static_cast<int>(kNumCompressors - 1);
+    const auto coutFlags = Cout.flags();
+    const auto coutPrecision = Cout.precision();
+
+    Cout << _T("Round trip with ") << title << _T(":") << std::endl;
+    Cout << _T("  mip         size  enc MPix/s  dec MPix/s  normal mean deg   max deg  gloss dB  height dB") << std::endl;
+
+    RoundtripStats total;
+    for (size_t i = 0, end = bumpMips.mips.size(); i != end; ++i) {
+        const auto& mip = bumpMips.mips[i];
+        const RoundtripStats stats = RoundtripMip(mipsQuality[i], bc1Mode, closedLoopPasses, mip, heightMips.mips[i], scast<int>(i));
+        total.Add(stats);
+
+        const String size = ToString(mip.width) + _T("x") + ToString(mip.height);
+        Cout << _T("  ") << std::left << std::setw(4) << i
+             << std::right << std::setw(12) << size << std::fixed << std::setprecision(2)
+             << std::setw(12) << mpixPerSecond(stats.numPixels, stats.encodeMs)
+             << std::setw(12) << mpixPerSecond(stats.numPixels, stats.decodeMs)
+             << std::setw(17) << stats.normalErrorSum / scast<double>(stats.numPixels)
+             << std::setw(10) << stats.normalErrorMax
+             << std::setw(10) << PSNR(stats.glossSquaredError, stats.numPixels)
+             << std::setw(11) << PSNR(stats.heightSquaredError, stats.numPixels) << std::endl;
     }
 
-    Cout << _T("Using quality level ") << quality << std::endl;
+    Cout << _T("  all ") << std::setw(12) << _T("") << std::setw(12) << mpixPerSecond(total.numPixels, total.encodeMs)
+         << std::setw(12) << mpixPerSecond(total.numPixels, total.decodeMs)
+         << std::setw(17) << total.normalErrorSum / scast<double>(std::max<size_t>(1, total.numPixels))
+         << std::setw(10) << total.normalErrorMax
+         << std::setw(10) << PSNR(total.glossSquaredError, total.numPixels)
+         << std::setw(11) << PSNR(total.heightSquaredError, total.numPixels) << std::endl;
 
-#ifdef ENABLE_NVTT3
-    if (quality == 3) {
-        void* hDll = LoadLibraryW(_T("nvtt30106.dll"));
-        if (!hDll) {
-            quality = 2;
-        } else {
-            func_nvttCreateCPUInputBuffer = reinterpret_cast<decltype(func_nvttCreateCPUInputBuffer)>(GetProcAddress(hDll, "nvttCreateCPUInputBuffer"));
-            func_nvttDestroyCPUInputBuffer = reinterpret_cast<decltype(func_nvttDestroyCPUInputBuffer)>(GetProcAddress(hDll, "nvttDestroyCPUInputBuffer"));
-            func_nvttEncodeBC3CPU = reinterpret_cast<decltype(func_nvttEncodeBC3CPU)>(GetProcAddress(hDll, "nvttEncodeBC3CPU"));
+    Cout.flags(coutFlags);
+    Cout.precision(coutPrecision);
+}
 
-            if (!func_nvttCreateCPUInputBuffer || !func_nvttDestroyCPUInputBuffer || !func_nvttEncodeBC3CPU) {
-                quality = 2;
-            }
-        }
 
-        if (quality == 2) {
-            Cerr << _T("Failed to load nvtt3 dll!") << std::endl << _T("Changing quality level to 2.") << std::endl;
-        }
+// reads compressed mips of a DXT5 dds, fails if the file doesn't have exactly the expected layout
+static bool LoadDDSMips(const fs::path& path, const size_t w, const size_t h, const size_t numMips, std::vector<BytesArray>& compressedMips) {
+    std::ifstream file(path, std::ifstream::binary);
+    uint32_t signature = 0;
+    DDSURFACEDESC2 desc = {};
+    if (!file.read(rcast<char*>(&signature), sizeof(signature)) || signature != kDDSFileSignature ||
+        !file.read(rcast<char*>(&desc), sizeof(desc)) ||
+        desc.ddpfPixelFormat.dwFlags != 0x00000004 ||   // DDPF_FOURCC
+        desc.ddpfPixelFormat.dwFourCC != 0x35545844 ||  // DXT5
+        desc.dwWidth != w || desc.dwHeight != h || desc.dwMipMapCount != numMips) {
+        return false;
     }
-#endif
 
-    Cout << _T("This will use \"") << kCompressorsNames[quality] << _T("\" compressor") << std::endl;
-
-    fs::path pathNormalmap, pathGlossmap, pathHeightmap, pathOutput;
+    compressedMips.resize(numMips);
+    size_t mipW = w, mipH = h;
+    for (auto& cm : compressedMips) {
+        cm.resize(((mipW / 4) * (mipH / 4)) * 16);
+        if (!file.read(rcast<char*>(cm.data()), cm.size())) {
+            compressedMips.clear();
+            return false;
+        }
 
-    if (paramN.empty()) {
-        Cerr << _T("No normalmap provided, nothing to do for me...") << std::endl;
-        PrintUsage();
-        return -1;
+        mipW = std::max<size_t>(mipW / 2, kMinMipSize);
+        mipH = std::max<size_t>(mipH / 2, kMinMipSize);
     }
 
-    pathNormalmap = paramN;
-    fileStatus = fs::status(pathNormalmap, errorCode);
-    if (!fs::exists(fileStatus) || !fs::is_regular_file(fileStatus)) {
-        Cerr << _T("Provided normalmap path does not exist or not a valid file!") << std::endl;
-        return -1;
-    }
-
-    if (paramO.empty()) {
-        Cout << _T("No output option provided, using source name and folder") << std::endl;
-        pathOutput = pathNormalmap.parent_path() / pathNormalmap.stem();
-    } else {
-        pathOutput = paramO;
-        fileStatus = fs::status(pathOutput, errorCode);
-        if (fs::exists(fileStatus) && fs::is_directory(fileStatus)) {
-            Cout << _T("A directory was provided as an output, source name will be used") << std::endl;
-            pathOutput /= pathNormalmap.stem();
-        }
-    }
+    return true;
+}
 
-    if (!paramG.empty()) {
-        pathGlossmap = paramG;
-        fileStatus = fs::status(pathGlossmap, errorCode);
-        if (!fs::exists(fileStatus) || !fs::is_regular_file(fileStatus)) {
-            Cout << _T("Provided glossmap path does not exist or not a valid file.") << std::endl;
-            Cout << _T("This is not a showstopper, just gloss will be omitted from the result.") << std::endl;
-            pathGlossmap.clear();
+// the digest of bump and bump# dds files with these mips, for --incremental
+static PackedFilesDigest DigestPackedMips(const std::vector<BytesArray>& bumpMips, const std::vector<BytesArray>& bumpXMips) {
+    auto hashMips = [](const std::vector<BytesArray>& mips) {
+        uint64_t hash = HashBytes(nullptr, 0);
+        for (const auto& mip : mips) {
+            hash = HashBytes(mip.data(), mip.size(), hash);
         }
-    }
+        return hash;
+    };
+    return { DDSFileSize(bumpMips), hashMips(bumpMips), DDSFileSize(bumpXMips), hashMips(bumpXMips) };
+}
 
-    if (!paramH.empty()) {
-        pathHeightmap = paramH;
-        fileStatus = fs::status(pathHeightmap, errorCode);
-        if (!fs::exists(fileStatus) || !fs::is_regular_file(fileStatus)) {
-            Cout << _T("Provided heightmap path does not exist or not a valid file.") << std::endl;
-            Cout << _T("This is not a showstopper, default (neutral) height will be used.") << std::endl;
-            pathHeightmap.clear();
-        }
-    }
+// steps 1-2: makes the mipchains of the sources and assembles stalker bump in the normalmap mips, gloss and height
+// are checked against the normalmap (and omitted if they don't match) after its mipchain is built, so they may still be decoding
+void BuildBumpMips(const bool linearGloss, Bitmap<PixelRgba>& normalmap,
+                   std::future<Bitmap<PixelMono>>& glossmapFuture, std::future<Bitmap<PixelMono>>& heightmapFuture,
+                   Texture<PixelRgba>& normalmapWithMips, Texture<PixelMono>& heightmapWithMips) {
+    const size_t nwidth = normalmap.width;
+    const size_t nheight = normalmap.height;
 
-    Bitmap<PixelRgba> normalmap = LoadBitmap<PixelRgba>(pathNormalmap);
-    if (normalmap.empty()) {
-        Cerr << _T("Couldn't load normalmap, not an image or unsupported format?") << std::endl;
-        return -1;
-    } else if (!IsPowerOfTwo(normalmap.width) || !IsPowerOfTwo(normalmap.height)) {
-        Cerr << _T("Normalmap width & height must be power of two!") << std::endl;
-        return -1;
+    // step 1: make mipchains with our source images
+    Cout << _T("Computing mipmaps for the source normalmap...") << std::endl;
+    normalmapWithMips.mips[0] = normalmap; normalmap.clear();
+    {
+        StageTimer timer(_T("mips normalmap"));
+        BuildMipchain<PixelRgba, true>(normalmapWithMips);
+        timer.SetVolume(TexturePixels(normalmapWithMips), nwidth * nheight * sizeof(PixelRgba), TexturePixels(normalmapWithMips) * sizeof(PixelRgba));
     }
+    Cout << _T("Successfully created ") << normalmapWithMips.mips.size() << _T(" mips") << std::endl;
 
-    Bitmap<PixelMono> glossmap = pathGlossmap.empty() ? Bitmap<PixelMono>(0, 1) : LoadBitmap<PixelMono>(pathGlossmap);
-    Bitmap<PixelMono> heightmap = pathHeightmap.empty() ? Bitmap<PixelMono>(0, 1) : LoadBitmap<PixelMono>(pathHeightmap);
+    Bitmap<PixelMono> glossmap = glossmapFuture.get();
+    Bitmap<PixelMono> heightmap = heightmapFuture.get();
 
-    if (glossmap.empty() && !glossmap.height) {
+    // an empty bitmap of height 1 is an omitted map, height 0 is one that failed to load
+    if (glossmap.empty() && glossmap.height) {
+        glossmap.clear();
+    } else if (glossmap.empty()) {
         Cout << _T("Couldn't load glossmap, not an image or unsupported format?") << std::endl;
         Cout << _T("This is not a showstopper, just gloss will be omitted from the result.") << std::endl;
-    } else if (glossmap.width != normalmap.width || glossmap.height != normalmap.height) {
+    } else if (glossmap.width != nwidth || glossmap.height != nheight) {
         Cout << _T("Glossmap has different dimensions than normalmap!") << std::endl;
         Cout << _T("This is not a showstopper, just gloss will be omitted from the result.") << std::endl;
         glossmap.clear();
     }
 
-    if (heightmap.empty() && !heightmap.height) {
+    if (heightmap.empty() && heightmap.height) {
+        heightmap.clear();
+    } else if (heightmap.empty()) {
         Cout << _T("Couldn't load heightmap, not an image or unsupported format?") << std::endl;
         Cout << _T("This is not a showstopper, default (neutral) height will be used.") << std::endl;
-    } else if (heightmap.width != normalmap.width || heightmap.height != normalmap.height) {
+    } else if (heightmap.width != nwidth || heightmap.height != nheight) {
         Cout << _T("Heightmap has different dimensions than normalmap!") << std::endl;
         Cout << _T("This is not a showstopper, default (neutral) height will be used.") << std::endl;
         heightmap.clear();
     }
 
-    // make default heightmap
-    if (heightmap.empty()) {
-        heightmap = Bitmap<PixelMono>(normalmap.width, normalmap.height, { 128 });
-    }
-
-    //rgbcx::init(rgbcx::bc1_approx_mode::cBC1IdealRound4);
-    rgbcx::init(rgbcx::bc1_approx_mode::cBC1NVidia);
-
-    const size_t nwidth = normalmap.width;
-    const size_t nheight = normalmap.height;
-
-    // step 1: make mipchains with our source images
-    Cout << _T("Computing mipmaps for the source normalmap...") << std::endl;
-    Texture<PixelRgba> normalmapWithMips(nwidth, nheight);
-    normalmapWithMips.mips[0] = normalmap; normalmap.clear();
-    BuildMipchain<PixelRgba, true>(normalmapWithMips);
-    Cout << _T("Successfully created ") << normalmapWithMips.mips.size() << _T(" mips") << std::endl;
-
-    Texture<PixelMono> glossmapWithMips(nwidth, nheight);
+    // no glossmap - no glossmap mips, the bump gets zero gloss right away (see AssembleBump)
+    Texture<PixelMono> glossmapWithMips(glossmap.empty() ? 0 : nwidth, glossmap.empty() ? 0 : nheight);
     if (!glossmap.empty()) {
         Cout << _T("Computing mipmaps for the source glossmap...") << std::endl;
         glossmapWithMips.mips[0] = glossmap; glossmap.clear();
+        StageTimer timer(_T("mips glossmap"));
         BuildMipchain<PixelMono, false>(glossmapWithMips);
+        timer.SetVolume(TexturePixels(glossmapWithMips), nwidth * nheight, TexturePixels(glossmapWithMips));
         Cout << _T("Successfully created ") << glossmapWithMips.mips.size() << _T(" mips") << std::endl;
     }
 
-    Texture<PixelMono> heightmapWithMips(nwidth, nheight);
     if (!heightmap.empty()) {
         Cout << _T("Computing mipmaps for the source heightmap...") << std::endl;
         heightmapWithMips.mips[0] = heightmap; heightmap.clear();
+        StageTimer timer(_T("mips heightmap"));
         BuildMipchain<PixelMono, false>(heightmapWithMips);
+        timer.SetVolume(TexturePixels(heightmapWithMips), nwidth * nheight, TexturePixels(heightmapWithMips));
         Cout << _T("Successfully created ") << heightmapWithMips.mips.size() << _T(" mips") << std::endl;
+    } else {
+        // default (neutral) height, the mips of a flat image are just as flat, so there is nothing to resample
+        for (auto& mip : heightmapWithMips.mips) {
+            std::fill(mip.pixels.begin(), mip.pixels.end(), PixelMono{ 128 });
+        }
     }
 
     // step 2: assemble stalker normalmap
     Cout << _T("Assembling stalker bump (a - NX, b - NY, g - NZ, r - Gloss)...") << std::endl;
+    StageTimer timer(_T("assemble bump"));
+    timer.SetVolume(TexturePixels(normalmapWithMips), TexturePixels(normalmapWithMips) * (sizeof(PixelRgba) + sizeof(PixelMono)),
+                    TexturePixels(normalmapWithMips) * sizeof(PixelRgba));
+    const bool hasGloss = !glossmapWithMips.mips.empty();
     for (size_t i = 0, end = normalmapWithMips.mips.size(); i != end; ++i) {
         auto& normalMip = normalmapWithMips.mips[i];
-        auto& glossMip = glossmapWithMips.mips[i];
-        std::transform(normalMip.pixels.begin(),
-            normalMip.pixels.end(),
-            glossMip.pixels.begin(),
-            normalMip.pixels.begin(),
-            [linearGloss](const auto& np, const auto& gp)->PixelRgba {
-            return {
-                // stalker stores gloss logarithmically to gain some precision for lower values (linearized back in shader)
-                linearGloss ? gp.r : scast<uint8_t>(std::sqrt(scast<float>(gp.r) / 255.0f) * 255.0f),
-                // swizzle is weird, as NZ typically doesn't require much precision (you can even omit one)
-                // but meh, we must follow the original
-                np.b,
-                np.g,
-                np.r
-            };
-        });
+        gKernels->AssembleBump(rcast<const uint8_t*>(normalMip.pixels.data()),
+                               hasGloss ? rcast<const uint8_t*>(glossmapWithMips.mips[i].pixels.data()) : nullptr,
+                               rcast<uint8_t*>(normalMip.pixels.data()),
+                               normalMip.pixels.size(),
+                               linearGloss);
     }
     Cout << _T("Done") << std::endl;
+}
 
-    // step 3: compress the normalmap
-    std::vector<BytesArray> normalmapWithMipsCompressed(normalmapWithMips.mips.size());
-    for (size_t i = 0, end = normalmapWithMips.mips.size(); i != end; ++i) {
-        auto& normalMip = normalmapWithMips.mips[i];
-        auto& compressedMip = normalmapWithMipsCompressed[i];
+// --stream: packing jobs come on stdin and the results go to stdout in the same order until stdin ends,
+// everything is little endian:
+//  job:    "BXSJ", then normalmap, glossmap and heightmap, each is a StreamImageHeader followed by size bytes of data
+//  result: "BXSR", uint32 status (0 - ok, 1 - bad job), uint32 number of payloads (2 if ok), then every payload is
+//          uint32 tag ("BUMP" - bump, "BMPX" - bump#), uint64 size and size bytes of the dds file
+static const uint32_t kStreamJobSignature = 0x4A535842;     // "BXSJ"
+static const uint32_t kStreamResultSignature = 0x52535842;  // "BXSR"
+static const uint32_t kStreamTagBump = 0x504D5542;          // "BUMP"
+static const uint32_t kStreamTagBumpX = 0x58504D42;         // "BMPX"
+static const uint64_t kMaxStreamImageSize = 1ull << 30;
+static const uint32_t kMaxStreamImageDimension = 16384;     // of a raw image
+
+enum class StreamImageKind : uint32_t {
+    None    = 0,    // no glossmap/heightmap, same as the omitted -g/-h
+    Raw     = 1,    // width * height * channels bytes of 8 bit pixels, 1, 3 or 4 channels, at most 16384 x 16384
+    File    = 2     // any image file format we can load, width, height and channels are ignored
+};
+
+struct StreamImageHeader {
+    StreamImageKind kind;
+    uint32_t        width;
+    uint32_t        height;
+    uint32_t        channels;
+    uint64_t        size;
+};
 
-        Cout << _T("Compressing bump mip ") << i << _T("...") << std::endl;
+// stdout for the results of --stream, Cout goes to stderr in this mode (see Main)
+static std::streambuf* gStreamOutput = nullptr;
 
-        const size_t compressedMipSize = ((normalMip.width / 4) * (normalMip.height / 4)) * 16;
-        compressedMip.resize(compressedMipSize);
+// false if the stream is broken or has ended
+static bool ReadStreamImage(std::istream& in, StreamImageHeader& header, BytesArray& data) {
+    if (!in.read(rcast<char*>(&header), sizeof(header)) || header.size > kMaxStreamImageSize) {
+        return false;
+    }
 
-        CompressBC3(quality, normalMip, compressedMip.data());
+    data.resize(scast<size_t>(header.size));
+    return header.size == 0 || in.read(rcast<char*>(data.data()), data.size());
+}
 
-        const size_t originalMipSize = normalMip.width * normalMip.height * BytesPerPixel<PixelRgba>();
-        Cout << _T("Done, compressed ") << originalMipSize << _T(" bytes to ") << compressedMipSize << _T(" bytes") << std::endl;
+template <typename T>
+static Bitmap<T> StreamImageToBitmap(const StreamImageHeader& header, const BytesArray& data) {
+    if (header.kind == StreamImageKind::Raw) {
+        // the header is untrusted, so it must describe exactly the data that came before anything is allocated for it
+        const uint64_t rawSize = uint64_t(header.width) * header.height * header.channels;
+        if (header.width && header.height && header.width <= kMaxStreamImageDimension && header.height <= kMaxStreamImageDimension &&
+            (header.channels == 1 || header.channels == 3 || header.channels == 4) && rawSize == header.size && rawSize == data.size()) {
+            Bitmap<T> result(header.width, header.height);
+            if (ConvertPixels(data.data(), header.channels, result)) {
+                return result;
+            }
+        }
+    } else if (header.kind == StreamImageKind::File) {
+        return DecodeBitmap<T>(data.data(), data.size());
     }
+    return Bitmap<T>(0, header.kind == StreamImageKind::None ? 1 : 0);
+}
 
-    // step 4: decompress the normalmap and calculate the error, assemble bump# with the error and the height
-    //         the format is: RGB - error * 2, A - height
-    Texture<PixelRgba> bumpXWithMips(nwidth, nheight);
-    for (size_t i = 0, end = normalmapWithMips.mips.size(); i != end; ++i) {
-        auto& normalMip = normalmapWithMips.mips[i];
-        auto& compressedMip = normalmapWithMipsCompressed[i];
-        auto& heightMip = heightmapWithMips.mips[i];
-        auto& bumpXMip = bumpXWithMips.mips[i];
-
-        Cout << _T("Calculating error for mip ") << i << _T("...") << std::endl;
-        DecompressBC3_MY(compressedMip.data(), bumpXMip);
-
-        // calculate the difference and un-swizzle back to RGB
-        std::transform(normalMip.pixels.begin(),
-            normalMip.pixels.end(),
-            bumpXMip.pixels.begin(),
-            bumpXMip.pixels.begin(),
-            [](const auto& np, const auto& dp)->PixelRgba {
-            return {
-                scast<uint8_t>(Clamp((scast<int>(np.a) - scast<int>(dp.a)) * 2 + 128, 0, 255)),
-                scast<uint8_t>(Clamp((scast<int>(np.b) - scast<int>(dp.b)) * 2 + 128, 0, 255)),
-                scast<uint8_t>(Clamp((scast<int>(np.g) - scast<int>(dp.g)) * 2 + 128, 0, 255)),
-                0
-            };
-        });
+static int PackBumpStream(const bool linearGloss, const QualitySettings& qualitySettings, const BC1ApproxMode bc1Mode, const int closedLoopPasses) {
+    std::istream& in = std::cin;
+    std::ostream out(gStreamOutput);
+
+    auto write32 = [&out](const uint32_t v) { out.write(rcast<const char*>(&v), sizeof(v)); };
+    auto write64 = [&out](const uint64_t v) { out.write(rcast<const char*>(&v), sizeof(v)); };
+    auto writeFailed = [&]() {
+        write32(kStreamResultSignature);
+        write32(1);
+        write32(0);
+        out.flush();
+    };
 
-        // move height to alpha
-        std::transform(bumpXMip.pixels.begin(),
-            bumpXMip.pixels.end(),
-            heightMip.pixels.begin(),
-            bumpXMip.pixels.begin(),
-            [](const auto& xp, const auto& hp)->PixelRgba {
-            return { xp.r, xp.g, xp.b, hp.r };
-        });
+    size_t numJobs = 0;
+    uint32_t signature = 0;
+    while (in.read(rcast<char*>(&signature), sizeof(signature))) {
+        StreamImageHeader headers[3];
+        BytesArray data[3];
+        if (signature != kStreamJobSignature ||
+            !ReadStreamImage(in, headers[0], data[0]) || !ReadStreamImage(in, headers[1], data[1]) || !ReadStreamImage(in, headers[2], data[2])) {
+            Cerr << _T("Broken stream after ") << numJobs << _T(" jobs") << std::endl;
+            return -1;
+        }
+        ++numJobs;
+
+        // a job that throws (out of memory on a huge image and such) fails alone, the stream goes on
+        std::vector<BytesArray> bumpMipsCompressed, bumpXMipsCompressed;
+        size_t nwidth = 0, nheight = 0;
+        try {
+            // as with the files, gloss and height are decoded while the normalmap mipchain is built
+            std::future<Bitmap<PixelMono>> glossmapFuture = std::async(std::launch::async, StreamImageToBitmap<PixelMono>, std::cref(headers[1]), std::cref(data[1]));
+            std::future<Bitmap<PixelMono>> heightmapFuture = std::async(std::launch::async, StreamImageToBitmap<PixelMono>, std::cref(headers[2]), std::cref(data[2]));
+
+            Bitmap<PixelRgba> normalmap = StreamImageToBitmap<PixelRgba>(headers[0], data[0]);
+            BytesArray().swap(data[0]);
+            if (normalmap.empty() || !IsPowerOfTwo(normalmap.width) || !IsPowerOfTwo(normalmap.height)) {
+                Cerr << _T("Job ") << numJobs << _T(": bad normalmap, must be a power of two image") << std::endl;
+                writeFailed();
+                continue;
+            }
+
+            nwidth = normalmap.width;
+            nheight = normalmap.height;
+
+            Texture<PixelRgba> normalmapWithMips(nwidth, nheight);
+            Texture<PixelMono> heightmapWithMips(nwidth, nheight);
+            BuildBumpMips(linearGloss, normalmap, glossmapFuture, heightmapFuture, normalmapWithMips, heightmapWithMips);
+
+            const size_t numMips = normalmapWithMips.mips.size();
+            bumpMipsCompressed.resize(numMips);
+            bumpXMipsCompressed.resize(numMips);
+            for (size_t i = 0; i != numMips; ++i) {
+                const auto& normalMip = normalmapWithMips.mips[i];
+                const size_t compressedMipSize = ((normalMip.width / 4) * (normalMip.height / 4)) * 16;
+                const int quality = qualitySettings.ForMip(i, normalMip.width, normalMip.height);
+
+                Cverbose << _T("Compressing bump and bump# mip ") << i << _T("...") << std::endl;
+                double bumpTime = 0.0, bumpXTime = 0.0;
+                bumpMipsCompressed[i].resize(compressedMipSize);
+                bumpXMipsCompressed[i].resize(compressedMipSize);
+                CompressBumpPair(quality, bc1Mode, scast<size_t>(closedLoopPasses), normalMip, heightmapWithMips.mips[i],
+                                 bumpMipsCompressed[i].data(), bumpXMipsCompressed[i].data(), bumpTime, bumpXTime, scast<int>(i));
+            }
+        } catch (const std::exception& e) {
+            Cerr << _T("Job ") << numJobs << _T(" failed: ") << e.what() << std::endl;
+            writeFailed();
+            continue;
+        }
 
-        Cout << _T("Done") << std::endl;
+        write32(kStreamResultSignature);
+        write32(0);
+        write32(2);
+        write32(kStreamTagBump);
+        write64(DDSFileSize(bumpMipsCompressed));
+        WriteDDS(bumpMipsCompressed, nwidth, nheight, out);
+        write32(kStreamTagBumpX);
+        write64(DDSFileSize(bumpXMipsCompressed));
+        WriteDDS(bumpXMipsCompressed, nwidth, nheight, out);
+        out.flush();
+
+        if (!out.good()) {
+            Cerr << _T("Failed to write the results of job ") << numJobs << std::endl;
+            return -1;
+        }
     }
 
-    // step 5: compress bump#
-    std::vector<BytesArray> bumpXMipsCompressed(bumpXWithMips.mips.size());
-    for (size_t i = 0, end = bumpXWithMips.mips.size(); i != end; ++i) {
-        auto& bumpXMip = bumpXWithMips.mips[i];
-        auto& compressedMip = bumpXMipsCompressed[i];
+    Cout << _T("Stream ended, ") << numJobs << _T(" jobs done") << std::endl;
+    return 0;
+}
+
+static int PackBump(int argc, Char** argv) {
+    std::error_code errorCode;
+    fs::file_status fileStatus;
+
+    String paramN, paramG, paramH, paramO, paramL, paramQ, paramA, paramJ;
+
+    std::vector<std::pair<Char, String*>> paramsMap = {
+        { _T('n'), &paramN },
+        { _T('g'), &paramG },
+        { _T('h'), &paramH },
+        { _T('o'), &paramO },
+        { _T('l'), &paramL },
+        { _T('q'), &paramQ },
+        { _T('a'), &paramA },
+        { _T('j'), &paramJ }
+    };
 
-        Cout << _T("Compressing bump# mip ") << i << _T("...") << std::endl;
+    bool incremental = false, roundtrip = false, stream = false;
 
-        const size_t compressedMipSize = ((bumpXMip.width / 4) * (bumpXMip.height / 4)) * 16;
-        compressedMip.resize(compressedMipSize);
+    Char** it = argv, **end = argv + argc;
+    for (; it != end; ++it) {
+        String s = *it;
 
-        CompressBC3(quality, bumpXMip, compressedMip.data());
+        bool knownParam = false;
+        if (s == _T("--incremental")) {
+            incremental = true;
+        } else if (s == _T("--roundtrip")) {
+            roundtrip = true;
+        } else if (s == _T("--stream")) {
+            stream = true;
+        } else if (s.length() > 3 && s[2] == ':') {
+            if (s[0] == _T('-')) {
+                const Char c = s[1];
+                auto paramsIt = std::find_if(paramsMap.begin(), paramsMap.end(), [c](auto& v)->bool {
+                    return c == v.first;
+                });
 
-        const size_t originalMipSize = bumpXMip.width * bumpXMip.height * BytesPerPixel<PixelRgba>();
-        Cout << _T("Done, compressed ") << originalMipSize << _T(" bytes to ") << compressedMipSize << _T(" bytes") << std::endl;
+                if (paramsIt != paramsMap.end()) {
+                    knownParam = true;
+                    *paramsIt->second = s.substr(3);
+                    paramsMap.erase(paramsIt);
+                } else {
+                    const size_t paramIdx = std::distance(it, end);
+                    Cerr << _T("Unknown param #") << paramIdx << _T(" \"") << s << _T("\"") << std::endl;
+                }
+            }
+        }
     }
 
-    // step 6: save everything
-    fs::path bumpOutputPath = pathOutput; bumpOutputPath += _T("_bump.dds");
-    fs::path bumpXOutputPath = pathOutput; bumpXOutputPath += _T("_bump#.dds");
+    const bool linearGloss = !paramL.empty() && paramL.front() == _T('g');
 
-    if (!SaveAsDDS(normalmapWithMipsCompressed, nwidth, nheight, bumpOutputPath)) {
-        Cerr << _T("Failed to write bump texture to ") << bumpOutputPath << std::endl;
+    QualitySettings qualitySettings;
+    if (!paramQ.empty() && !ParseQualityParam(paramQ, qualitySettings)) {
+        Cerr << _T("Invalid quality \"") << paramQ << _T("\", must be 0 to ") << (kNumCompressors - 1)
+             << _T(" or auto, optionally followed by mip=quality overrides") << std::endl;
         return -1;
-    } else {
-        Cout << _T("Successfully saved ") << bumpOutputPath << std::endl;
     }
 
-    if (!SaveAsDDS(bumpXMipsCompressed, nwidth, nheight, bumpXOutputPath)) {
-        Cerr << _T("Failed to write bump# texture to ") << bumpXOutputPath << std::endl;
-        return -1;
+    if (qualitySettings.autoPolicy) {
+        Cout << _T("Using automatic quality level") << std::endl;
     } else {
-        Cout << _T("Successfully saved ") << bumpXOutputPath << std::endl;
+        Cout << _T("Using quality level ") << qualitySettings.quality << std::endl;
     }
 
-    return 0;
-}
+    // --roundtrip without -q compares all the compressors
+    const bool roundtripAll = roundtrip && paramQ.empty();
+    size_t numRoundtripCompressors = kNumCompressors;
 
-int UnpackBump(int argc, Char** argv) {
-    auto loadAndDecompressDDS = [](const fs::path& ddsPath)->Bitmap<PixelRgba> {
-        std::ifstream file(ddsPath, std::ifstream::in | std::ifstream::binary);
-        if (file.is_open()) {
-            uint32_t signature = 0;
-            file.read(rcast<char*>(&signature), sizeof(signature));
-            if (kDDSFileSignature == signature) {
-                DDSURFACEDESC2 desc = {};
-                file.read(rcast<char*>(&desc), sizeof(desc));
-                if (desc.ddpfPixelFormat.dwFlags == 0x00000004 &&   // DDPF_FOURCC
-                    desc.ddpfPixelFormat.dwFourCC == 0x35545844) {  // DXT5
-                    const size_t compressedSize = ((desc.dwWidth / 4) * (desc.dwHeight / 4)) * 16;
-                    std::vector<uint8_t> compressedImage(compressedSize);
-                    file.read(rcast<char*>(compressedImage.data()), compressedImage.size());
-                    file.close();
-
-                    Bitmap<PixelRgba> bmp(desc.dwWidth, desc.dwHeight);
-                    DecompressBC3_MY(compressedImage.data(), bmp);
-                    return bmp;
-                } else {
-                    return Bitmap<PixelRgba>(0, 0);
-                }
-            } else {
-                return Bitmap<PixelRgba>(0, 0);
+#ifdef ENABLE_NVTT3
+    if (qualitySettings.Uses(3) || roundtripAll) {
+        bool nvttLoaded = false;
+        void* hDll = LoadLibraryW(_T("nvtt30106.dll"));
+        if (hDll) {
+            func_nvttCreateCPUInputBuffer = reinterpret_cast<decltype(func_nvttCreateCPUInputBuffer)>(GetProcAddress(hDll, "nvttCreateCPUInputBuffer"));
+            func_nvttDestroyCPUInputBuffer = reinterpret_cast<decltype(func_nvttDestroyCPUInputBuffer)>(GetProcAddress(hDll, "nvttDestroyCPUInputBuffer"));
+            func_nvttEncodeBC3CPU = reinterpret_cast<decltype(func_nvttEncodeBC3CPU)>(GetProcAddress(hDll, "nvttEncodeBC3CPU"));
+
+            nvttLoaded = func_nvttCreateCPUInputBuffer && func_nvttDestroyCPUInputBuffer && func_nvttEncodeBC3CPU;
+        }
+
+        if (!nvttLoaded) {
+            Cerr << _T("Failed to load nvtt3 dll!") << std::endl;
+            if (qualitySettings.Uses(3)) {
+                Cerr << _T("Changing quality level to 2.") << std::endl;
+                qualitySettings.Replace(3, 2);
             }
-        } else {
-            return Bitmap<PixelRgba>(0, 0);
+            numRoundtripCompressors = 3;
         }
-    };
+    }
+#endif
 
-    fs::path bumpPath = argv[1];
+    if (!qualitySettings.autoPolicy && qualitySettings.overrides.empty()) {
+        Cout << _T("This will use \"") << kCompressorsNames[qualitySettings.quality] << _T("\" compressor") << std::endl;
+    }
+
+    BC1ApproxMode bc1Mode = BC1ApproxMode::NVidia;
+    if (!paramA.empty()) {
+        auto modeIt = std::find(std::begin(kBC1ApproxModesNames), std::end(kBC1ApproxModesNames), paramA);
+        if (modeIt == std::end(kBC1ApproxModesNames)) {
+            Cerr << _T("Unknown BC1 approximation mode \"") << paramA << _T("\", must be one of");
+            for (const String& name : kBC1ApproxModesNames) {
+                Cerr << _T(" ") << name;
+            }
+            Cerr << std::endl;
+            return -1;
+        }
+        bc1Mode = scast<BC1ApproxMode>(std::distance(std::begin(kBC1ApproxModesNames), modeIt));
+    }
+
+    int closedLoopPasses = 0;
+    if (!paramJ.empty()) {
+        if (!StrToInt(paramJ, closedLoopPasses) || closedLoopPasses < 0 || closedLoopPasses > kMaxClosedLoopPasses) {
+            Cerr << _T("Invalid closed loop passes \"") << paramJ << _T("\", must be 0 (off) to ") << kMaxClosedLoopPasses << std::endl;
+            return -1;
+        }
+        if (closedLoopPasses > 0) {
+            Cout << _T("Using closed loop bump/bump# compression, ") << closedLoopPasses << _T(" passes") << std::endl;
+        }
+    }
+
+    if (stream) {
+        return PackBumpStream(linearGloss, qualitySettings, bc1Mode, closedLoopPasses);
+    }
+
+    fs::path pathNormalmap, pathGlossmap, pathHeightmap, pathOutput;
 
-    Bitmap<PixelRgba> bump = loadAndDecompressDDS(bumpPath);
-    if (bump.empty()) {
-        Cout << _T("Failed to load ") << argv[1] << std::endl;
+    if (paramN.empty()) {
+        Cerr << _T("No normalmap provided, nothing to do for me...") << std::endl;
+        PrintUsage();
         return -1;
     }
 
-    fs::path bumpXPath = (bumpPath.parent_path() / bumpPath.stem()).native() + _T("#.dds");
-    Bitmap<PixelRgba> bumpX = loadAndDecompressDDS(bumpXPath);
-    if (bumpX.empty()) {
-        Cout << _T("Failed to load ") << bumpXPath << std::endl;
+    pathNormalmap = paramN;
+    fileStatus = fs::status(pathNormalmap, errorCode);
+    if (!fs::exists(fileStatus) || !fs::is_regular_file(fileStatus)) {
+        Cerr << _T("Provided normalmap path does not exist or not a valid file!") << std::endl;
         return -1;
     }
 
-    if (bump.width != bumpX.width || bump.height != bumpX.height) {
-        Cout << _T("The two dds files are not of the same size! Aborting...") << std::endl;
+    if (paramO.empty()) {
+        Cout << _T("No output option provided, using source name and folder") << std::endl;
+        pathOutput = pathNormalmap.parent_path() / pathNormalmap.stem();
+    } else {
+        pathOutput = paramO;
+        fileStatus = fs::status(pathOutput, errorCode);
+        if (fs::exists(fileStatus) && fs::is_directory(fileStatus)) {
+            Cout << _T("A directory was provided as an output, source name will be used") << std::endl;
+            pathOutput /= pathNormalmap.stem();
+        }
+    }
+
+    if (!paramG.empty()) {
+        pathGlossmap = paramG;
+        fileStatus = fs::status(pathGlossmap, errorCode);
+        if (!fs::exists(fileStatus) || !fs::is_regular_file(fileStatus)) {
+            Cout << _T("Provided glossmap path does not exist or not a valid file.") << std::endl;
+            Cout << _T("This is not a showstopper, just gloss will be omitted from the result.") << std::endl;
+            pathGlossmap.clear();
+        }
+    }
+
+    if (!paramH.empty()) {
+        pathHeightmap = paramH;
+        fileStatus = fs::status(pathHeightmap, errorCode);
+        if (!fs::exists(fileStatus) || !fs::is_regular_file(fileStatus)) {
+            Cout << _T("Provided heightmap path does not exist or not a valid file.") << std::endl;
+            Cout << _T("This is not a showstopper, default (neutral) height will be used.") << std::endl;
+            pathHeightmap.clear();
+        }
+    }
+
+    // gloss and height are decoded in the background while the normalmap is decoded and its mipchain is built
+    auto loadMono = [](const Char* stage, const fs::path& path) {
+        if (path.empty()) {
+            return Bitmap<PixelMono>(0, 1);
+        }
+        StageTimer timer(stage);
+        Bitmap<PixelMono> result = LoadBitmap<PixelMono>(path);
+        timer.SetVolume(result.pixels.size(), FileSizeOrZero(path), result.pixels.size());
+        return result;
+    };
+    std::future<Bitmap<PixelMono>> glossmapFuture = std::async(std::launch::async, loadMono, _T("load glossmap"), pathGlossmap);
+    std::future<Bitmap<PixelMono>> heightmapFuture = std::async(std::launch::async, loadMono, _T("load heightmap"), pathHeightmap);
+
+    Bitmap<PixelRgba> normalmap(0, 0);
+    {
+        StageTimer timer(_T("load normalmap"));
+        normalmap = LoadBitmap<PixelRgba>(pathNormalmap);
+        timer.SetVolume(normalmap.pixels.size(), FileSizeOrZero(pathNormalmap), normalmap.pixels.size() * sizeof(PixelRgba));
+    }
+    if (normalmap.empty()) {
+        Cerr << _T("Couldn't load normalmap, not an image or unsupported format?") << std::endl;
+        return -1;
+    } else if (!IsPowerOfTwo(normalmap.width) || !IsPowerOfTwo(normalmap.height)) {
+        Cerr << _T("Normalmap width & height must be power of two!") << std::endl;
         return -1;
     }
 
-    fs::path bumpName = bumpPath.stem();
+    const size_t nwidth = normalmap.width;
+    const size_t nheight = normalmap.height;
+
+    Texture<PixelRgba> normalmapWithMips(nwidth, nheight);
+    Texture<PixelMono> heightmapWithMips(nwidth, nheight);
+    BuildBumpMips(linearGloss, normalmap, glossmapFuture, heightmapFuture, normalmapWithMips, heightmapWithMips);
 
-    fs::path outputFolder = (argc == 3) ? argv[2] : bumpPath.parent_path();
-
-    Cout << _T("Saving out heightmap:") << std::endl;
-    fs::path heightmapPath = outputFolder / (bumpName.native() + _T("_height.tga"));
-    Cout << heightmapPath << std::endl;
-    std::vector<uint8_t> heightmapData(bumpX.width * bumpX.height);
-    for (size_t i = 0; i < bumpX.width * bumpX.height; ++i) {
-        heightmapData[i] = bumpX.pixels[i].a;
-    }
-    int stbResult = stbi_write_tga(heightmapPath.u8string().c_str(), scast<int>(bumpX.width), scast<int>(bumpX.height), 1, heightmapData.data());
-    if (!stbResult) {
-        Cout << _T("Failed :(") << std::endl;
-    }
-    heightmapData.clear();
-
-    Cout << _T("Saving out glossmap:") << std::endl;
-    fs::path glossmapPath = outputFolder / (bumpName.native() + _T("_gloss.tga"));
-    Cout << glossmapPath << std::endl;
-    std::vector<uint8_t> glossmapData(bump.width * bump.height);
-    for (size_t i = 0; i < bump.width * bump.height; ++i) {
-        glossmapData[i] = bump.pixels[i].r;
-    }
-    stbResult = stbi_write_tga(glossmapPath.u8string().c_str(), scast<int>(bump.width), scast<int>(bump.height), 1, glossmapData.data());
-    if (!stbResult) {
-        Cout << _T("Failed :(") << std::endl;
-    }
-    glossmapData.clear();
-
-    Cout << _T("Saving out normalmap:") << std::endl;
-    fs::path normalmapPath = outputFolder / (bumpName.native() + _T("_normal.tga"));
-    Cout << normalmapPath << std::endl;
-    std::vector<PixelRgb> normalmapData(bump.width * bump.height);
-    for (size_t i = 0; i < bump.width * bump.height; ++i) {
-        const float nX = scast<float>(bump.pixels[i].a) / 255.0f;
-        const float nY = scast<float>(bump.pixels[i].b) / 255.0f;
-        const float nZ = scast<float>(bump.pixels[i].g) / 255.0f;
-
-        const float eX = scast<float>(bumpX.pixels[i].r) / 255.0f;
-        const float eY = scast<float>(bumpX.pixels[i].g) / 255.0f;
-        const float eZ = scast<float>(bumpX.pixels[i].b) / 255.0f;
-
-        float NX = nX + (eX - 1.0f);
-        float NY = nY + (eY - 1.0f);
-        float NZ = nZ + (eZ - 1.0f);
-
-        const float il = 1.0f / std::sqrt(NX * NX + NY * NY + NZ * NZ);
-        NX *= il;
-        NY *= il;
-        NZ *= il;
-        PixelRgb& result = normalmapData[i];
-        result.r = scast<uint8_t>(Clamp((NX * 0.5f + 0.5f) * 255.0f, 0.0f, 255.0f));
-        result.g = scast<uint8_t>(Clamp((NY * 0.5f + 0.5f) * 255.0f, 0.0f, 255.0f));
-        result.b = scast<uint8_t>(Clamp((NZ * 0.5f + 0.5f) * 255.0f, 0.0f, 255.0f));
-    }
-    stbResult = stbi_write_tga(normalmapPath.u8string().c_str(), scast<int>(bump.width), scast<int>(bump.height), 3, normalmapData.data());
-    if (!stbResult) {
-        Cout << _T("Failed :(") << std::endl;
+    std::vector<int> mipsQuality(normalmapWithMips.mips.size());
+    for (size_t i = 0, end = mipsQuality.size(); i != end; ++i) {
+        mipsQuality[i] = qualitySettings.ForMip(i, normalmapWithMips.mips[i].width, normalmapWithMips.mips[i].height);
     }
 
-    return 0;
-}
+    if (roundtrip) {
+        if (roundtripAll) {
+            for (size_t q = 0; q < numRoundtripCompressors; ++q) {
+                const std::vector<int> sameQuality(mipsQuality.size(), scast<int>(q));
+                RoundtripReport(kCompressorsNames[q], sameQuality, bc1Mode, scast<size_t>(closedLoopPasses), normalmapWithMips, heightmapWithMips);
+            }
+        } else {
+            RoundtripReport(_T("the selected quality"), mipsQuality, bc1Mode, scast<size_t>(closedLoopPasses), normalmapWithMips, heightmapWithMips);
+        }
+        return 0;
+    }
 
+    std::vector<double> bumpMipsTime(mipsQuality.size()), bumpXMipsTime(mipsQuality.size());   // in milliseconds
 
-int Main(int argc, Char** argv) {
-    int returnCode = 0;
+    fs::path bumpOutputPath = pathOutput; bumpOutputPath += _T("_bump.dds");
+    fs::path bumpXOutputPath = pathOutput; bumpXOutputPath += _T("_bump#.dds");
+    fs::path hashesOutputPath = pathOutput; hashesOutputPath += _T("_bump.hashes");
 
-    if (argc <= 1 || (argc > 1 && String(_T("-help")) == argv[1])) {
-        PrintUsage();
-    } else {
-        // detect the mode
-        bool isPackingMode = true;
-        if (argc == 2 || argc == 3) {
-            if (StrEndsWith(argv[1], _T(".dds"))) {
-                isPackingMode = false;
+    const size_t numMips = normalmapWithMips.mips.size();
+
+    std::vector<BytesArray> normalmapWithMipsCompressed(numMips);
+    std::vector<BytesArray> bumpXMipsCompressed(numMips);
+
+    // incremental mode: previous results are reused only if everything (both dds and the hashes) matches the layout
+    std::vector<BlockHashes> mipsHashes, prevMipsHashes;
+    if (incremental) {
+        for (size_t i = 0; i != numMips; ++i) {
+            const int settings[3] = { mipsQuality[i], scast<int>(bc1Mode), closedLoopPasses };
+            mipsHashes.push_back(HashMipBlocks(normalmapWithMips.mips[i], heightmapWithMips.mips[i], HashBytes(settings, sizeof(settings))));
+        }
+
+        // the dds files must be the very ones the hashes were saved with, not packed since by a run without --incremental
+        // or by something else, their size on disk counts too as LoadDDSMips ignores whatever follows the mips
+        std::error_code sizeError;
+        if (!LoadDDSMips(bumpOutputPath, nwidth, nheight, numMips, normalmapWithMipsCompressed) ||
+            !LoadDDSMips(bumpXOutputPath, nwidth, nheight, numMips, bumpXMipsCompressed) ||
+            fs::file_size(bumpOutputPath, sizeError) != DDSFileSize(normalmapWithMipsCompressed) ||
+            fs::file_size(bumpXOutputPath, sizeError) != DDSFileSize(bumpXMipsCompressed) ||
+            !LoadBlockHashes(hashesOutputPath, mipsHashes, nwidth, nheight,
+                             DigestPackedMips(normalmapWithMipsCompressed, bumpXMipsCompressed), prevMipsHashes)) {
+            Cout << _T("No matching results of a previous incremental run, compressing everything") << std::endl;
+            prevMipsHashes.clear();
+        }
+    }
+
+    // steps 3-5: compress bump, calculate the error and assemble bump# with it and the height, compress bump#
+    for (size_t i = 0; i != numMips; ++i) {
+        auto& normalMip = normalmapWithMips.mips[i];
+        auto& heightMip = heightmapWithMips.mips[i];
+        const size_t compressedMipSize = ((normalMip.width / 4) * (normalMip.height / 4)) * 16;
+
+        std::vector<size_t> changedBlocks;
+        if (!prevMipsHashes.empty()) {
+            for (size_t j = 0, numBlocks = mipsHashes[i].size(); j != numBlocks; ++j) {
+                if (mipsHashes[i][j] != prevMipsHashes[i][j]) {
+                    changedBlocks.push_back(j);
+                }
             }
         }
 
-        Cout << _T("Selected mode - ") << (isPackingMode ? _T("1, packing.") : _T("2, unpacking.")) << std::endl;
+        if (prevMipsHashes.empty() || changedBlocks.size() == mipsHashes[i].size()) {
+            Cverbose << _T("Compressing bump and bump# mip ") << i << _T("...") << std::endl;
+
+            normalmapWithMipsCompressed[i].resize(compressedMipSize);
+            bumpXMipsCompressed[i].resize(compressedMipSize);
+            CompressBumpPair(mipsQuality[i], bc1Mode, scast<size_t>(closedLoopPasses), normalMip, heightMip,
+                             normalmapWithMipsCompressed[i].data(), bumpXMipsCompressed[i].data(),
+                             bumpMipsTime[i], bumpXMipsTime[i], scast<int>(i));
+
+            const size_t originalMipSize = normalMip.width * normalMip.height * BytesPerPixel<PixelRgba>();
+            Cverbose << _T("Done, compressed ") << originalMipSize << _T(" bytes to ") << compressedMipSize << _T(" bytes") << std::endl;
+        } else {
+            Cverbose << _T("Mip ") << i << _T(": ") << changedBlocks.size() << _T(" of ") << mipsHashes[i].size() << _T(" blocks changed") << std::endl;
+            if (!changedBlocks.empty()) {
+                const Bitmap<PixelRgba> bumpStrip = GatherBlocks(normalMip, changedBlocks);
+                const Bitmap<PixelMono> heightStrip = GatherBlocks(heightMip, changedBlocks);
+                BytesArray bumpStripCompressed(changedBlocks.size() * 16), bumpXStripCompressed(changedBlocks.size() * 16);
+
+                CompressBumpPair(mipsQuality[i], bc1Mode, scast<size_t>(closedLoopPasses), bumpStrip, heightStrip,
+                                 bumpStripCompressed.data(), bumpXStripCompressed.data(),
+                                 bumpMipsTime[i], bumpXMipsTime[i], scast<int>(i));
+
+                ScatterCompressedBlocks(bumpStripCompressed.data(), changedBlocks, normalmapWithMipsCompressed[i].data());
+                ScatterCompressedBlocks(bumpXStripCompressed.data(), changedBlocks, bumpXMipsCompressed[i].data());
+            }
+        }
+    }
 
-        returnCode = isPackingMode ? PackBump(argc, argv) : UnpackBump(argc, argv);
+    const auto coutFlags = Cout.flags();
+    const auto coutPrecision = Cout.precision();
+    Cout << _T("Compression time per mip:") << std::endl;
+    Cout << _T("  mip         size  compressor                   bump ms    bump# ms") << std::endl;
+    double totalTime = 0.0;
+    for (size_t i = 0, end = mipsQuality.size(); i != end; ++i) {
+        const auto& mip = normalmapWithMips.mips[i];
+        const String size = ToString(mip.width) + _T("x") + ToString(mip.height);
+        Cout << _T("  ") << std::left << std::setw(4) << i
+             << std::right << std::setw(12) << size << _T("  ")
+             << std::left << std::setw(24) << kCompressorsNames[mipsQuality[i]]
+             << std::right << std::fixed << std::setprecision(2)
+             << std::setw(12) << bumpMipsTime[i] << std::setw(12) << bumpXMipsTime[i] << std::endl;
+        totalTime += bumpMipsTime[i] + bumpXMipsTime[i];
     }
+    Cout << _T("  total ") << totalTime << _T(" ms") << std::endl;
+    Cout.flags(coutFlags);
+    Cout.precision(coutPrecision);
 
-    return returnCode;
+    // step 6: save everything
+
+    // the hashes of a previous incremental run don't describe what is about to be written
+    if (!incremental) {
+        std::error_code removeError;
+        fs::remove(hashesOutputPath, removeError);
+    }
+
+    auto saveDDS = [nwidth, nheight](const Char* stage, const std::vector<BytesArray>& compressedMips, const fs::path& path) {
+        StageTimer timer(stage);
+        timer.SetVolume(0, DDSFileSize(compressedMips), DDSFileSize(compressedMips));
+        return SaveAsDDS(compressedMips, nwidth, nheight, path);
+    };
+
+    if (!saveDDS(_T("write bump dds"), normalmapWithMipsCompressed, bumpOutputPath)) {
+        Cerr << _T("Failed to write bump texture to ") << bumpOutputPath << std::endl;
+        return -1;
+    } else {
+        Cout << _T("Successfully saved ") << bumpOutputPath << std::endl;
+    }
+
+    if (!saveDDS(_T("write bump# dds"), bumpXMipsCompressed, bumpXOutputPath)) {
+        Cerr << _T("Failed to write bump# texture to ") << bumpXOutputPath << std::endl;
+        return -1;
+    } else {
+        Cout << _T("Successfully saved ") << bumpXOutputPath << std::endl;
+    }
+
+    if (incremental) {
+        if (!SaveBlockHashes(mipsHashes, nwidth, nheight, DigestPackedMips(normalmapWithMipsCompressed, bumpXMipsCompressed), hashesOutputPath)) {
+            Cerr << _T("Failed to write block hashes to ") << hashesOutputPath << std::endl;
+            return -1;
+        } else {
+            Cout << _T("Successfully saved ") << hashesOutputPath << std::endl;
+        }
+    }
+
+    return 0;
+}
+
+// PNG writer with pigz-like parallel deflate - the image is split into chunks of rows that are filtered and
+// compressed independently on all threads, every chunk but the last ends with a sync flush (an empty stored block)
+// so the chunks simply concatenate into one zlib stream, chunks adler32 are combined afterwards.
+// The deflate itself is greedy hash chains LZ77 with fixed Huffman codes, the same idea as stbi_zlib_compress.
+static const size_t kPngChunkSize = 256 * 1024;    // of the raw image
+static const size_t kDeflateWindowSize = 32768;
+static const size_t kDeflateHashBits = 15;
+static const size_t kDeflateMaxChain = 32;
+static const size_t kDeflateMinMatch = 3;
+static const size_t kDeflateMaxMatch = 258;
+
+struct DeflateTables {
+    DeflateTables() {
+        auto reverse = [](uint32_t code, const uint32_t numBits)->uint32_t {
+            uint32_t result = 0;
+            for (uint32_t i = 0; i < numBits; ++i, code >>= 1) {
+                result = (result << 1) | (code & 1);
+            }
+            return result;
+        };
+
+        // fixed Huffman codes, stored bit reversed as deflate writes Huffman codes starting from the msb
+        for (uint32_t sym = 0; sym < 288; ++sym) {
+            const uint32_t code = sym < 144 ? 0x30 + sym : (sym < 256 ? 0x190 + sym - 144 : (sym < 280 ? sym - 256 : 0xC0 + sym - 280));
+            const uint32_t numBits = sym < 144 ? 8 : (sym < 256 ? 9 : (sym < 280 ? 7 : 8));
+            litBits[sym] = reverse(code, numBits);
+            litNumBits[sym] = numBits;
+        }
+
+        static const uint32_t kLengthBase[29] = { 3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+        static const uint32_t kLengthExtra[29] = { 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+        for (uint32_t len = kDeflateMinMatch, i = 0; len <= kDeflateMaxMatch; ++len) {
+            while (i < 28 && len >= kLengthBase[i + 1]) {
+                ++i;
+            }
+            const uint32_t sym = 257 + i;
+            lengthBits[len] = litBits[sym] | ((len - kLengthBase[i]) << litNumBits[sym]);
+            lengthNumBits[len] = litNumBits[sym] + kLengthExtra[i];
+        }
+
+        for (uint32_t d = 0; d < 30; ++d) {
+            distBits[d] = reverse(d, 5);
+        }
+    }
+
+    uint32_t litBits[288];
+    uint32_t litNumBits[288];
+    uint32_t lengthBits[kDeflateMaxMatch + 1];      // length symbol + extra bits
+    uint32_t lengthNumBits[kDeflateMaxMatch + 1];
+    uint32_t distBits[30];
+};
+
+static const DeflateTables& GetDeflateTables() {
+    static const DeflateTables sTables;
+    return sTables;
+}
+
+class DeflateBitWriter {
+public:
+    explicit DeflateBitWriter(BytesArray& out) : mOut(out) {}
+
+    inline void Put(const uint32_t bits, const uint32_t numBits) {
+        mBits |= scast<uint64_t>(bits) << mNumBits;
+        mNumBits += numBits;
+        while (mNumBits >= 8) {
+            mOut.push_back(scast<uint8_t>(mBits & 0xFF));
+            mBits >>= 8;
+            mNumBits -= 8;
+        }
+    }
+
+    inline void AlignToByte() {
+        if (mNumBits) {
+            Put(0, 8 - mNumBits);
+        }
+    }
+
+private:
+    BytesArray& mOut;
+    uint64_t    mBits = 0;
+    uint32_t    mNumBits = 0;
+};
+
+// appends data as a single fixed Huffman block, a non last block is followed by a sync flush to end on a byte boundary
+static void DeflateChunk(const uint8_t* data, const size_t size, const bool last, BytesArray& out) {
+    const DeflateTables& tables = GetDeflateTables();
+    DeflateBitWriter writer(out);
+
+    writer.Put(last ? 1 : 0, 1);    // BFINAL
+    writer.Put(1, 2);               // BTYPE = fixed Huffman
+
+    const size_t kWindowMask = kDeflateWindowSize - 1;
+    std::vector<int32_t> head(size_t(1) << kDeflateHashBits, -1);
+    std::vector<int32_t> prev(kDeflateWindowSize, -1);
+
+    auto hash3 = [data](const size_t pos)->size_t {
+        const uint32_t v = (scast<uint32_t>(data[pos]) << 16) | (scast<uint32_t>(data[pos + 1]) << 8) | data[pos + 2];
+        return (v * 2654435761u) >> (32 - kDeflateHashBits);
+    };
+    auto insert = [&](const size_t pos) {
+        const size_t h = hash3(pos);
+        prev[pos & kWindowMask] = head[h];
+        head[h] = scast<int32_t>(pos);
+    };
+
+    size_t i = 0;
+    while (i < size) {
+        size_t bestLen = 0, bestDist = 0;
+        if (i + kDeflateMinMatch <= size) {
+            const size_t maxLen = std::min(kDeflateMaxMatch, size - i);
+            size_t chain = kDeflateMaxChain;
+            for (int32_t cand = head[hash3(i)]; cand >= 0 && i - cand <= kDeflateWindowSize && chain; cand = prev[cand & kWindowMask], --chain) {
+                const uint8_t* a = data + cand;
+                const uint8_t* b = data + i;
+                if (a[bestLen] != b[bestLen]) {
+                    continue;
+                }
+
+                size_t len = 0;
+                while (len < maxLen && a[len] == b[len]) {
+                    ++len;
+                }
+                if (len > bestLen) {
+                    bestLen = len;
+                    bestDist = i - cand;
+                    if (len == maxLen) {
+                        break;
+                    }
+                }
+            }
+            insert(i);
+        }
+
+        if (bestLen >= kDeflateMinMatch) {
+            writer.Put(tables.lengthBits[bestLen], tables.lengthNumBits[bestLen]);
+
+            // distance code: 0-3 as is, then 2 codes per power of two with (log2 - 1) extra bits
+            const uint32_t v = scast<uint32_t>(bestDist - 1);
+            if (v < 4) {
+                writer.Put(tables.distBits[v], 5);
+            } else {
+                uint32_t log2 = 0;
+                while ((v >> (log2 + 1)) != 0) {
+                    ++log2;
+                }
+                const uint32_t numExtra = log2 - 1;
+                writer.Put(tables.distBits[2 * log2 + ((v >> numExtra) & 1)], 5);
+                writer.Put(v & ((1u << numExtra) - 1), numExtra);
+            }
+
+            for (size_t j = i + 1, end = std::min(i + bestLen, size - kDeflateMinMatch + 1); j < end; ++j) {
+                insert(j);
+            }
+            i += bestLen;
+        } else {
+            writer.Put(tables.litBits[data[i]], tables.litNumBits[data[i]]);
+            ++i;
+        }
+    }
+
+    writer.Put(tables.litBits[256], tables.litNumBits[256]);   // end of block
+
+    if (!last) {
+        // sync flush - empty stored block
+        writer.Put(0, 3);
+        writer.AlignToByte();
+        writer.Put(0x0000, 16);
+        writer.Put(0xFFFF, 16);
+    } else {
+        writer.AlignToByte();
+    }
+}
+
+static const uint32_t kAdler32Base = 65521;
+
+static uint32_t Adler32(const uint8_t* data, size_t size) {
+    uint32_t a = 1, b = 0;
+    while (size) {
+        // 5552 is the most bytes before b can overflow 32 bits
+        const size_t n = std::min<size_t>(size, 5552);
+        for (size_t i = 0; i < n; ++i) {
+            a += data[i];
+            b += a;
+        }
+        a %= kAdler32Base;
+        b %= kAdler32Base;
+        data += n;
+        size -= n;
+    }
+    return (b << 16) | a;
+}
+
+// adler32 of the concatenation of two blocks, the second one of size2 bytes (as adler32_combine in zlib)
+static uint32_t Adler32Combine(const uint32_t adler1, const uint32_t adler2, const size_t size2) {
+    const uint32_t rem = scast<uint32_t>(size2 % kAdler32Base);
+    uint32_t sum1 = adler1 & 0xFFFF;
+    uint32_t sum2 = scast<uint32_t>((scast<uint64_t>(rem) * sum1) % kAdler32Base);
+    sum1 += (adler2 & 0xFFFF) + kAdler32Base - 1;
+    sum2 += (adler1 >> 16) + (adler2 >> 16) + kAdler32Base - rem;
+    if (sum1 >= kAdler32Base) sum1 -= kAdler32Base;
+    if (sum1 >= kAdler32Base) sum1 -= kAdler32Base;
+    if (sum2 >= (kAdler32Base << 1)) sum2 -= (kAdler32Base << 1);
+    if (sum2 >= kAdler32Base) sum2 -= kAdler32Base;
+    return sum1 | (sum2 << 16);
+}
+
+static uint32_t Crc32(const uint8_t* data, const size_t size, uint32_t crc = 0) {
+    static const auto sTable = []() {
+        std::vector<uint32_t> table(256);
+        for (uint32_t i = 0; i < 256; ++i) {
+            uint32_t c = i;
+            for (int k = 0; k < 8; ++k) {
+                c = (c & 1) ? (0xEDB88320u ^ (c >> 1)) : (c >> 1);
+            }
+            table[i] = c;
+        }
+        return table;
+    }();
+
+    crc = ~crc;
+    for (size_t i = 0; i < size; ++i) {
+        crc = sTable[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+    }
+    return ~crc;
+}
+
+bool WritePng(const fs::path& path, const uint8_t* pixels, const size_t width, const size_t height, const size_t numChannels) {
+    const size_t rowBytes = width * numChannels;
+    const size_t rowsPerChunk = std::max<size_t>(1, kPngChunkSize / std::max<size_t>(1, rowBytes));
+    const size_t numChunks = (height + rowsPerChunk - 1) / rowsPerChunk;
+
+    std::vector<BytesArray> chunks(numChunks);
+    std::vector<uint32_t> chunksAdler(numChunks);
+    const BytesArray zeroRow(rowBytes, 0);
+
+    ParallelForBands(_T("png filter chunks"), numChunks, 1, [&](const size_t firstChunk, const size_t numChunksInBand) {
+        BytesArray filtered;
+        for (size_t c = firstChunk; c < firstChunk + numChunksInBand; ++c) {
+            const size_t firstRow = c * rowsPerChunk;
+            const size_t numRows = std::min(rowsPerChunk, height - firstRow);
+
+            filtered.resize(numRows * (rowBytes + 1));
+            for (size_t r = 0; r < numRows; ++r) {
+                const size_t y = firstRow + r;
+                gKernels->FilterPngRow(pixels + y * rowBytes, y ? pixels + (y - 1) * rowBytes : zeroRow.data(), rowBytes, numChannels, &filtered[r * (rowBytes + 1)]);
+            }
+
+            chunksAdler[c] = Adler32(filtered.data(), filtered.size());
+            DeflateChunk(filtered.data(), filtered.size(), c + 1 == numChunks, chunks[c]);
+        }
+    });
+
+    // zlib stream: header, the chunks, adler32 of everything (big endian)
+    BytesArray zlibStream = { 0x78, 0x01 };
+    uint32_t adler = 1;
+    for (size_t c = 0; c < numChunks; ++c) {
+        zlibStream.insert(zlibStream.end(), chunks[c].begin(), chunks[c].end());
+        adler = c ? Adler32Combine(adler, chunksAdler[c], std::min(rowsPerChunk, height - c * rowsPerChunk) * (rowBytes + 1)) : chunksAdler[c];
+        BytesArray().swap(chunks[c]);
+    }
+    for (int shift = 24; shift >= 0; shift -= 8) {
+        zlibStream.push_back(scast<uint8_t>(adler >> shift));
+    }
+
+    std::ofstream file(path, std::ofstream::binary);
+    if (!file.good()) {
+        return false;
+    }
+
+    auto writeChunk = [&file](const char* type, const uint8_t* data, const size_t size) {
+        const uint8_t sizeBE[4] = { scast<uint8_t>(size >> 24), scast<uint8_t>(size >> 16), scast<uint8_t>(size >> 8), scast<uint8_t>(size) };
+        const uint32_t crc = Crc32(data, size, Crc32(rcast<const uint8_t*>(type), 4));
+        const uint8_t crcBE[4] = { scast<uint8_t>(crc >> 24), scast<uint8_t>(crc >> 16), scast<uint8_t>(crc >> 8), scast<uint8_t>(crc) };
+        file.write(rcast<const char*>(sizeBE), 4);
+        file.write(type, 4);
+        file.write(rcast<const char*>(data), size);
+        file.write(rcast<const char*>(crcBE), 4);
+    };
+
+    static const uint8_t kPngSignature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+    static const uint8_t kColorTypes[5] = { 0, 0, 0, 2, 6 };    // by number of channels - grey, rgb, rgba
+    const uint8_t ihdr[13] = {
+        scast<uint8_t>(width >> 24), scast<uint8_t>(width >> 16), scast<uint8_t>(width >> 8), scast<uint8_t>(width),
+        scast<uint8_t>(height >> 24), scast<uint8_t>(height >> 16), scast<uint8_t>(height >> 8), scast<uint8_t>(height),
+        8, kColorTypes[numChannels], 0, 0, 0    // bit depth, color type, compression, filter, interlace
+    };
+
+    file.write(rcast<const char*>(kPngSignature), sizeof(kPngSignature));
+    writeChunk("IHDR", ihdr, sizeof(ihdr));
+    // IDAT chunks of at most 1 GB, well under the 2^31 limit
+    for (size_t offset = 0; offset < zlibStream.size(); offset += (size_t(1) << 30)) {
+        writeChunk("IDAT", zlibStream.data() + offset, std::min(zlibStream.size() - offset, size_t(1) << 30));
+    }
+    writeChunk("IEND", nullptr, 0);
+
+    return file.good();
+}
+
+// mips of a DXT5 dds mapped in memory, in the standard dds layout - every next mip is max(1, size / 2)
+// and takes whole 4x4 blocks, mips missing from the file are dropped
+struct DDSMipsView {
+    struct Mip {
+        const uint8_t*  blocks;
+        size_t          width;
+        size_t          height;
+    };
+
+    std::vector<Mip> mips;
+};
+
+static bool ParseDDSMips(const MappedFile& file, DDSMipsView& view) {
+    uint32_t signature = 0;
+    DDSURFACEDESC2 desc = {};
+    if (file.size() < sizeof(signature) + sizeof(desc)) {
+        return false;
+    }
+
+    std::memcpy(&signature, file.data(), sizeof(signature));
+    std::memcpy(&desc, file.data() + sizeof(signature), sizeof(desc));
+    if (signature != kDDSFileSignature ||
+        desc.ddpfPixelFormat.dwFlags != 0x00000004 ||   // DDPF_FOURCC
+        desc.ddpfPixelFormat.dwFourCC != 0x35545844) {  // DXT5
+        return false;
+    }
+
+    const size_t numMips = (desc.dwFlags & 0x00020000) ? std::max<size_t>(1, desc.dwMipMapCount) : 1; // DDSD_MIPMAPCOUNT
+    size_t offset = sizeof(signature) + sizeof(desc);
+    size_t mipW = desc.dwWidth, mipH = desc.dwHeight;
+
+    view.mips.clear();
+    for (size_t i = 0; i < numMips && mipW && mipH; ++i) {
+        // in 64 bits and checked against the rest of the file by division, the dimensions of a malformed header
+        // would overflow the size
+        const uint64_t numBlocksX = (scast<uint64_t>(mipW) + 3) / 4, numBlocksY = (scast<uint64_t>(mipH) + 3) / 4;
+        if (numBlocksX > (scast<uint64_t>(file.size()) - offset) / 16 / numBlocksY) {
+            break;
+        }
+        const size_t mipSize = scast<size_t>(numBlocksX * numBlocksY * 16);
+
+        view.mips.push_back({ file.data() + offset, mipW, mipH });
+        offset += mipSize;
+        mipW = std::max<size_t>(1, mipW / 2);
+        mipH = std::max<size_t>(1, mipH / 2);
+    }
+
+    return !view.mips.empty();
+}
+
+// decodes bump and bump# blocks of a width x height mip into the normalmap (rgb), glossmap and heightmap,
+// works row of blocks by row of blocks - both textures are decoded into small strips and disassembled right away,
+// so the whole decoded bump and bump# never exist
+static void DecodeBumpMip(const uint8_t* bumpBlocks, const uint8_t* bumpXBlocks, const size_t width, const size_t height,
+                          uint8_t* normalRgb, uint8_t* gloss, uint8_t* heightmap) {
+    const size_t stripWidth = (width + 3) & ~size_t(3);
+    const size_t blocksPerRow = stripWidth / 4;
+    const size_t numBlockRows = (height + 3) / 4;
+    const size_t minRowsPerThread = kMinPixelsPerUnpackThread / (stripWidth * 4);
+
+    ParallelForBands(_T("unpack rows"), numBlockRows, minRowsPerThread, [&](const size_t firstRow, const size_t numRows) {
+        Bitmap<PixelRgba> bumpStrip(stripWidth, 4), bumpXStrip(stripWidth, 4);
+
+        for (size_t blockRow = firstRow; blockRow < firstRow + numRows; ++blockRow) {
+            gKernels->DecompressBC3(bumpBlocks + blockRow * blocksPerRow * 16, rcast<uint8_t*>(bumpStrip.pixels.data()), stripWidth, 4);
+            gKernels->DecompressBC3(bumpXBlocks + blockRow * blocksPerRow * 16, rcast<uint8_t*>(bumpXStrip.pixels.data()), stripWidth, 4);
+
+            for (size_t row = 0, y = blockRow * 4; row < 4 && y < height; ++row, ++y) {
+                gKernels->DisassembleBump(rcast<const uint8_t*>(&bumpStrip.pixels[row * stripWidth]),
+                                          rcast<const uint8_t*>(&bumpXStrip.pixels[row * stripWidth]),
+                                          normalRgb + y * width * 3,
+                                          gloss + y * width,
+                                          heightmap + y * width,
+                                          width);
+            }
+        }
+    });
+}
+
+// decodes a mip of bump and bump# and writes out the heightmap, glossmap and normalmap of it,
+// outputPathBase gets "_height.tga", "_gloss.tga" and "_normal.tga" (or .png) appended, messages go to log,
+// false if any of them failed to write
+static bool UnpackBumpMip(const DDSMipsView::Mip& bumpMip, const DDSMipsView::Mip& bumpXMip, const int mip, const fs::path& outputPathBase, const bool asPng,
+                          IoLimiter* ioLimiter, std::basic_ostream<Char>& log) {
+    const size_t width = bumpMip.width, height = bumpMip.height;
+
+    std::vector<uint8_t> heightmapData(width * height);
+    std::vector<uint8_t> glossmapData(width * height);
+    std::vector<PixelRgb> normalmapData(width * height);
+
+    {
+        IoScope ioScope(ioLimiter);     // the decoding is what reads the mapped dds files
+        const size_t numBlocks = ((width + 3) / 4) * ((height + 3) / 4);
+        StageTimer timer(_T("decode"), mip);
+        timer.SetVolume(width * height, numBlocks * 16 * 2, width * height * (sizeof(PixelRgb) + 2));
+        DecodeBumpMip(bumpMip.blocks, bumpXMip.blocks, width, height,
+                      rcast<uint8_t*>(normalmapData.data()), glossmapData.data(), heightmapData.data());
+    }
+
+    auto writeImage = [&](const Char* stage, const fs::path& path, const void* data, const size_t numChannels)->bool {
+        IoScope ioScope(ioLimiter);
+        StageTimer timer(stage, mip);
+        bool result;
+        if (asPng) {
+            result = WritePng(path, rcast<const uint8_t*>(data), width, height, numChannels);
+        } else {
+            result = stbi_write_tga(path.u8string().c_str(), scast<int>(width), scast<int>(height), scast<int>(numChannels), data) != 0;
+        }
+        timer.SetVolume(width * height, width * height * numChannels, gStatsEnabled ? FileSizeOrZero(path) : 0);
+        return result;
+    };
+
+    const String extension = asPng ? _T(".png") : _T(".tga");
+    bool succeeded = true;
+
+    log << _T("Saving out heightmap:") << std::endl;
+    fs::path heightmapPath = outputPathBase; heightmapPath += _T("_height") + extension;
+    log << heightmapPath << std::endl;
+    if (!writeImage(_T("write heightmap"), heightmapPath, heightmapData.data(), 1)) {
+        log << _T("Failed :(") << std::endl;
+        succeeded = false;
+    }
+
+    log << _T("Saving out glossmap:") << std::endl;
+    fs::path glossmapPath = outputPathBase; glossmapPath += _T("_gloss") + extension;
+    log << glossmapPath << std::endl;
+    if (!writeImage(_T("write glossmap"), glossmapPath, glossmapData.data(), 1)) {
+        log << _T("Failed :(") << std::endl;
+        succeeded = false;
+    }
+
+    log << _T("Saving out normalmap:") << std::endl;
+    fs::path normalmapPath = outputPathBase; normalmapPath += _T("_normal") + extension;
+    log << normalmapPath << std::endl;
+    if (!writeImage(_T("write normalmap"), normalmapPath, normalmapData.data(), 3)) {
+        log << _T("Failed :(") << std::endl;
+        succeeded = false;
+    }
+
+    return succeeded;
+}
+
+// unpacks bump.dds and its bump#.dds into outputFolder, messages go to log
+static bool UnpackBumpFile(const fs::path& bumpPath, const fs::path& bumpXPath, const fs::path& outputFolder, const bool allMips, const bool asPng,
+                           IoLimiter* ioLimiter, std::basic_ostream<Char>& log) {
+    MappedFile bumpFile, bumpXFile;
+    DDSMipsView bumpMips, bumpXMips;
+    {
+        IoScope ioScope(ioLimiter);
+        StageTimer timer(_T("map dds"));
+        if (!bumpFile.Open(bumpPath) || !ParseDDSMips(bumpFile, bumpMips)) {
+            log << _T("Failed to load ") << bumpPath << std::endl;
+            return false;
+        }
+
+        if (!bumpXFile.Open(bumpXPath) || !ParseDDSMips(bumpXFile, bumpXMips)) {
+            log << _T("Failed to load ") << bumpXPath << std::endl;
+            return false;
+        }
+        timer.SetVolume(0, bumpFile.size() + bumpXFile.size(), 0);
+    }
+
+    // every mip, the same as --probe pairs them
+    bool samePair = bumpMips.mips.size() == bumpXMips.mips.size();
+    for (size_t i = 0; samePair && i < bumpMips.mips.size(); ++i) {
+        samePair = bumpMips.mips[i].width == bumpXMips.mips[i].width && bumpMips.mips[i].height == bumpXMips.mips[i].height;
+    }
+    if (!samePair) {
+        log << _T("The two dds files are not of the same size! Aborting...") << std::endl;
+        return false;
+    }
+
+    fs::path bumpName = bumpPath.stem();
+
+    const size_t numMips = allMips ? bumpMips.mips.size() : 1;
+    if (allMips) {
+        log << _T("Unpacking ") << numMips << _T(" mips") << std::endl;
+    }
+
+    // mips are independent, so they are unpacked in parallel, biggest first, the messages are printed in order afterwards
+    std::vector<std::basic_ostringstream<Char>> logs(numMips);
+    std::atomic<size_t> nextMip{ 0 };
+    std::atomic<size_t> numFailedMips{ 0 };
+    auto unpackMips = [&]() {
+        for (size_t i = nextMip++; i < numMips; i = nextMip++) {
+            fs::path outputPathBase = outputFolder / bumpName;
+            if (i > 0) {
+                outputPathBase += _T("_mip") + ToString(i);
+            }
+            try {
+                if (!UnpackBumpMip(bumpMips.mips[i], bumpXMips.mips[i], scast<int>(i), outputPathBase, asPng, ioLimiter, logs[i])) {
+                    ++numFailedMips;
+                }
+            } catch (const std::exception& e) {
+                logs[i] << _T("Mip ") << i << _T(" failed: ") << e.what() << std::endl;
+                ++numFailedMips;
+            }
+        }
+    };
+
+    const size_t numThreads = Clamp<size_t>(MaxWorkerThreads(), 1, numMips);
+    std::vector<std::thread> threads;
+    for (size_t i = 1; i < numThreads; ++i) {
+        threads.emplace_back(unpackMips);
+    }
+    unpackMips();
+    for (auto& t : threads) {
+        t.join();
+    }
+
+    for (auto& mipLog : logs) {
+        log << mipLog.str();
+    }
+
+    return numFailedMips == 0;
+}
+
+// name#.dds next to name.dds, the exact name if there's such a file or else one of any case, as --probe pairs them
+static fs::path FindBumpXPartner(const fs::path& bumpPath) {
+    const fs::path bumpXPath = (bumpPath.parent_path() / bumpPath.stem()).native() + _T("#.dds");
+    std::error_code errorCode;
+    if (fs::is_regular_file(bumpXPath, errorCode)) {
+        return bumpXPath;
+    }
+
+    const String name = StrToLower(bumpXPath.filename().native());
+    const fs::path folder = bumpPath.parent_path().empty() ? fs::path(_T(".")) : bumpPath.parent_path();
+    for (auto it = fs::directory_iterator(folder, errorCode); !errorCode && it != fs::directory_iterator(); it.increment(errorCode)) {
+        if (StrToLower(it->path().filename().native()) == name && it->is_regular_file(errorCode)) {
+            return bumpPath.parent_path() / it->path().filename();
+        }
+    }
+    return bumpXPath;   // fails to load with its name in the message
+}
+
+// unpacks every *_bump.dds with its *_bump#.dds found in the tree on a pool of threads, one texture per thread,
+// the output tree mirrors the source one
+static int UnpackBumpTree(const fs::path& root, const fs::path& outputRoot, const bool allMips, const bool asPng) {
+    std::error_code errorCode;
+
+    // the dds files by lower case path, so the bump# partners are found regardless of the case, as --probe pairs them
+    std::map<String, fs::path> ddsByName;
+    for (auto it = fs::recursive_directory_iterator(root, errorCode); !errorCode && it != fs::recursive_directory_iterator(); it.increment(errorCode)) {
+        if (StrEndsWith(StrToLower(it->path().filename().native()), _T(".dds")) && it->is_regular_file(errorCode)) {
+            ddsByName.emplace(StrToLower(it->path().native()), it->path());
+        }
+    }
+
+    // sorted by the lower case path
+    std::vector<std::pair<fs::path, fs::path>> bumpPaths;    // bump.dds, bump#.dds
+    size_t numMissingPartners = 0;
+    for (const auto& dds : ddsByName) {
+        if (!StrEndsWith(dds.first, _T("_bump.dds"))) {
+            continue;
+        }
+
+        auto partnerIt = ddsByName.find(dds.first.substr(0, dds.first.length() - 4) + _T("#.dds"));
+        if (partnerIt != ddsByName.end()) {
+            bumpPaths.emplace_back(dds.second, partnerIt->second);
+        } else {
+            Cerr << _T("No bump# for ") << dds.second << _T(", skipping") << std::endl;
+            ++numMissingPartners;
+        }
+    }
+
+    Cout << _T("Found ") << bumpPaths.size() << _T(" bump textures to unpack") << std::endl;
+
+    IoLimiter ioLimiter(kMaxConcurrentIo);
+    std::mutex progressMutex;
+    std::atomic<size_t> nextTexture{ 0 };
+    size_t numDone = 0, numFailed = 0;
+
+    auto worker = [&]() {
+        tInWorkerPool = true;
+        for (size_t i = nextTexture++; i < bumpPaths.size(); i = nextTexture++) {
+            const fs::path& bumpPath = bumpPaths[i].first;
+            const fs::path outputFolder = outputRoot / bumpPath.parent_path().lexically_relative(root);
+
+            // whatever a texture throws fails that texture only
+            std::basic_ostringstream<Char> log;
+            bool succeeded = false;
+            try {
+                std::error_code dirError;
+                fs::create_directories(outputFolder, dirError);
+                succeeded = !dirError && UnpackBumpFile(bumpPath, bumpPaths[i].second, outputFolder, allMips, asPng, &ioLimiter, log);
+            } catch (const std::exception& e) {
+                log << e.what() << std::endl;
+            }
+
+            std::lock_guard<std::mutex> lock(progressMutex);
+            ++numDone;
+            Cout << _T("[") << numDone << _T("/") << bumpPaths.size() << _T("] ") << bumpPath.lexically_relative(root).native() << std::endl;
+            if (!succeeded) {
+                ++numFailed;
+                Cerr << _T("Failed to unpack ") << bumpPath << std::endl << log.str();
+            }
+        }
+    };
+
+    const size_t numThreads = Clamp<size_t>(std::thread::hardware_concurrency(), 1, std::max<size_t>(1, bumpPaths.size()));
+    std::vector<std::thread> threads;
+    for (size_t i = 0; i < numThreads; ++i) {
+        threads.emplace_back(worker);
+    }
+    for (auto& t : threads) {
+        t.join();
+    }
+
+    Cout << _T("Unpacked ") << (bumpPaths.size() - numFailed) << _T(" of ") << bumpPaths.size() << _T(" textures");
+    if (numMissingPartners) {
+        Cout << _T(", ") << numMissingPartners << _T(" skipped without bump#");
+    }
+    Cout << std::endl;
+
+    return numFailed ? -1 : 0;
+}
+
+static int UnpackBump(int argc, Char** argv) {
+    fs::path bumpPath = argv[1];
+
+    std::error_code errorCode;
+    const bool isTree = fs::is_directory(bumpPath, errorCode);
+
+    bool allMips = false, asPng = false;
+    fs::path outputFolder = isTree ? bumpPath : bumpPath.parent_path();
+    for (int i = 2; i < argc; ++i) {
+        if (String(_T("--mips")) == argv[i]) {
+            allMips = true;
+        } else if (String(_T("--png")) == argv[i]) {
+            asPng = true;
+        } else {
+            outputFolder = argv[i];
+        }
+    }
+
+    if (isTree) {
+        return UnpackBumpTree(bumpPath, outputFolder, allMips, asPng);
+    } else {
+        // the same as a texture of the tree: the messages are errors if the unpacking failed
+        std::basic_ostringstream<Char> log;
+        if (!UnpackBumpFile(bumpPath, FindBumpXPartner(bumpPath), outputFolder, allMips, asPng, nullptr, log)) {
+            Cerr << _T("Failed to unpack ") << bumpPath << std::endl << log.str();
+            return -1;
+        }
+        Cout << log.str();
+        return 0;
+    }
+}
+
+// probe mode - only the headers of the dds files are read, nothing gets decoded
+static const uint32_t kDDSFourCC_DX10 = 0x30315844;     // "DX10"
+static const size_t kNumProbeThreads = 8;   // waiting for the disk mostly, so more than cores is fine
+
+struct DDSHeaderDX10 {
+    uint32_t dxgiFormat;
+    uint32_t resourceDimension;
+    uint32_t miscFlag;
+    uint32_t arraySize;
+    uint32_t miscFlags2;
+};
+
+struct DDSProbe {
+    fs::path    path;
+    uint64_t    fileSize = 0;
+    uint32_t    width = 0;
+    uint32_t    height = 0;
+    uint32_t    numMips = 0;
+    uint32_t    fourCC = 0;         // 0 for uncompressed formats
+    uint32_t    bitCount = 0;       // for uncompressed formats
+    uint32_t    dxgiFormat = 0;     // for DX10 headers
+    const char* problem = nullptr;  // in the header, nullptr if it's fine
+    const char* pairProblem = nullptr;
+};
+
+// reads up to size bytes from the beginning of the file with a single call, returns the number of bytes read or -1
+static long long ReadFileHead(const fs::path& path, void* buffer, const size_t size, uint64_t& fileSize) {
+    long long result = -1;
+#ifdef _WIN32
+    void* const kInvalidHandle = rcast<void*>(scast<intptr_t>(-1));
+    void* hFile = CreateFileW(path.c_str(), 0x80000000 /*GENERIC_READ*/, 1 /*FILE_SHARE_READ*/, nullptr,
+                              3 /*OPEN_EXISTING*/, 0x08000000 /*FILE_FLAG_SEQUENTIAL_SCAN*/, nullptr);
+    if (hFile == kInvalidHandle) {
+        return -1;
+    }
+
+    long long size64 = 0;
+    unsigned long numRead = 0;
+    if (GetFileSizeEx(hFile, &size64) && ReadFile(hFile, buffer, scast<unsigned long>(size), &numRead, nullptr)) {
+        fileSize = scast<uint64_t>(size64);
+        result = numRead;
+    }
+    CloseHandle(hFile);
+#else
+    const int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return -1;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) == 0) {
+        fileSize = scast<uint64_t>(st.st_size);
+        result = pread(fd, buffer, size, 0);
+    }
+    close(fd);
+#endif
+    return result;
+}
+
+// bytes per 4x4 block for the block compressed formats, 0 if the format is not (or not known to be) block compressed
+static size_t DDSBytesPerBlock(const uint32_t fourCC, const uint32_t dxgiFormat) {
+    switch (fourCC) {
+        case 0x31545844:    // DXT1
+        case 0x31495441:    // ATI1
+        case 0x55344342:    // BC4U
+        case 0x53344342:    // BC4S
+            return 8;
+        case 0x32545844:    // DXT2
+        case 0x33545844:    // DXT3
+        case 0x34545844:    // DXT4
+        case 0x35545844:    // DXT5
+        case 0x32495441:    // ATI2
+        case 0x55354342:    // BC5U
+        case 0x53354342:    // BC5S
+            return 16;
+        case kDDSFourCC_DX10:
+            if ((dxgiFormat >= 70 && dxgiFormat <= 72) || (dxgiFormat >= 79 && dxgiFormat <= 81)) {        // BC1, BC4
+                return 8;
+            } else if ((dxgiFormat >= 73 && dxgiFormat <= 78) || (dxgiFormat >= 82 && dxgiFormat <= 84) ||  // BC2, BC3, BC5
+                       (dxgiFormat >= 94 && dxgiFormat <= 99)) {                                            // BC6H, BC7
+                return 16;
+            }
+            return 0;
+    }
+    return 0;
+}
+
+static std::string DDSFormatName(const DDSProbe& probe) {
+    static const std::pair<uint32_t, const char*> kDxgiNames[] = {
+        { 28, "RGBA8" }, { 29, "RGBA8_SRGB" }, { 87, "BGRA8" }, { 91, "BGRA8_SRGB" },
+        { 71, "BC1" }, { 72, "BC1_SRGB" }, { 74, "BC2" }, { 75, "BC2_SRGB" }, { 77, "BC3" }, { 78, "BC3_SRGB" },
+        { 80, "BC4" }, { 81, "BC4_SNORM" }, { 83, "BC5" }, { 84, "BC5_SNORM" },
+        { 95, "BC6H_UF16" }, { 96, "BC6H_SF16" }, { 98, "BC7" }, { 99, "BC7_SRGB" }
+    };
+
+    if (!probe.fourCC) {
+        return "RGB" + std::to_string(probe.bitCount);
+    } else if (probe.fourCC == kDDSFourCC_DX10) {
+        for (const auto& v : kDxgiNames) {
+            if (v.first == probe.dxgiFormat) {
+                return std::string("DX10/") + v.second;
+            }
+        }
+        return "DX10/" + std::to_string(probe.dxgiFormat);
+    } else {
+        std::string result;
+        for (size_t i = 0; i < 4; ++i) {
+            const char c = scast<char>((probe.fourCC >> (i * 8)) & 0xFF);
+            result += (c > 32 && c < 127) ? c : '?';
+        }
+        return result;
+    }
+}
+
+static void ProbeDDS(DDSProbe& probe) {
+    uint8_t head[sizeof(uint32_t) + sizeof(DDSURFACEDESC2) + sizeof(DDSHeaderDX10)] = {};
+    const long long numRead = ReadFileHead(probe.path, head, sizeof(head), probe.fileSize);
+    if (numRead < 0) {
+        probe.problem = "read-error";
+        return;
+    }
+
+    uint32_t signature = 0;
+    DDSURFACEDESC2 desc = {};
+    DDSHeaderDX10 descDX10 = {};
+    std::memcpy(&signature, head, sizeof(signature));
+    std::memcpy(&desc, head + sizeof(signature), sizeof(desc));
+    std::memcpy(&descDX10, head + sizeof(signature) + sizeof(desc), sizeof(descDX10));
+
+    if (scast<size_t>(numRead) < sizeof(signature) + sizeof(desc) || signature != kDDSFileSignature) {
+        probe.problem = "not-dds";
+        return;
+    }
+    if (desc.dwSize != sizeof(DDSURFACEDESC2) || desc.ddpfPixelFormat.dwSize != sizeof(DDPIXELFORMAT)) {
+        probe.problem = "bad-header";
+        return;
+    }
+
+    const bool isDX10 = (desc.ddpfPixelFormat.dwFlags & 0x00000004) && desc.ddpfPixelFormat.dwFourCC == kDDSFourCC_DX10;
+    if (isDX10 && scast<size_t>(numRead) < sizeof(head)) {
+        probe.problem = "bad-header";
+        return;
+    }
+
+    probe.width = desc.dwWidth;
+    probe.height = desc.dwHeight;
+    probe.numMips = (desc.dwFlags & 0x00020000) ? std::max<uint32_t>(1, desc.dwMipMapCount) : 1;   // DDSD_MIPMAPCOUNT
+    probe.fourCC = (desc.ddpfPixelFormat.dwFlags & 0x00000004) ? desc.ddpfPixelFormat.dwFourCC : 0;
+    probe.bitCount = probe.fourCC ? 0 : desc.ddpfPixelFormat.dwRGBBitCount;
+    probe.dxgiFormat = isDX10 ? descDX10.dxgiFormat : 0;
+
+    if (!probe.width || !probe.height) {
+        probe.problem = "bad-dimensions";
+        return;
+    }
+    if (probe.numMips > Log2I(std::max(probe.width, probe.height)) + 1) {
+        probe.problem = "bad-mip-count";
+        return;
+    }
+
+    // the size check is skipped for volume textures and the formats we don't know
+    const size_t bytesPerBlock = DDSBytesPerBlock(probe.fourCC, probe.dxgiFormat);
+    if ((bytesPerBlock || (!probe.fourCC && probe.bitCount)) && !(desc.ddsCaps.dwCaps2 & 0x00200000)) {    // DDSCAPS2_VOLUME
+        const uint64_t numFaces = isDX10 ? std::max<uint32_t>(1, descDX10.arraySize) * ((descDX10.miscFlag & 0x4) ? 6 : 1)  // TEXTURECUBE
+                                         : ((desc.ddsCaps.dwCaps2 & 0x00000200) ? 6 : 1);                                   // DDSCAPS2_CUBEMAP
+        uint64_t dataSize = 0;
+        for (uint64_t i = 0, w = probe.width, h = probe.height; i < probe.numMips; ++i) {
+            dataSize += bytesPerBlock ? ((w + 3) / 4) * ((h + 3) / 4) * bytesPerBlock : ((w * probe.bitCount + 7) / 8) * h;
+            w = std::max<uint64_t>(1, w / 2);
+            h = std::max<uint64_t>(1, h / 2);
+        }
+
+        const uint64_t headerSize = sizeof(signature) + sizeof(desc) + (isDX10 ? sizeof(descDX10) : 0);
+        if (probe.fileSize < headerSize + dataSize * numFaces) {
+            probe.problem = "truncated";
+        }
+    }
+}
+
+// reads the headers of all the dds files in root and its subfolders in parallel, checks the bump/bump# pairs
+// and writes an index, one tab separated line per file
+static int ProbeTree(const fs::path& root, const fs::path& indexPath) {
+    std::error_code errorCode;
+
+    std::vector<DDSProbe> probes;
+    for (auto it = fs::recursive_directory_iterator(root, errorCode); !errorCode && it != fs::recursive_directory_iterator(); it.increment(errorCode)) {
+        if (StrEndsWith(StrToLower(it->path().filename().native()), _T(".dds")) && it->is_regular_file(errorCode)) {
+            probes.emplace_back();
+            probes.back().path = it->path();
+        }
+    }
+    std::sort(probes.begin(), probes.end(), [](const DDSProbe& a, const DDSProbe& b) { return a.path < b.path; });
+
+    Cout << _T("Probing ") << probes.size() << _T(" dds files...") << std::endl;
+
+    std::atomic<size_t> nextProbe{ 0 };
+    auto worker = [&]() {
+        for (size_t i = nextProbe++; i < probes.size(); i = nextProbe++) {
+            ProbeDDS(probes[i]);
+        }
+    };
+
+    const size_t numThreads = Clamp<size_t>(kNumProbeThreads, 1, std::max<size_t>(1, probes.size()));
+    std::vector<std::thread> threads;
+    for (size_t i = 0; i < numThreads; ++i) {
+        threads.emplace_back(worker);
+    }
+    for (auto& t : threads) {
+        t.join();
+    }
+
+    // pair the bumps up, names are compared case insensitive as the game does
+    std::map<String, size_t> probesByName;
+    for (size_t i = 0; i < probes.size(); ++i) {
+        probesByName[StrToLower(probes[i].path.native())] = i;
+    }
+
+    // every pair problem is decided before anything is reported, a bump# comes before its bump but is marked by it
+    size_t numMalformed = 0, numMissingPartners = 0, numMismatchedPairs = 0;
+    for (auto& probe : probes) {
+        const String name = StrToLower(probe.path.native());
+        if (StrEndsWith(name, _T("_bump.dds"))) {
+            auto partnerIt = probesByName.find(name.substr(0, name.length() - 4) + _T("#.dds"));
+            if (partnerIt == probesByName.end()) {
+                probe.pairProblem = "no-bump#";
+            } else {
+                DDSProbe& partner = probes[partnerIt->second];
+                if (!probe.problem && !partner.problem &&
+                    (probe.width != partner.width || probe.height != partner.height || probe.numMips != partner.numMips)) {
+                    probe.pairProblem = partner.pairProblem = "pair-mismatch";
+                    ++numMismatchedPairs;
+                }
+            }
+        } else if (StrEndsWith(name, _T("_bump#.dds"))) {
+            if (probesByName.find(name.substr(0, name.length() - 5) + _T(".dds")) == probesByName.end()) {
+                probe.pairProblem = "no-bump";
+            }
+        }
+    }
+
+    for (const auto& probe : probes) {
+        numMalformed += probe.problem ? 1 : 0;
+        numMissingPartners += (probe.pairProblem && probe.pairProblem[0] == 'n') ? 1 : 0;
+
+        const char* problem = probe.problem ? probe.problem : probe.pairProblem;
+        if (problem) {
+            Cerr << probe.path.lexically_relative(root).native() << _T(": ") << String(problem, problem + std::strlen(problem)) << std::endl;
+        }
+    }
+
+    std::ofstream file(indexPath, std::ofstream::binary);
+    if (file.good()) {
+        file << "# bumpx probe index v1: path width height mips format size status\n";
+        for (const auto& probe : probes) {
+            const char* problem = probe.problem ? probe.problem : (probe.pairProblem ? probe.pairProblem : "ok");
+            file << probe.path.lexically_relative(root).generic_u8string() << '\t' << probe.width << '\t' << probe.height << '\t'
+                 << probe.numMips << '\t' << (probe.width ? DDSFormatName(probe) : "-") << '\t' << probe.fileSize << '\t'
+                 << problem << '\n';
+        }
+        file.close();
+    }
+
+    Cout << _T("Probed ") << probes.size() << _T(" dds files: ") << numMalformed << _T(" malformed, ")
+         << numMissingPartners << _T(" without a bump/bump# partner, ") << numMismatchedPairs << _T(" mismatched pairs") << std::endl;
+    if (file.fail()) {
+        Cerr << _T("Failed to write the index to ") << indexPath << std::endl;
+        return -1;
+    }
+    Cout << _T("Index written to ") << indexPath << std::endl;
+
+    return (numMalformed || numMissingPartners || numMismatchedPairs) ? -1 : 0;
+}
+
+} // namespace bumpx
+
+using namespace bumpx;
+
+
+// C interface (see bumpx.h): the same pipeline as the packing and unpacking modes, but on the caller's buffers,
+// every call mutes the log of its thread and keeps everything it needs on its stack
+
+// the best kernels for the running CPU, picked once by whichever call comes first, unless bumpx already did
+static void SelectLibraryKernels() {
+    static const bool sSelected = gKernels != nullptr || SelectKernels(String());
+    (void)sSelected;
+}
+
+// copies rows of a buffer with stride (0 - tight) into a bitmap
+template <typename T>
+static Bitmap<T> BitmapFromRows(const uint8_t* src, const size_t stride, const size_t width, const size_t height) {
+    Bitmap<T> result(width, height);
+    const size_t rowSize = width * sizeof(T);
+    for (size_t y = 0; y < height; ++y) {
+        std::memcpy(&result.pixels[y * width], src + y * (stride ? stride : rowSize), rowSize);
+    }
+    return result;
+}
+
+extern "C" bumpx_pack_options bumpx_default_pack_options(void) {
+    bumpx_pack_options options;
+    options.quality = 2;
+    options.bc1_mode = scast<int>(BC1ApproxMode::NVidia);
+    options.closed_loop_passes = 0;
+    options.linear_gloss = 0;
+    return options;
+}
+
+extern "C" uint32_t bumpx_mip_count(uint32_t width, uint32_t height) {
+    if (width < kMinMipSize || height < kMinMipSize || !IsPowerOfTwo(width) || !IsPowerOfTwo(height)) {
+        return 0;
+    }
+    return scast<uint32_t>(Log2I(std::max(width, height)));    // as many as Texture has
+}
+
+extern "C" size_t bumpx_chain_size(uint32_t width, uint32_t height) {
+    size_t result = 0;
+    size_t mipW = width, mipH = height;
+    for (uint32_t i = 0, numMips = bumpx_mip_count(width, height); i < numMips; ++i) {
+        result += (mipW / 4) * (mipH / 4) * 16;
+        mipW = std::max<size_t>(mipW / 2, kMinMipSize);
+        mipH = std::max<size_t>(mipH / 2, kMinMipSize);
+    }
+    return result;
+}
+
+extern "C" bumpx_result bumpx_pack(const bumpx_pack_input* input, const bumpx_pack_options* options,
+                                   void* bump_chain, size_t bump_size, void* bumpx_chain, size_t bumpx_size) {
+    const bumpx_pack_options opts = options ? *options : bumpx_default_pack_options();
+    if (!input || !input->normal_rgba || !bump_chain || !bumpx_chain ||
+        opts.quality < -1 || opts.quality > 2 || opts.closed_loop_passes < 0 || opts.closed_loop_passes > kMaxClosedLoopPasses ||
+        opts.bc1_mode < 0 || opts.bc1_mode >= scast<int>(BC1ApproxMode::Count)) {
+        return BUMPX_INVALID_ARGUMENT;
+    }
+
+    const size_t width = input->width, height = input->height;
+    const size_t chainSize = bumpx_chain_size(input->width, input->height);
+    if (!chainSize ||
+        (input->normal_stride && input->normal_stride < width * sizeof(PixelRgba)) ||
+        (input->gloss_stride && input->gloss_stride < width) ||
+        (input->height_map_stride && input->height_map_stride < width)) {
+        return BUMPX_INVALID_ARGUMENT;
+    } else if (bump_size < chainSize || bumpx_size < chainSize) {
+        return BUMPX_BUFFER_TOO_SMALL;
+    }
+
+    LogMuteScope muteScope;
+    try {
+        SelectLibraryKernels();
+
+        QualitySettings qualitySettings;
+        qualitySettings.autoPolicy = opts.quality < 0;
+        qualitySettings.quality = opts.quality < 0 ? qualitySettings.quality : opts.quality;
+        const BC1ApproxMode bc1Mode = scast<BC1ApproxMode>(opts.bc1_mode);
+
+        // deferred, the planes are only copied, so there is nothing to overlap with the normalmap mipchain
+        auto monoPlane = [width, height](const uint8_t* plane, const size_t stride) {
+            return plane ? BitmapFromRows<PixelMono>(plane, stride, width, height) : Bitmap<PixelMono>(0, 1);
+        };
+        std::future<Bitmap<PixelMono>> glossmapFuture = std::async(std::launch::deferred, monoPlane, input->gloss, input->gloss_stride);
+        std::future<Bitmap<PixelMono>> heightmapFuture = std::async(std::launch::deferred, monoPlane, input->height_map, input->height_map_stride);
+
+        Bitmap<PixelRgba> normalmap = BitmapFromRows<PixelRgba>(input->normal_rgba, input->normal_stride, width, height);
+        Texture<PixelRgba> normalmapWithMips(width, height);
+        Texture<PixelMono> heightmapWithMips(width, height);
+        BuildBumpMips(opts.linear_gloss != 0, normalmap, glossmapFuture, heightmapFuture, normalmapWithMips, heightmapWithMips);
+
+        uint8_t* outBump = scast<uint8_t*>(bump_chain);
+        uint8_t* outBumpX = scast<uint8_t*>(bumpx_chain);
+        for (size_t i = 0, numMips = normalmapWithMips.mips.size(); i != numMips; ++i) {
+            const auto& normalMip = normalmapWithMips.mips[i];
+            const int quality = qualitySettings.ForMip(i, normalMip.width, normalMip.height);
+
+            double bumpTime = 0.0, bumpXTime = 0.0;
+            CompressBumpPair(quality, bc1Mode, scast<size_t>(opts.closed_loop_passes), normalMip, heightmapWithMips.mips[i],
+                             outBump, outBumpX, bumpTime, bumpXTime, scast<int>(i));
+
+            const size_t compressedMipSize = ((normalMip.width / 4) * (normalMip.height / 4)) * 16;
+            outBump += compressedMipSize;
+            outBumpX += compressedMipSize;
+        }
+    } catch (const std::bad_alloc&) {
+        return BUMPX_OUT_OF_MEMORY;
+    } catch (...) {
+        return BUMPX_INTERNAL_ERROR;
+    }
+
+    return BUMPX_OK;
+}
+
+extern "C" bumpx_result bumpx_unpack(uint32_t width, uint32_t height, const void* bump_blocks, const void* bumpx_blocks,
+                                     uint8_t* normal_rgb, uint8_t* gloss, uint8_t* height_map) {
+    if (!width || !height || !bump_blocks || !bumpx_blocks || !normal_rgb) {
+        return BUMPX_INVALID_ARGUMENT;
+    }
+
+    LogMuteScope muteScope;
+    try {
+        SelectLibraryKernels();
+
+        // the kernels always write all three, the ones the caller doesn't want go to scratch
+        std::vector<uint8_t> glossScratch(gloss ? 0 : size_t(width) * height);
+        std::vector<uint8_t> heightScratch(height_map ? 0 : size_t(width) * height);
+        DecodeBumpMip(scast<const uint8_t*>(bump_blocks), scast<const uint8_t*>(bumpx_blocks), width, height, normal_rgb,
+                      gloss ? gloss : glossScratch.data(), height_map ? height_map : heightScratch.data());
+    } catch (const std::bad_alloc&) {
+        return BUMPX_OUT_OF_MEMORY;
+    } catch (...) {
+        return BUMPX_INTERNAL_ERROR;
+    }
+
+    return BUMPX_OK;
+}
+
+
+// the whole command line tool, the CMake build puts this file into the bumpx_core library (BUMPX_CORE_LIBRARY)
+// and the main of the bumpx executable is in main.cpp, bumpx_bench links the same library and has its own main
+int BumpxMain(int argc, Char** argv) {
+    int returnCode = 0;
+
+    const auto startTime = std::chrono::steady_clock::now();
+
+    // global "--name:value" options are consumed here, so the modes never see them
+    String paramCpu, paramStats, paramTrace;
+    argc = scast<int>(std::distance(argv, std::remove_if(argv, argv + argc, [&paramCpu, &paramStats, &paramTrace](const Char* arg)->bool {
+        const String s = arg;
+        if (s == _T("--quiet")) {
+            GetLogSink().SetLevel(LogLevel::Error);
+            return true;
+        } else if (s == _T("--verbose")) {
+            GetLogSink().SetLevel(LogLevel::Verbose);
+            return true;
+        } else if (s == _T("--log:json")) {
+            GetLogSink().SetJson(true);
+            return true;
+        } else if (StrStartsWith(s, _T("--cpu:"))) {
+            paramCpu = s.substr(6);
+            return true;
+        } else if (s == _T("--stats") || StrStartsWith(s, _T("--stats:"))) {
+            gStatsEnabled = true;
+            paramStats = s.substr(std::min<size_t>(s.length(), 8));
+            return true;
+        } else if (s == _T("--counters")) {
+            gStatsEnabled = true;
+            gCountersEnabled = true;
+            return true;
+        } else if (StrStartsWith(s, _T("--trace:"))) {
+            gTraceEnabled = true;
+            paramTrace = s.substr(8);
+            return true;
+        }
+        return false;
+    })));
+
+    // before any thread is started, so they all inherit the counters
+    if (gCountersEnabled) {
+        String error;
+        if (!gHwCounters.Open(error)) {
+            Cout << _T("Hardware counters are not available (") << error << _T("), reporting the timings only") << std::endl;
+            gCountersEnabled = false;
+        }
+    }
+
+    // the main thread gets the first ring, so it is always "main" in the trace
+    if (gTraceEnabled) {
+        ThreadTraceRing();
+    }
+
+    // --stream keeps stdout for the results, all the messages go to stderr
+    if (std::find(argv, argv + argc, String(_T("--stream"))) != argv + argc) {
+#ifdef _WIN32
+        _setmode(_fileno(stdin), _O_BINARY);
+        _setmode(_fileno(stdout), _O_BINARY);
+#endif
+        gStreamOutput = std::cout.rdbuf();
+        GetLogSink().RedirectToStderr();
+    }
+
+    if (!SelectKernels(paramCpu)) {
+        return -1;
+    }
+
+    if (argc <= 1 || (argc > 1 && String(_T("-help")) == argv[1])) {
+        PrintUsage();
+    } else {
+        Cout << _T("Using ") << gKernels->name << _T(" cpu kernels") << std::endl;
+
+        if (String(_T("--probe")) == argv[1]) {
+            if (argc < 3) {
+                PrintUsage();
+                return -1;
+            }
+            Cout << _T("Selected mode - 3, probing.") << std::endl;
+            returnCode = ProbeTree(argv[2], (argc > 3) ? fs::path(argv[3]) : fs::path(argv[2]) / _T("bumpx_probe.txt"));
+        } else {
+            // detect the mode
+            bool isPackingMode = true;
+            if (argc >= 2 && argc <= 5) {
+                std::error_code errorCode;
+                if (StrEndsWith(argv[1], _T(".dds")) || fs::is_directory(argv[1], errorCode)) {
+                    isPackingMode = false;
+                }
+            }
+
+            Cout << _T("Selected mode - ") << (isPackingMode ? _T("1, packing.") : _T("2, unpacking.")) << std::endl;
+
+            returnCode = isPackingMode ? PackBump(argc, argv) : UnpackBump(argc, argv);
+        }
+
+        if (gStatsEnabled) {
+            const double totalWallMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startTime).count();
+            ReportStats(totalWallMs, paramStats);
+        }
+        if (gTraceEnabled) {
+            WriteTrace(paramTrace);
+        }
+    }
+
+    GetLogSink().Flush();
+
+    return returnCode;
+}
+
+#ifndef BUMPX_CORE_LIBRARY
+int Main(int argc, Char** argv) {
+    return BumpxMain(argc, argv);
 }
+#endif // BUMPX_CORE_LIBRARY
 
 
 // Changelog:
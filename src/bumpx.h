@@ -0,0 +1,70 @@
+/* C interface of bumpx for the tools that embed it (bumpx_core library of the CMake build, or bumpx.cpp compiled
+ * with BUMPX_CORE_LIBRARY), packs and unpacks in memory only: no files, no console output (not from the threads
+ * a call starts either), no global settings but the CPU kernels picked once by the first call, any number of calls
+ * may run at once on different threads
+ *
+ * a chain is all the DXT5 (BC3) mips of a texture one after another, mip 0 first, without the DDS header,
+ * exactly what follows the header in the bump.dds / bump#.dds bumpx writes
+ */
+
+#ifndef BUMPX_H
+#define BUMPX_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define BUMPX_API_VERSION 1
+
+typedef enum bumpx_result {
+    BUMPX_OK                    = 0,
+    BUMPX_INVALID_ARGUMENT      = 1,    /* null pointers, zero or not power of two sizes, bad options */
+    BUMPX_BUFFER_TOO_SMALL      = 2,    /* see bumpx_chain_size */
+    BUMPX_OUT_OF_MEMORY         = 3,
+    BUMPX_INTERNAL_ERROR        = 4
+} bumpx_result;
+
+typedef struct bumpx_pack_options {
+    int quality;                /* -q: 0 - fast (STB), 1 - medium (Squish), 2 - best (RGBCX), -1 - by the mip size */
+    int bc1_mode;               /* -b: 0 - ideal, 1 - nvidia, 2 - amd, 3 - idealround4, for quality 2 only */
+    int closed_loop_passes;     /* -j: 0 - the classic bump# of the bump error, 1 to 16 - the closed loop */
+    int linear_gloss;           /* -l:g, non-zero stores gloss linear instead of the exponent */
+} bumpx_pack_options;
+
+typedef struct bumpx_pack_input {
+    uint32_t        width;              /* powers of two */
+    uint32_t        height;
+    const uint8_t*  normal_rgba;        /* 4 bytes per pixel, alpha is ignored */
+    size_t          normal_stride;      /* bytes per row, 0 - width * 4 */
+    const uint8_t*  gloss;              /* 1 byte per pixel, null - no gloss */
+    size_t          gloss_stride;       /* 0 - width */
+    const uint8_t*  height_map;         /* 1 byte per pixel, null - neutral height */
+    size_t          height_map_stride;  /* 0 - width */
+} bumpx_pack_input;
+
+/* what bumpx does without any options: quality 2, nvidia bc1 mode, no closed loop, exponent gloss */
+bumpx_pack_options bumpx_default_pack_options(void);
+
+/* number of mips in the chains of a width x height texture, 0 if the size can't be packed */
+uint32_t bumpx_mip_count(uint32_t width, uint32_t height);
+/* bytes of a chain (each of bump and bump# has one) of a width x height texture, 0 if the size can't be packed */
+size_t bumpx_chain_size(uint32_t width, uint32_t height);
+
+/* packs the normalmap (+ gloss and height) into the bump and bump# chains, each buffer must hold bumpx_chain_size
+ * bytes, options may be null for the defaults */
+bumpx_result bumpx_pack(const bumpx_pack_input* input, const bumpx_pack_options* options,
+                        void* bump_chain, size_t bump_size, void* bumpx_chain, size_t bumpx_size);
+
+/* unpacks one width x height mip of bump and bump# (width / 4 * height / 4 blocks each, rounded up) back into
+ * normal_rgb (3 bytes per pixel), gloss and height_map (a byte per pixel each, both may be null), rows are tight */
+bumpx_result bumpx_unpack(uint32_t width, uint32_t height, const void* bump_blocks, const void* bumpx_blocks,
+                          uint8_t* normal_rgb, uint8_t* gloss, uint8_t* height_map);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* BUMPX_H */
@@ -0,0 +1,251 @@
+// the C++ side of bumpx.cpp that bumpx_bench is built on: the bench links the same bumpx_core as the bumpx tool
+// (build_nix.sh and build_win.bat compile bumpx.cpp with BUMPX_CORE_LIBRARY next to it), so the PGO training that
+// runs the bench profiles the very code that ships, the C interface for the tools embedding bumpx is bumpx.h,
+// everything below but the macros is in the bumpx namespace like the rest of bumpx.cpp
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <filesystem>
+#include <functional>
+#include <future>
+#include <ostream>
+
+#include "squish/squish.h"
+#include "kernels.h"
+
+namespace fs = std::filesystem;
+
+using BytesArray = std::vector<uint8_t>;
+
+#ifdef _WIN32
+using Char = wchar_t;
+using String = std::wstring;
+#define _T(str) L ## str
+#define ConsoleOut std::wcout
+#define ConsoleErr std::wcerr
+#define Main wmain
+#define ENABLE_NVTT3 1
+#else
+using Char = char;
+using String = std::string;
+#define _T(str) str
+#define ConsoleOut std::cout
+#define ConsoleErr std::cerr
+#define Main main
+#endif //  _WIN32
+
+#ifdef __GNUC__
+#define PACKED_STRUCT_BEGIN
+#define PACKED_STRUCT_END __attribute__((__packed__))
+#else
+#define PACKED_STRUCT_BEGIN __pragma(pack(push, 1))
+#define PACKED_STRUCT_END __pragma(pack(pop))
+#endif
+
+
+#define scast static_cast
+#define rcast reinterpret_cast
+
+namespace bumpx {
+
+enum class LogLevel : int {
+    Error   = 0,
+    Info    = 1,
+    Verbose = 2
+};
+
+// the calling thread's stream of a level, see LogSink in bumpx.cpp
+std::basic_ostream<Char>& LogStream(const LogLevel level);
+// set up once before any worker thread starts, messages above the level are dropped
+void SetLogLevel(const LogLevel level);
+
+// all the messages go through the log (see LogSink), std::endl only hands the line over to it
+#define Cout LogStream(LogLevel::Info)
+#define Cerr LogStream(LogLevel::Error)
+#define Cverbose LogStream(LogLevel::Verbose)
+
+static const size_t kMinMipSize = 4;    // 4 because the result is always BC compressed
+
+inline size_t Log2I(size_t v) {
+    size_t result = 0;
+    while (v >>= 1) {
+        ++result;
+    }
+    return result;
+}
+
+template <typename T>
+inline T Clamp(const T& v, const T& left, const T& right) {
+    return std::min(std::max(left, v), right);
+}
+
+constexpr size_t IsPowerOfTwo(const size_t v) {
+    return v != 0 && (v & (v - 1)) == 0;
+}
+
+
+inline bool StrEndsWith(const String& str, const String& ending) {
+    return str.size() >= ending.size() && str.compare(str.size() - ending.size(), ending.size(), ending) == 0;
+}
+
+inline String StrToLower(String str) {
+    std::transform(str.begin(), str.end(), str.begin(), [](const Char c) { return (c >= _T('A') && c <= _T('Z')) ? scast<Char>(c - _T('A') + _T('a')) : c; });
+    return str;
+}
+
+inline bool StrStartsWith(const String& str, const String& start) {
+    return str.size() >= start.size() && str.compare(0, start.size(), start) == 0;
+}
+
+inline std::vector<String> StrSplit(const String& str, const Char separator) {
+    std::vector<String> result;
+    size_t start = 0;
+    for (size_t pos = str.find(separator); pos != String::npos; pos = str.find(separator, start)) {
+        result.push_back(str.substr(start, pos - start));
+        start = pos + 1;
+    }
+    result.push_back(str.substr(start));
+    return result;
+}
+
+template <typename T>
+inline String ToString(const T& v) {
+#ifdef _WIN32
+    return std::to_wstring(v);
+#else
+    return std::to_string(v);
+#endif
+}
+
+// non-negative decimal integer, no exceptions unlike std::stoi
+inline bool StrToInt(const String& str, int& result) {
+    if (str.empty() || str.size() > 9) {
+        return false;
+    }
+
+    result = 0;
+    for (const Char c : str) {
+        if (c < _T('0') || c > _T('9')) {
+            return false;
+        }
+        result = result * 10 + scast<int>(c - _T('0'));
+    }
+    return true;
+}
+
+
+PACKED_STRUCT_BEGIN
+struct PixelMono {
+    uint8_t r;
+} PACKED_STRUCT_END;
+
+PACKED_STRUCT_BEGIN
+struct PixelRgb {
+    uint8_t r, g, b;
+} PACKED_STRUCT_END;
+
+PACKED_STRUCT_BEGIN
+struct PixelRgba {
+    uint8_t r, g, b, a;
+} PACKED_STRUCT_END;
+
+template <typename T>
+struct Bitmap {
+    using PixelType = T;
+
+    Bitmap() = delete;
+    Bitmap(const size_t w, const size_t h, const T& value = {}) : pixels(w * h, value), width(w), height(h) {}
+
+    inline bool empty() const { return pixels.empty(); }
+    inline void clear() { width = 0; height = 0; pixels.clear(); }
+
+    std::vector<PixelType>  pixels;
+    size_t                  width;
+    size_t                  height;
+};
+
+template <typename T>
+struct Texture {
+    using BitmapType = Bitmap<T>;
+
+    std::vector<BitmapType> mips;
+
+    Texture() = delete;
+    Texture(const size_t w, const size_t h) {
+        const size_t numMips = Log2I(std::max(w, h));
+        mips.reserve(numMips);
+
+        size_t mipW = w, mipH = h;
+        for (size_t i = 0; i < numMips; ++i) {
+            mips.push_back(BitmapType(mipW, mipH));
+
+            mipW = std::max<size_t>(mipW / 2, kMinMipSize);
+            mipH = std::max<size_t>(mipH / 2, kMinMipSize);
+        }
+    }
+};
+
+// --roundtrip: packs and unpacks in memory, measuring the quality of the reconstruction and the speed
+struct RoundtripStats {
+    size_t  numPixels = 0;
+    double  encodeMs = 0.0;
+    double  decodeMs = 0.0;
+    double  normalErrorSum = 0.0;   // degrees
+    double  normalErrorMax = 0.0;
+    double  glossSquaredError = 0.0;
+    double  heightSquaredError = 0.0;
+
+    void Add(const RoundtripStats& other) {
+        numPixels += other.numPixels;
+        encodeMs += other.encodeMs;
+        decodeMs += other.decodeMs;
+        normalErrorSum += other.normalErrorSum;
+        normalErrorMax = std::max(normalErrorMax, other.normalErrorMax);
+        glossSquaredError += other.glossSquaredError;
+        heightSquaredError += other.heightSquaredError;
+    }
+};
+
+// any BC3 encoder of a bitmap made of whole 4x4 blocks, see WithBC3Encoder
+using BC3EncodeFunc = std::function<void(const Bitmap<PixelRgba>&, void*)>;
+
+
+// selected once at startup and never changed afterwards, so safe to read from any thread
+extern const Kernels* gKernels;
+
+// cpuOverride is one of the kernels names ("sse2", "sse41", "avx2", "avx512") or empty / "auto" for autodetect
+bool SelectKernels(const String& cpuOverride);
+
+// instantiated for PixelMono and PixelRgba, an empty bitmap if the file can't be read or decoded
+template <typename T>
+Bitmap<T> LoadBitmap(const fs::path& path);
+// 8 bit grey (1), rgb (3) or rgba (4) image
+bool WritePng(const fs::path& path, const uint8_t* pixels, const size_t width, const size_t height, const size_t numChannels);
+
+// FNV-1a
+uint64_t HashBytes(const void* data, const size_t size, uint64_t hash = 0xcbf29ce484222325ull);
+
+void CompressBC3_STB(const Bitmap<PixelRgba>& bmp, void* outBlocks);
+void CompressBC3_Squish(const Bitmap<PixelRgba>& bmp, void* outBlocks, const int colourFit = squish::kColourIterativeClusterFit);
+void CompressBC3_RGBCX(const Bitmap<PixelRgba>& bmp, const BC1ApproxMode bc1Mode, void* outBlocks, const uint32_t level = kRGBCXMaxLevel);
+
+// steps 1-2 of the packing, see bumpx.cpp
+void BuildBumpMips(const bool linearGloss, Bitmap<PixelRgba>& normalmap,
+                   std::future<Bitmap<PixelMono>>& glossmapFuture, std::future<Bitmap<PixelMono>>& heightmapFuture,
+                   Texture<PixelRgba>& normalmapWithMips, Texture<PixelMono>& heightmapWithMips);
+// decompresses the compressed bump and stores the error * 2 with the height in bumpXMip, that's what the bump# encoder gets
+void MakeBumpXMip(const Bitmap<PixelRgba>& bumpMip, const Bitmap<PixelMono>& heightMip, const uint8_t* compressedBump, Bitmap<PixelRgba>& bumpXMip);
+// the classic bump and bump# compression with any BC3 encoder, instantiated for BC3EncodeFunc
+template <typename EncodeFunc>
+void CompressBumpPairWith(EncodeFunc encode, const Bitmap<PixelRgba>& bumpMip, const Bitmap<PixelMono>& heightMip,
+                          uint8_t* outBump, uint8_t* outBumpX, double& bumpTime, double& bumpXTime, const int mip);
+
+// decodes bump and bump# the same way UnpackBump does, minus the files, and adds the error against the source to stats
+void MeasureRoundtrip(const Bitmap<PixelRgba>& bumpMip, const Bitmap<PixelMono>& heightMip,
+                      const uint8_t* compressedBump, const uint8_t* compressedBumpX, RoundtripStats& stats);
+double PSNR(const double squaredError, const size_t numSamples);
+
+} // namespace bumpx
@@ -0,0 +1,555 @@
+// ISA specific build of the hot kernels
+// compile with -DBUMPX_ISA=<sse2|sse41|avx2|avx512|generic> and the matching code generation flags
+// (see build_nix.sh and build_win.bat), every variant lives in its own namespace so they can be linked together
+
+#ifndef BUMPX_ISA
+#error BUMPX_ISA must be defined when compiling kernels.cpp
+#endif
+
+#include "kernels.h"
+
+// the libraries below are included inside of a namespace, so all the standard headers
+// they use must be pulled in beforehand
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <assert.h>
+#include <limits.h>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+// the SIMD BC3 decoder needs pshufb, so it's only in SSSE3+ builds, the others use plain bcdec
+#if defined(__AVX2__) || defined(__SSSE3__)
+#define BUMPX_SIMD_BC3_DECODER 1
+#include <immintrin.h>
+#endif
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define BUMPX_SIMD_SSE2 1
+#include <emmintrin.h>
+#endif
+
+#define BUMPX_CONCAT_IMPL(a, b) a ## b
+#define BUMPX_CONCAT(a, b)      BUMPX_CONCAT_IMPL(a, b)
+#define BUMPX_STRINGIFY_IMPL(a) #a
+#define BUMPX_STRINGIFY(a)      BUMPX_STRINGIFY_IMPL(a)
+
+#define scast static_cast
+#define rcast reinterpret_cast
+
+namespace BUMPX_CONCAT(kernels_, BUMPX_ISA) {
+
+#define STB_IMAGE_RESIZE_IMPLEMENTATION
+#define STB_IMAGE_RESIZE_STATIC
+#define STBIR_DEFAULT_FILTER_DOWNSAMPLE  STBIR_FILTER_KAISER
+#define STBIR_ASSERT(boolval)
+#include "stb_image_resize.h"
+
+#define STB_DXT_IMPLEMENTATION
+#define STB_DXT_STATIC
+#include "stb_dxt.h"
+
+#define RGBCX_IMPLEMENTATION
+#include "rgbcx.h"
+
+// My own BCDEC library to decompress BC blocks :)
+#define BCDEC_IMPLEMENTATION
+#define BCDEC_STATIC
+#include "../bcdec/bcdec.h"
+
+
+template <typename T>
+static inline T Clamp(const T& v, const T& left, const T& right) {
+    return std::min(std::max(left, v), right);
+}
+
+static void Resize(const uint8_t* src, size_t srcW, size_t srcH, uint8_t* dst, size_t dstW, size_t dstH, size_t numChannels) {
+    stbir_resize_uint8(src, scast<int>(srcW), scast<int>(srcH), 0,
+                       dst, scast<int>(dstW), scast<int>(dstH), 0,
+                       scast<int>(numChannels));
+}
+
+template <size_t bpp>
+static void NormalizeNormalsT(uint8_t* pixels, const size_t numPixels) {
+    for (size_t i = 0; i < numPixels; ++i) {
+        uint8_t* p = pixels + i * bpp;
+        float x = Clamp(scast<float>(p[0]) / 255.0f, 0.0f, 1.0f) * 2.0f - 1.0f;
+        float y = Clamp(scast<float>(p[1]) / 255.0f, 0.0f, 1.0f) * 2.0f - 1.0f;
+        float z = Clamp(scast<float>(p[2]) / 255.0f, 0.0f, 1.0f) * 2.0f - 1.0f;
+        const float il = 1.0f / std::sqrt(x * x + y * y + z * z);
+        x *= il;
+        y *= il;
+        z *= il;
+        p[0] = scast<uint8_t>(Clamp((x * 0.5f + 0.5f) * 255.0f, 0.0f, 255.0f));
+        p[1] = scast<uint8_t>(Clamp((y * 0.5f + 0.5f) * 255.0f, 0.0f, 255.0f));
+        p[2] = scast<uint8_t>(Clamp((z * 0.5f + 0.5f) * 255.0f, 0.0f, 255.0f));
+        if constexpr (bpp == 4) {
+            p[3] = 0;
+        }
+    }
+}
+
+static void NormalizeNormals(uint8_t* pixels, size_t numPixels, size_t bytesPerPixel) {
+    if (bytesPerPixel == 4) {
+        NormalizeNormalsT<4>(pixels, numPixels);
+    } else {
+        NormalizeNormalsT<3>(pixels, numPixels);
+    }
+}
+
+template <bool hasGloss, bool linearGloss>
+static void AssembleBumpT(const uint8_t* normalRgba, const uint8_t* gloss, uint8_t* bumpRgba, const size_t numPixels) {
+    for (size_t i = 0; i < numPixels; ++i) {
+        const uint8_t* np = normalRgba + i * 4;
+        uint8_t* bp = bumpRgba + i * 4;
+        const uint8_t r = np[0], g = np[1], b = np[2];
+        // stalker stores gloss logarithmically to gain some precision for lower values (linearized back in shader),
+        // no gloss is zero either way
+        if constexpr (!hasGloss) {
+            bp[0] = 0;
+        } else if constexpr (linearGloss) {
+            bp[0] = gloss[i];
+        } else {
+            bp[0] = scast<uint8_t>(std::sqrt(scast<float>(gloss[i]) / 255.0f) * 255.0f);
+        }
+        // swizzle is weird, as NZ typically doesn't require much precision (you can even omit one)
+        // but meh, we must follow the original
+        bp[1] = b;
+        bp[2] = g;
+        bp[3] = r;
+    }
+}
+
+static void AssembleBump(const uint8_t* normalRgba, const uint8_t* gloss, uint8_t* bumpRgba, size_t numPixels, bool linearGloss) {
+    if (!gloss) {
+        AssembleBumpT<false, false>(normalRgba, gloss, bumpRgba, numPixels);
+    } else if (linearGloss) {
+        AssembleBumpT<true, true>(normalRgba, gloss, bumpRgba, numPixels);
+    } else {
+        AssembleBumpT<true, false>(normalRgba, gloss, bumpRgba, numPixels);
+    }
+}
+
+static void AssembleBumpX(const uint8_t* bumpRgba, const uint8_t* decodedRgba, const uint8_t* height, uint8_t* bumpXRgba, size_t numPixels) {
+    for (size_t i = 0; i < numPixels; ++i) {
+        const uint8_t* np = bumpRgba + i * 4;
+        const uint8_t* dp = decodedRgba + i * 4;
+        uint8_t* xp = bumpXRgba + i * 4;
+        // calculate the difference and un-swizzle back to RGB
+        const int ex = (scast<int>(np[3]) - scast<int>(dp[3])) * 2 + 128;
+        const int ey = (scast<int>(np[2]) - scast<int>(dp[2])) * 2 + 128;
+        const int ez = (scast<int>(np[1]) - scast<int>(dp[1])) * 2 + 128;
+        xp[0] = scast<uint8_t>(Clamp(ex, 0, 255));
+        xp[1] = scast<uint8_t>(Clamp(ey, 0, 255));
+        xp[2] = scast<uint8_t>(Clamp(ez, 0, 255));
+        xp[3] = height[i];
+    }
+}
+
+static inline void DisassembleBumpPixel(const uint8_t* bp, const uint8_t* xp, uint8_t* normalRgb, uint8_t* gloss, uint8_t* height) {
+    float nx = scast<float>(bp[3]) / 255.0f + (scast<float>(xp[0]) / 255.0f - 1.0f);
+    float ny = scast<float>(bp[2]) / 255.0f + (scast<float>(xp[1]) / 255.0f - 1.0f);
+    float nz = scast<float>(bp[1]) / 255.0f + (scast<float>(xp[2]) / 255.0f - 1.0f);
+
+    const float il = 1.0f / std::sqrt(nx * nx + ny * ny + nz * nz);
+    nx *= il;
+    ny *= il;
+    nz *= il;
+    normalRgb[0] = scast<uint8_t>(Clamp((nx * 0.5f + 0.5f) * 255.0f, 0.0f, 255.0f));
+    normalRgb[1] = scast<uint8_t>(Clamp((ny * 0.5f + 0.5f) * 255.0f, 0.0f, 255.0f));
+    normalRgb[2] = scast<uint8_t>(Clamp((nz * 0.5f + 0.5f) * 255.0f, 0.0f, 255.0f));
+    *gloss = bp[0];
+    *height = xp[3];
+}
+
+static void DisassembleBump(const uint8_t* bumpRgba, const uint8_t* bumpXRgba, uint8_t* normalRgb, uint8_t* gloss, uint8_t* height, size_t numPixels) {
+    size_t i = 0;
+#ifdef BUMPX_SIMD_SSE2
+    // 4 pixels at once, the same operations in the same order as the scalar version, so the results are identical
+    // (max(v, 0) picks 0 for NaN just like Clamp does)
+    const __m128i byteMask = _mm_set1_epi32(0xFF);
+    const __m128 one = _mm_set1_ps(1.0f), half = _mm_set1_ps(0.5f), c255 = _mm_set1_ps(255.0f), zero = _mm_setzero_ps();
+
+    auto channel = [&byteMask](const __m128i v, const int shift)->__m128 {
+        return _mm_cvtepi32_ps(_mm_and_si128(_mm_srli_epi32(v, shift), byteMask));
+    };
+    auto toByte = [&](const __m128 n)->__m128i {
+        const __m128 v = _mm_mul_ps(_mm_add_ps(_mm_mul_ps(n, half), half), c255);
+        return _mm_cvttps_epi32(_mm_min_ps(_mm_max_ps(v, zero), c255));
+    };
+
+    for (; i + 4 <= numPixels; i += 4) {
+        const __m128i b = _mm_loadu_si128(rcast<const __m128i*>(bumpRgba + i * 4));
+        const __m128i x = _mm_loadu_si128(rcast<const __m128i*>(bumpXRgba + i * 4));
+
+        __m128 nx = _mm_add_ps(_mm_div_ps(channel(b, 24), c255), _mm_sub_ps(_mm_div_ps(channel(x, 0), c255), one));
+        __m128 ny = _mm_add_ps(_mm_div_ps(channel(b, 16), c255), _mm_sub_ps(_mm_div_ps(channel(x, 8), c255), one));
+        __m128 nz = _mm_add_ps(_mm_div_ps(channel(b, 8), c255), _mm_sub_ps(_mm_div_ps(channel(x, 16), c255), one));
+
+        const __m128 sum = _mm_add_ps(_mm_add_ps(_mm_mul_ps(nx, nx), _mm_mul_ps(ny, ny)), _mm_mul_ps(nz, nz));
+        const __m128 il = _mm_div_ps(one, _mm_sqrt_ps(sum));
+        nx = _mm_mul_ps(nx, il);
+        ny = _mm_mul_ps(ny, il);
+        nz = _mm_mul_ps(nz, il);
+
+        alignas(16) uint32_t rgb[4];
+        _mm_store_si128(rcast<__m128i*>(rgb), _mm_or_si128(_mm_or_si128(toByte(nx), _mm_slli_epi32(toByte(ny), 8)), _mm_slli_epi32(toByte(nz), 16)));
+        for (size_t j = 0; j < 4; ++j) {
+            std::memcpy(normalRgb + (i + j) * 3, &rgb[j], 3);
+        }
+
+        const __m128i g = _mm_and_si128(b, byteMask);
+        const __m128i h = _mm_srli_epi32(x, 24);
+        const uint32_t gloss4 = scast<uint32_t>(_mm_cvtsi128_si32(_mm_packus_epi16(_mm_packs_epi32(g, g), g)));
+        const uint32_t height4 = scast<uint32_t>(_mm_cvtsi128_si32(_mm_packus_epi16(_mm_packs_epi32(h, h), h)));
+        std::memcpy(gloss + i, &gloss4, 4);
+        std::memcpy(height + i, &height4, 4);
+    }
+#endif
+    for (; i < numPixels; ++i) {
+        DisassembleBumpPixel(bumpRgba + i * 4, bumpXRgba + i * 4, normalRgb + i * 3, gloss + i, height + i);
+    }
+}
+
+enum PngFilter : uint8_t {
+    PngFilterNone = 0,
+    PngFilterSub,
+    PngFilterUp,
+    PngFilterAverage,
+    PngFilterPaeth,
+
+    PngFilterCount
+};
+
+// a - left, b - up, c - up left
+static inline uint8_t PaethPredictor(const int a, const int b, const int c) {
+    const int pa = std::abs(b - c), pb = std::abs(a - c), pc = std::abs(a + b - 2 * c);
+    return scast<uint8_t>((pa <= pb && pa <= pc) ? a : (pb <= pc ? b : c));
+}
+
+static inline uint8_t PngResidual(const PngFilter filter, const uint8_t x, const uint8_t a, const uint8_t b, const uint8_t c) {
+    switch (filter) {
+        case PngFilterSub:      return scast<uint8_t>(x - a);
+        case PngFilterUp:       return scast<uint8_t>(x - b);
+        case PngFilterAverage:  return scast<uint8_t>(x - ((a + b) >> 1));
+        case PngFilterPaeth:    return scast<uint8_t>(x - PaethPredictor(a, b, c));
+        default:                return x;
+    }
+}
+
+static inline uint64_t PngResidualCost(const uint8_t r) {
+    return scast<uint64_t>(r < 128 ? r : 256 - r);
+}
+
+#ifdef BUMPX_SIMD_SSE2
+// residuals of all the filters for 16 bytes, x - current, a - left, b - up, c - up left
+static inline void PngResiduals16(const __m128i x, const __m128i a, const __m128i b, const __m128i c, __m128i residuals[PngFilterCount]) {
+    const __m128i zero = _mm_setzero_si128();
+
+    // paeth in 16 bit lanes: pa = |b - c|, pb = |a - c|, pc = |a + b - 2c|
+    auto paeth = [](const __m128i a16, const __m128i b16, const __m128i c16)->__m128i {
+        const __m128i bc = _mm_sub_epi16(b16, c16), ac = _mm_sub_epi16(a16, c16);
+        const __m128i abc = _mm_add_epi16(bc, ac);
+        const __m128i pa = _mm_max_epi16(bc, _mm_sub_epi16(_mm_setzero_si128(), bc));
+        const __m128i pb = _mm_max_epi16(ac, _mm_sub_epi16(_mm_setzero_si128(), ac));
+        const __m128i pc = _mm_max_epi16(abc, _mm_sub_epi16(_mm_setzero_si128(), abc));
+        const __m128i pickA = _mm_andnot_si128(_mm_or_si128(_mm_cmpgt_epi16(pa, pb), _mm_cmpgt_epi16(pa, pc)), _mm_set1_epi16(-1));
+        const __m128i pickB = _mm_andnot_si128(_mm_cmpgt_epi16(pb, pc), _mm_set1_epi16(-1));
+        const __m128i bOrC = _mm_or_si128(_mm_and_si128(pickB, b16), _mm_andnot_si128(pickB, c16));
+        return _mm_or_si128(_mm_and_si128(pickA, a16), _mm_andnot_si128(pickA, bOrC));
+    };
+
+    const __m128i paethLo = paeth(_mm_unpacklo_epi8(a, zero), _mm_unpacklo_epi8(b, zero), _mm_unpacklo_epi8(c, zero));
+    const __m128i paethHi = paeth(_mm_unpackhi_epi8(a, zero), _mm_unpackhi_epi8(b, zero), _mm_unpackhi_epi8(c, zero));
+    // floor average, _mm_avg_epu8 rounds up
+    const __m128i average = _mm_sub_epi8(_mm_avg_epu8(a, b), _mm_and_si128(_mm_xor_si128(a, b), _mm_set1_epi8(1)));
+
+    residuals[PngFilterNone] = x;
+    residuals[PngFilterSub] = _mm_sub_epi8(x, a);
+    residuals[PngFilterUp] = _mm_sub_epi8(x, b);
+    residuals[PngFilterAverage] = _mm_sub_epi8(x, average);
+    residuals[PngFilterPaeth] = _mm_sub_epi8(x, _mm_packus_epi16(paethLo, paethHi));
+}
+
+// sum of absolute values of the bytes taken as signed, in two 64 bit lanes
+static inline __m128i PngResidualsCost16(const __m128i r) {
+    const __m128i absR = _mm_min_epu8(r, _mm_sub_epi8(_mm_setzero_si128(), r));
+    return _mm_sad_epu8(absR, _mm_setzero_si128());
+}
+#endif // BUMPX_SIMD_SSE2
+
+static void FilterPngRow(const uint8_t* row, const uint8_t* prevRow, size_t rowBytes, size_t bpp, uint8_t* out) {
+    uint64_t costs[PngFilterCount] = { 0 };
+
+    auto scalarCosts = [&](const size_t from, const size_t to) {
+        for (size_t i = from; i < to; ++i) {
+            const uint8_t a = i >= bpp ? row[i - bpp] : 0, c = i >= bpp ? prevRow[i - bpp] : 0;
+            for (int f = 0; f < PngFilterCount; ++f) {
+                costs[f] += PngResidualCost(PngResidual(scast<PngFilter>(f), row[i], a, prevRow[i], c));
+            }
+        }
+    };
+
+    size_t i = std::min(bpp, rowBytes);
+    scalarCosts(0, i);
+#ifdef BUMPX_SIMD_SSE2
+    __m128i costs16[PngFilterCount];
+    for (int f = 0; f < PngFilterCount; ++f) {
+        costs16[f] = _mm_setzero_si128();
+    }
+
+    for (; i + 16 <= rowBytes; i += 16) {
+        __m128i residuals[PngFilterCount];
+        PngResiduals16(_mm_loadu_si128(rcast<const __m128i*>(row + i)),
+                       _mm_loadu_si128(rcast<const __m128i*>(row + i - bpp)),
+                       _mm_loadu_si128(rcast<const __m128i*>(prevRow + i)),
+                       _mm_loadu_si128(rcast<const __m128i*>(prevRow + i - bpp)),
+                       residuals);
+        for (int f = 0; f < PngFilterCount; ++f) {
+            costs16[f] = _mm_add_epi64(costs16[f], PngResidualsCost16(residuals[f]));
+        }
+    }
+
+    for (int f = 0; f < PngFilterCount; ++f) {
+        alignas(16) uint64_t lanes[2];
+        _mm_store_si128(rcast<__m128i*>(lanes), costs16[f]);
+        costs[f] += lanes[0] + lanes[1];
+    }
+#endif
+    scalarCosts(i, rowBytes);
+
+    const PngFilter best = scast<PngFilter>(std::distance(costs, std::min_element(costs, costs + PngFilterCount)));
+
+    out[0] = best;
+    uint8_t* dst = out + 1;
+    i = std::min(bpp, rowBytes);
+    for (size_t j = 0; j < i; ++j) {
+        dst[j] = PngResidual(best, row[j], 0, prevRow[j], 0);
+    }
+#ifdef BUMPX_SIMD_SSE2
+    for (; i + 16 <= rowBytes; i += 16) {
+        __m128i residuals[PngFilterCount];
+        PngResiduals16(_mm_loadu_si128(rcast<const __m128i*>(row + i)),
+                       _mm_loadu_si128(rcast<const __m128i*>(row + i - bpp)),
+                       _mm_loadu_si128(rcast<const __m128i*>(prevRow + i)),
+                       _mm_loadu_si128(rcast<const __m128i*>(prevRow + i - bpp)),
+                       residuals);
+        _mm_storeu_si128(rcast<__m128i*>(dst + i), residuals[best]);
+    }
+#endif
+    for (; i < rowBytes; ++i) {
+        dst[i] = PngResidual(best, row[i], row[i - bpp], prevRow[i], prevRow[i - bpp]);
+    }
+}
+
+// one immutable rgbcx context per BC1 approximation mode, built on first use and then shared read-only by all threads
+struct RGBCXContexts {
+    RGBCXContexts() {
+        for (int i = 0; i < scast<int>(BC1ApproxMode::Count); ++i) {
+            rgbcx::init_context(contexts[i], scast<rgbcx::bc1_approx_mode>(i));
+        }
+    }
+
+    rgbcx::bc1_approx_context contexts[scast<size_t>(BC1ApproxMode::Count)];
+};
+
+static const rgbcx::bc1_approx_context& GetRGBCXContext(const BC1ApproxMode mode) {
+    static const RGBCXContexts sContexts;   // C++11 guarantees thread-safe initialization
+    return sContexts.contexts[scast<size_t>(mode)];
+}
+
+template <typename Encoder>
+static void CompressBC3Blocks(const uint8_t* rgba, size_t width, size_t height, void* outBlocks, Encoder encoder) {
+    uint8_t* dst = rcast<uint8_t*>(outBlocks);
+
+    uint8_t pixelsBlock[16 * 4] = { 0 };
+
+    for (size_t y = 0; y < height; y += 4) {
+        for (size_t x = 0; x < width; x += 4) {
+            const uint8_t* src = rgba + (y * width + x) * 4;
+            for (size_t i = 0; i < 4; ++i) {
+                std::memcpy(&pixelsBlock[i * 16], src, 16);
+                src += (width * 4);
+            }
+
+            encoder(dst, pixelsBlock);
+            dst += 16;
+        }
+    }
+}
+
+static void CompressBC3_STB(const uint8_t* rgba, size_t width, size_t height, void* outBlocks) {
+    CompressBC3Blocks(rgba, width, height, outBlocks, [](uint8_t* dst, const uint8_t* block) {
+        stb_compress_dxt_block(dst, block, 1, STB_DXT_HIGHQUAL);
+    });
+}
+
+static void CompressBC3_RGBCX(const uint8_t* rgba, size_t width, size_t height, void* outBlocks, BC1ApproxMode mode, uint32_t level) {
+    const rgbcx::bc1_approx_context& ctx = GetRGBCXContext(mode);
+    level = std::min<uint32_t>(level, rgbcx::MAX_LEVEL);
+    CompressBC3Blocks(rgba, width, height, outBlocks, [&ctx, level](uint8_t* dst, const uint8_t* block) {
+        rgbcx::encode_bc3(ctx, level, dst, block);
+    });
+}
+
+#ifdef BUMPX_SIMD_BC3_DECODER
+// selectors expansion tables for the SIMD BC3 decoder
+struct BC3DecodeTables {
+    BC3DecodeTables() {
+        for (int sel = 0; sel < 256; ++sel) {
+            for (int p = 0; p < 4; ++p) {
+                const int idx = (sel >> (2 * p)) & 3;
+                for (int c = 0; c < 4; ++c) {
+                    colorShuffle[sel][p * 4 + c] = scast<uint8_t>(idx * 4 + c);
+                }
+            }
+        }
+
+        for (int bits = 0; bits < 4096; ++bits) {
+            alphaIndices[bits] = 0;
+            for (int p = 0; p < 4; ++p) {
+                alphaIndices[bits] |= scast<uint32_t>((bits >> (3 * p)) & 7) << (8 * p);
+            }
+        }
+    }
+
+    alignas(16) uint8_t colorShuffle[256][16];  // selectors byte (a row of 4 pixels) -> pshufb mask picking the palette entries
+    uint32_t            alphaIndices[4096];     // 12 bits of alpha indices (a row of 4 pixels) -> 4 byte indices
+};
+
+static const BC3DecodeTables& GetBC3DecodeTables() {
+    static const BC3DecodeTables sTables;
+    return sTables;
+}
+
+// all the maths below matches bcdec bit to bit, divisions by 3, 5 and 7 are done with mulhi
+// by rounded up reciprocals which are exact for the ranges involved
+
+// 4 colors of the color block as RGBA bytes with zero alpha (alpha comes from the alpha block)
+static inline __m128i BC3ColorPalette(const uint8_t* colorBlock) {
+    uint16_t c0, c1;
+    std::memcpy(&c0, colorBlock, 2);
+    std::memcpy(&c1, colorBlock + 2, 2);
+
+    // 16 bit lanes: r0 g0 b0 0 r1 g1 b1 0
+    const __m128i c = _mm_setr_epi16(c0, c0, c0, 0, c1, c1, c1, 0);
+    const __m128i m = _mm_and_si128(c, _mm_setr_epi16(-2048, 0x07E0, 0x001F, 0, -2048, 0x07E0, 0x001F, 0));
+    const __m128i v = _mm_or_si128(_mm_mulhi_epu16(m, _mm_setr_epi16(32, 2048, 0, 0, 32, 2048, 0, 0)),
+                                   _mm_and_si128(m, _mm_setr_epi16(0, 0, -1, 0, 0, 0, -1, 0)));
+    // expand 565 to 888
+    const __m128i e = _mm_srli_epi16(_mm_add_epi16(_mm_mullo_epi16(v, _mm_setr_epi16(527, 259, 527, 0, 527, 259, 527, 0)),
+                                                   _mm_setr_epi16(23, 33, 23, 0, 23, 33, 23, 0)), 6);
+
+    // color_2 = (2 * color_0 + color_1 + 1) / 3, color_3 = (color_0 + 2 * color_1 + 1) / 3
+    const __m128i sum = _mm_add_epi16(_mm_add_epi16(_mm_unpacklo_epi64(e, e), _mm_unpackhi_epi64(e, e)),
+                                      _mm_add_epi16(e, _mm_set1_epi16(1)));
+    const __m128i interpolated = _mm_mulhi_epu16(sum, _mm_set1_epi16(21846));
+
+    return _mm_packus_epi16(e, interpolated);
+}
+
+// 16 alpha values of the alpha block, in pixels order
+static inline __m128i BC3AlphaValues(const uint8_t* alphaBlock, const BC3DecodeTables& tables) {
+    const __m128i a0 = _mm_set1_epi16(alphaBlock[0]);
+    const __m128i a1 = _mm_set1_epi16(alphaBlock[1]);
+
+    __m128i palette;
+    if (alphaBlock[0] > alphaBlock[1]) {
+        const __m128i n = _mm_add_epi16(_mm_add_epi16(_mm_mullo_epi16(a0, _mm_setr_epi16(7, 0, 6, 5, 4, 3, 2, 1)),
+                                                      _mm_mullo_epi16(a1, _mm_setr_epi16(0, 7, 1, 2, 3, 4, 5, 6))),
+                                        _mm_set1_epi16(1));
+        palette = _mm_mulhi_epu16(n, _mm_set1_epi16(9363));
+    } else {
+        const __m128i n = _mm_add_epi16(_mm_add_epi16(_mm_mullo_epi16(a0, _mm_setr_epi16(5, 0, 4, 3, 2, 1, 0, 0)),
+                                                      _mm_mullo_epi16(a1, _mm_setr_epi16(0, 5, 1, 2, 3, 4, 0, 0))),
+                                        _mm_set1_epi16(1));
+        palette = _mm_or_si128(_mm_mulhi_epu16(n, _mm_set1_epi16(13108)), _mm_setr_epi16(0, 0, 0, 0, 0, 0, 0, 255));
+    }
+    palette = _mm_packus_epi16(palette, palette);
+
+    uint64_t bits = 0;
+    std::memcpy(&bits, alphaBlock + 2, 6);
+    const __m128i indices = _mm_setr_epi32(scast<int>(tables.alphaIndices[bits & 0xFFF]),
+                                           scast<int>(tables.alphaIndices[(bits >> 12) & 0xFFF]),
+                                           scast<int>(tables.alphaIndices[(bits >> 24) & 0xFFF]),
+                                           scast<int>(tables.alphaIndices[(bits >> 36) & 0xFFF]));
+    return _mm_shuffle_epi8(palette, indices);
+}
+
+// moves the alpha values of row r to the alpha bytes of the 4 pixels
+static inline __m128i BC3AlphaRowSpread(const int row) {
+    const char b = scast<char>(row * 4), z = scast<char>(0x80);
+    return _mm_setr_epi8(z, z, z, b, z, z, z, scast<char>(b + 1), z, z, z, scast<char>(b + 2), z, z, z, scast<char>(b + 3));
+}
+
+static void DecompressBC3(const void* inputBlocks, uint8_t* rgba, size_t width, size_t height) {
+    const BC3DecodeTables& tables = GetBC3DecodeTables();
+    const uint8_t* src = rcast<const uint8_t*>(inputBlocks);
+
+    const __m128i spread[4] = { BC3AlphaRowSpread(0), BC3AlphaRowSpread(1), BC3AlphaRowSpread(2), BC3AlphaRowSpread(3) };
+
+    for (size_t y = 0; y < height; y += 4) {
+        size_t x = 0;
+#ifdef __AVX2__
+        // two neighbour blocks at once, their rows are contiguous in the output
+        for (; x + 8 <= width; x += 8, src += 32) {
+            const __m256i palette = _mm256_inserti128_si256(_mm256_castsi128_si256(BC3ColorPalette(src + 8)), BC3ColorPalette(src + 24), 1);
+            const __m256i alphas = _mm256_inserti128_si256(_mm256_castsi128_si256(BC3AlphaValues(src, tables)), BC3AlphaValues(src + 16, tables), 1);
+
+            uint8_t* dst = rgba + (y * width + x) * 4;
+            for (int row = 0; row < 4; ++row, dst += width * 4) {
+                const __m256i shuffle = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_load_si128(rcast<const __m128i*>(tables.colorShuffle[src[12 + row]]))),
+                                                                _mm_load_si128(rcast<const __m128i*>(tables.colorShuffle[src[28 + row]])), 1);
+                const __m256i colors = _mm256_shuffle_epi8(palette, shuffle);
+                const __m256i alpha = _mm256_shuffle_epi8(alphas, _mm256_broadcastsi128_si256(spread[row]));
+                _mm256_storeu_si256(rcast<__m256i*>(dst), _mm256_or_si256(colors, alpha));
+            }
+        }
+#endif
+        for (; x < width; x += 4, src += 16) {
+            const __m128i palette = BC3ColorPalette(src + 8);
+            const __m128i alphas = BC3AlphaValues(src, tables);
+
+            uint8_t* dst = rgba + (y * width + x) * 4;
+            for (int row = 0; row < 4; ++row, dst += width * 4) {
+                const __m128i colors = _mm_shuffle_epi8(palette, _mm_load_si128(rcast<const __m128i*>(tables.colorShuffle[src[12 + row]])));
+                const __m128i alpha = _mm_shuffle_epi8(alphas, spread[row]);
+                _mm_storeu_si128(rcast<__m128i*>(dst), _mm_or_si128(colors, alpha));
+            }
+        }
+    }
+}
+#else
+static void DecompressBC3(const void* inputBlocks, uint8_t* rgba, size_t width, size_t height) {
+    const uint8_t* src = rcast<const uint8_t*>(inputBlocks);
+
+    for (size_t y = 0; y < height; y += 4) {
+        for (size_t x = 0; x < width; x += 4) {
+            uint8_t* dst = rgba + (y * width + x) * 4;
+            bcdec_bc3(src, dst, scast<int>(width * 4));
+            src += BCDEC_BC3_BLOCK_SIZE;
+        }
+    }
+}
+#endif // BUMPX_SIMD_BC3_DECODER
+
+static const Kernels kKernels = {
+    BUMPX_STRINGIFY(BUMPX_ISA),
+    Resize,
+    NormalizeNormals,
+    AssembleBump,
+    AssembleBumpX,
+    DisassembleBump,
+    FilterPngRow,
+    CompressBC3_STB,
+    CompressBC3_RGBCX,
+    DecompressBC3
+};
+
+} // namespace kernels_BUMPX_ISA
+
+const Kernels* BUMPX_CONCAT(GetKernels_, BUMPX_ISA)() {
+    return &BUMPX_CONCAT(kernels_, BUMPX_ISA)::kKernels;
+}
@@ -0,0 +1,61 @@
+// hot pixel kernels of bumpx (mips, bump assembly, BC3 encoding/decoding)
+// kernels.cpp is compiled several times with different instruction sets, the best variant
+// for the running CPU is picked at startup (see SelectKernels in bumpx.cpp)
+
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define BUMPX_KERNELS_X86 1
+#endif
+
+// BC1 approximation modes of the RGBCX encoder, values match rgbcx::bc1_approx_mode
+enum class BC1ApproxMode : int {
+    Ideal       = 0,
+    NVidia      = 1,
+    AMD         = 2,
+    IdealRound4 = 3,
+
+    Count
+};
+
+// RGBCX encoder levels, the higher the level the slower and the better, values match rgbcx::MIN_LEVEL and rgbcx::MAX_LEVEL
+static const uint32_t kRGBCXMinLevel = 0;
+static const uint32_t kRGBCXMaxLevel = 18;
+
+struct Kernels {
+    const char* name;
+
+    // resamples src to dst using Kaiser filter
+    void (*Resize)(const uint8_t* src, size_t srcW, size_t srcH, uint8_t* dst, size_t dstW, size_t dstH, size_t numChannels);
+    // renormalizes unorm-encoded normals in place, bytesPerPixel must be 3 or 4
+    void (*NormalizeNormals)(uint8_t* pixels, size_t numPixels, size_t bytesPerPixel);
+
+    // normalRgba + gloss -> stalker bump (r - Gloss, g - NZ, b - NY, a - NX), gloss may be null for no gloss (zero)
+    void (*AssembleBump)(const uint8_t* normalRgba, const uint8_t* gloss, uint8_t* bumpRgba, size_t numPixels, bool linearGloss);
+    // original bump + decoded bump + height -> stalker bump# (rgb - error * 2, a - height)
+    void (*AssembleBumpX)(const uint8_t* bumpRgba, const uint8_t* decodedRgba, const uint8_t* height, uint8_t* bumpXRgba, size_t numPixels);
+    // the inverse: stalker bump + bump# -> normalmap (rgb), glossmap and heightmap, the normal is rebuilt the same way the game does
+    void (*DisassembleBump)(const uint8_t* bumpRgba, const uint8_t* bumpXRgba, uint8_t* normalRgb, uint8_t* gloss, uint8_t* height, size_t numPixels);
+
+    // applies the PNG filter with the minimal sum of absolute (signed) residuals to a row of rowBytes,
+    // prevRow must be zeroes for the first row, out gets the filter type followed by rowBytes of residuals
+    void (*FilterPngRow)(const uint8_t* row, const uint8_t* prevRow, size_t rowBytes, size_t bpp, uint8_t* out);
+
+    void (*CompressBC3_STB)(const uint8_t* rgba, size_t width, size_t height, void* outBlocks);
+    // thread-safe, any number of jobs with different modes may encode simultaneously
+    void (*CompressBC3_RGBCX)(const uint8_t* rgba, size_t width, size_t height, void* outBlocks, BC1ApproxMode mode, uint32_t level);
+    // bit exact with bcdec in all variants, height may be any multiple of 4 so bands of rows can go to different threads
+    void (*DecompressBC3)(const void* inputBlocks, uint8_t* rgba, size_t width, size_t height);
+};
+
+#ifdef BUMPX_KERNELS_X86
+const Kernels* GetKernels_sse2();
+const Kernels* GetKernels_sse41();
+const Kernels* GetKernels_avx2();
+const Kernels* GetKernels_avx512();
+#else
+const Kernels* GetKernels_generic();
+#endif
@@ -0,0 +1,15 @@
+// the bumpx executable of the CMake build, everything else is in the bumpx_core library (bumpx.cpp)
+
+#ifdef _WIN32
+int BumpxMain(int argc, wchar_t** argv);
+
+int wmain(int argc, wchar_t** argv) {
+    return BumpxMain(argc, argv);
+}
+#else
+int BumpxMain(int argc, char** argv);
+
+int main(int argc, char** argv) {
+    return BumpxMain(argc, argv);
+}
+#endif // _WIN32
@@ -18,6 +18,14 @@
 //
 // This function manipulates global state, so it is not thread safe. 
 // You can call it multiple times to change the global BC1 approximation mode.
+//
+// Alternatively build an immutable per-mode context once and pass it to the encoders, this doesn't touch the global mode
+// and several contexts (with different modes) can be used from any number of threads simultaneously:
+//
+// rgbcx::bc1_approx_context ctx;
+// rgbcx::init_context(ctx, rgbcx::bc1_approx_mode::cBC1NVidia);
+// rgbcx::encode_bc3(ctx, level, pDst, pPixels);
+//
 // Important: BC1/3 textures encoded using non-ideal BC1 approximation modes should only be sampled on parts from that vendor.
 // If you encode for AMD, average error on AMD parts will go down, but average error on NVidia parts will go up and vice versa.
 // If in doubt, encode in ideal BC1 mode.
@@ -94,8 +102,29 @@ namespace rgbcx
 	// Encode to cBC1Ideal unless you know the texture data will only be deployed or used on a specific vendor's GPU.
 	void init(bc1_approx_mode mode = bc1_approx_mode::cBC1Ideal);
 
+	struct bc1_match_entry
+	{
+		uint8_t m_hi;
+		uint8_t m_lo;
+		uint8_t m_e;
+	};
+
+	// Everything the BC1 encoder needs that depends on the approximation mode.
+	// Filled by init_context() and only read afterwards, so one context may be shared between threads.
+	struct bc1_approx_context
+	{
+		bc1_approx_mode m_mode;
+		bc1_match_entry m_match5_equals_1[256], m_match6_equals_1[256];
+		bc1_match_entry m_match5_half[256], m_match6_half[256];
+	};
+
+	// Initializes ctx for the given mode. Mode independent tables are built on the first call, this function is thread-safe
+	// as long as different threads initialize different contexts. Doesn't change the global mode set by init().
+	void init_context(bc1_approx_context& ctx, bc1_approx_mode mode = bc1_approx_mode::cBC1Ideal);
+
 	// Optimally encodes a solid color block to BC1 format.
 	void encode_bc1_solid_block(void* pDst, uint32_t fr, uint32_t fg, uint32_t fb, bool allow_3color);
+	void encode_bc1_solid_block(const bc1_approx_context& ctx, void* pDst, uint32_t fr, uint32_t fg, uint32_t fb, bool allow_3color);
 
 	// BC1 low-level API encoder flags. You can ignore this if you use the simple level API.
 	enum
@@ -178,12 +207,14 @@ namespace rgbcx
 	// No transparency supported, however if you set use_transparent_texels_for_black to true the encocer will use transparent selectors on very dark/black texels to reduce MSE. 
 	const uint32_t MIN_LEVEL = 0, MAX_LEVEL = 18;
 	void encode_bc1(uint32_t level, void* pDst, const uint8_t* pPixels, bool allow_3color, bool use_transparent_texels_for_black);
+	void encode_bc1(const bc1_approx_context& ctx, uint32_t level, void* pDst, const uint8_t* pPixels, bool allow_3color, bool use_transparent_texels_for_black);
 
 	// Low-level interface for BC1 encoding.
 	// Always returns a 4 color block, unless cEncodeBC1Use3ColorBlocksForBlackPixels or cEncodeBC1Use3ColorBlock flags are specified. 
 	// total_orderings_to_try controls the perf. vs. quality tradeoff on 4-color blocks when the cEncodeBC1UseLikelyTotalOrderings flag is used. It must range between [MIN_TOTAL_ORDERINGS, MAX_TOTAL_ORDERINGS4].
 	// total_orderings_to_try3 controls the perf. vs. quality tradeoff on 3-color bocks when the cEncodeBC1UseLikelyTotalOrderings and the cEncodeBC1Use3ColorBlocks flags are used. Valid range is [0,MAX_TOTAL_ORDERINGS3] (0=disabled).
 	void encode_bc1(void* pDst, const uint8_t* pPixels, uint32_t flags = 0, uint32_t total_orderings_to_try = DEFAULT_TOTAL_ORDERINGS_TO_TRY, uint32_t total_orderings_to_try3 = DEFAULT_TOTAL_ORDERINGS_TO_TRY3);
+	void encode_bc1(const bc1_approx_context& ctx, void* pDst, const uint8_t* pPixels, uint32_t flags = 0, uint32_t total_orderings_to_try = DEFAULT_TOTAL_ORDERINGS_TO_TRY, uint32_t total_orderings_to_try3 = DEFAULT_TOTAL_ORDERINGS_TO_TRY3);
 		
 	// Encodes a 4x4 block of RGBA pixels to BC3 format.
 	// There are two encode_bc3() functions. 
@@ -191,6 +222,8 @@ namespace rgbcx
 	// The second is a low-level version that allows fine control over BC1 encoding. 
 	void encode_bc3(uint32_t level, void* pDst, const uint8_t* pPixels);
 	void encode_bc3(void* pDst, const uint8_t* pPixels, uint32_t flags = 0, uint32_t total_orderings_to_try = DEFAULT_TOTAL_ORDERINGS_TO_TRY);
+	void encode_bc3(const bc1_approx_context& ctx, uint32_t level, void* pDst, const uint8_t* pPixels);
+	void encode_bc3(const bc1_approx_context& ctx, void* pDst, const uint8_t* pPixels, uint32_t flags = 0, uint32_t total_orderings_to_try = DEFAULT_TOTAL_ORDERINGS_TO_TRY);
 
 	// Encodes a single channel to BC4.
 	// stride is the source pixel stride in bytes.
@@ -1636,16 +1669,8 @@ namespace rgbcx
 		}
 	};
 
-	struct bc1_match_entry
-	{
-		uint8_t m_hi;
-		uint8_t m_lo;
-		uint8_t m_e;
-	};
-
-	static bc1_approx_mode g_bc1_approx_mode;
-	static bc1_match_entry g_bc1_match5_equals_1[256], g_bc1_match6_equals_1[256];
-	static bc1_match_entry g_bc1_match5_half[256], g_bc1_match6_half[256]; 
+	// the context used by the legacy (context-less) API, set by init()
+	static bc1_approx_context g_default_context;
 
 	static inline int scale_5_to_8(int v) { return (v << 3) | (v >> 2); }
 	static inline int scale_6_to_8(int v) { return (v << 2) | (v >> 4); }
@@ -1848,23 +1873,10 @@ namespace rgbcx
 	}
 
 	static bool g_initialized;
-		
-	void init(bc1_approx_mode mode)
-	{
-		g_bc1_approx_mode = mode;
-								
-		uint8_t bc1_expand5[32];
-		for (int i = 0; i < 32; i++)
-			bc1_expand5[i] = static_cast<uint8_t>((i << 3) | (i >> 2));
-		prepare_bc1_single_color_table(g_bc1_match5_equals_1, bc1_expand5, 32, mode);
-		prepare_bc1_single_color_table_half(g_bc1_match5_half, bc1_expand5, 32, mode);
-
-		uint8_t bc1_expand6[64];
-		for (int i = 0; i < 64; i++)
-			bc1_expand6[i] = static_cast<uint8_t>((i << 2) | (i >> 4));
-		prepare_bc1_single_color_table(g_bc1_match6_equals_1, bc1_expand6, 64, mode);
-		prepare_bc1_single_color_table_half(g_bc1_match6_half, bc1_expand6, 64, mode);
 
+	// Mode independent tables, built exactly once (see init_context()).
+	static bool init_shared_tables()
+	{
 		for (uint32_t i = 0; i < NUM_UNIQUE_TOTAL_ORDERINGS4; i++)
 		{
 			hist4 h;
@@ -1901,9 +1913,41 @@ namespace rgbcx
 		}
 
 		g_initialized = true;
+		return true;
+	}
+
+	void init_context(bc1_approx_context& ctx, bc1_approx_mode mode)
+	{
+		// thread-safe one time initialization (C++11 static local)
+		static const bool s_shared_tables_ready = init_shared_tables();
+		(void)s_shared_tables_ready;
+
+		ctx.m_mode = mode;
+
+		uint8_t bc1_expand5[32];
+		for (int i = 0; i < 32; i++)
+			bc1_expand5[i] = static_cast<uint8_t>((i << 3) | (i >> 2));
+		prepare_bc1_single_color_table(ctx.m_match5_equals_1, bc1_expand5, 32, mode);
+		prepare_bc1_single_color_table_half(ctx.m_match5_half, bc1_expand5, 32, mode);
+
+		uint8_t bc1_expand6[64];
+		for (int i = 0; i < 64; i++)
+			bc1_expand6[i] = static_cast<uint8_t>((i << 2) | (i >> 4));
+		prepare_bc1_single_color_table(ctx.m_match6_equals_1, bc1_expand6, 64, mode);
+		prepare_bc1_single_color_table_half(ctx.m_match6_half, bc1_expand6, 64, mode);
+	}
+
+	void init(bc1_approx_mode mode)
+	{
+		init_context(g_default_context, mode);
+	}
+
+	void encode_bc1_solid_block(void* pDst, uint32_t fr, uint32_t fg, uint32_t fb, bool allow_3color)
+	{
+		encode_bc1_solid_block(g_default_context, pDst, fr, fg, fb, allow_3color);
 	}
 	
-	void encode_bc1_solid_block(void* pDst, uint32_t fr, uint32_t fg, uint32_t fb, bool allow_3color) 
+	void encode_bc1_solid_block(const bc1_approx_context& ctx, void* pDst, uint32_t fr, uint32_t fg, uint32_t fb, bool allow_3color) 
 	{
 		bc1_block* pDst_block = static_cast<bc1_block*>(pDst);
 
@@ -1912,13 +1956,13 @@ namespace rgbcx
 
 		if (allow_3color)
 		{
-			const uint32_t err4 = g_bc1_match5_equals_1[fr].m_e + g_bc1_match6_equals_1[fg].m_e + g_bc1_match5_equals_1[fb].m_e;
-			const uint32_t err3 = g_bc1_match5_half[fr].m_e + g_bc1_match6_half[fg].m_e + g_bc1_match5_half[fb].m_e;
+			const uint32_t err4 = ctx.m_match5_equals_1[fr].m_e + ctx.m_match6_equals_1[fg].m_e + ctx.m_match5_equals_1[fb].m_e;
+			const uint32_t err3 = ctx.m_match5_half[fr].m_e + ctx.m_match6_half[fg].m_e + ctx.m_match5_half[fb].m_e;
 
 			if (err3 < err4)
 			{
-				max16 = (g_bc1_match5_half[fr].m_hi << 11) | (g_bc1_match6_half[fg].m_hi << 5) | g_bc1_match5_half[fb].m_hi;
-				min16 = (g_bc1_match5_half[fr].m_lo << 11) | (g_bc1_match6_half[fg].m_lo << 5) | g_bc1_match5_half[fb].m_lo;
+				max16 = (ctx.m_match5_half[fr].m_hi << 11) | (ctx.m_match6_half[fg].m_hi << 5) | ctx.m_match5_half[fb].m_hi;
+				min16 = (ctx.m_match5_half[fr].m_lo << 11) | (ctx.m_match6_half[fg].m_lo << 5) | ctx.m_match5_half[fb].m_lo;
 
 				if (max16 > min16)
 					std::swap(max16, min16);
@@ -1927,8 +1971,8 @@ namespace rgbcx
 
 		if (max16 == -1)
 		{
-			max16 = (g_bc1_match5_equals_1[fr].m_hi << 11) | (g_bc1_match6_equals_1[fg].m_hi << 5) | g_bc1_match5_equals_1[fb].m_hi;
-			min16 = (g_bc1_match5_equals_1[fr].m_lo << 11) | (g_bc1_match6_equals_1[fg].m_lo << 5) | g_bc1_match5_equals_1[fb].m_lo;
+			max16 = (ctx.m_match5_equals_1[fr].m_hi << 11) | (ctx.m_match6_equals_1[fg].m_hi << 5) | ctx.m_match5_equals_1[fb].m_hi;
+			min16 = (ctx.m_match5_equals_1[fr].m_lo << 11) | (ctx.m_match6_equals_1[fg].m_lo << 5) | ctx.m_match5_equals_1[fb].m_lo;
 
 			if (min16 == max16)
 			{
@@ -2143,22 +2187,22 @@ namespace rgbcx
 		return true;
 	}
 
-	static inline void bc1_get_block_colors4(uint32_t block_r[4], uint32_t block_g[4], uint32_t block_b[4], uint32_t lr, uint32_t lg, uint32_t lb, uint32_t hr, uint32_t hg, uint32_t hb)
+	static inline void bc1_get_block_colors4(const bc1_approx_context& ctx, uint32_t block_r[4], uint32_t block_g[4], uint32_t block_b[4], uint32_t lr, uint32_t lg, uint32_t lb, uint32_t hr, uint32_t hg, uint32_t hb)
 	{
 		block_r[0] = (lr << 3) | (lr >> 2); block_g[0] = (lg << 2) | (lg >> 4);	block_b[0] = (lb << 3) | (lb >> 2);
 		block_r[3] = (hr << 3) | (hr >> 2);	block_g[3] = (hg << 2) | (hg >> 4);	block_b[3] = (hb << 3) | (hb >> 2);
 
-		if (g_bc1_approx_mode == bc1_approx_mode::cBC1Ideal)
+		if (ctx.m_mode == bc1_approx_mode::cBC1Ideal)
 		{
 			block_r[1] = (block_r[0] * 2 + block_r[3]) / 3;	block_g[1] = (block_g[0] * 2 + block_g[3]) / 3;	block_b[1] = (block_b[0] * 2 + block_b[3]) / 3;
 			block_r[2] = (block_r[3] * 2 + block_r[0]) / 3;	block_g[2] = (block_g[3] * 2 + block_g[0]) / 3;	block_b[2] = (block_b[3] * 2 + block_b[0]) / 3;
 		}
-		else if (g_bc1_approx_mode == bc1_approx_mode::cBC1IdealRound4)
+		else if (ctx.m_mode == bc1_approx_mode::cBC1IdealRound4)
 		{
 			block_r[1] = (block_r[0] * 2 + block_r[3] + 1) / 3;	block_g[1] = (block_g[0] * 2 + block_g[3] + 1) / 3;	block_b[1] = (block_b[0] * 2 + block_b[3] + 1) / 3;
 			block_r[2] = (block_r[3] * 2 + block_r[0] + 1) / 3;	block_g[2] = (block_g[3] * 2 + block_g[0] + 1) / 3;	block_b[2] = (block_b[3] * 2 + block_b[0] + 1) / 3;
 		}
-		else if (g_bc1_approx_mode == bc1_approx_mode::cBC1AMD)
+		else if (ctx.m_mode == bc1_approx_mode::cBC1AMD)
 		{
 			block_r[1] = interp_5_6_amd(block_r[0], block_r[3]); block_g[1] = interp_5_6_amd(block_g[0], block_g[3]); block_b[1] = interp_5_6_amd(block_b[0], block_b[3]);
 			block_r[2] = interp_5_6_amd(block_r[3], block_r[0]); block_g[2] = interp_5_6_amd(block_g[3], block_g[0]); block_b[2] = interp_5_6_amd(block_b[3], block_b[0]);
@@ -2170,16 +2214,16 @@ namespace rgbcx
 		}
 	}
 
-	static inline void bc1_get_block_colors3(uint32_t block_r[3], uint32_t block_g[3], uint32_t block_b[3], uint32_t lr, uint32_t lg, uint32_t lb, uint32_t hr, uint32_t hg, uint32_t hb)
+	static inline void bc1_get_block_colors3(const bc1_approx_context& ctx, uint32_t block_r[3], uint32_t block_g[3], uint32_t block_b[3], uint32_t lr, uint32_t lg, uint32_t lb, uint32_t hr, uint32_t hg, uint32_t hb)
 	{
 		block_r[0] = (lr << 3) | (lr >> 2); block_g[0] = (lg << 2) | (lg >> 4);	block_b[0] = (lb << 3) | (lb >> 2);
 		block_r[1] = (hr << 3) | (hr >> 2);	block_g[1] = (hg << 2) | (hg >> 4);	block_b[1] = (hb << 3) | (hb >> 2);
 
-		if ((g_bc1_approx_mode == bc1_approx_mode::cBC1Ideal) || (g_bc1_approx_mode == bc1_approx_mode::cBC1IdealRound4))
+		if ((ctx.m_mode == bc1_approx_mode::cBC1Ideal) || (ctx.m_mode == bc1_approx_mode::cBC1IdealRound4))
 		{
 			block_r[2] = (block_r[0] + block_r[1]) / 2; block_g[2] = (block_g[0] + block_g[1]) / 2; block_b[2] = (block_b[0] + block_b[1]) / 2;
 		}
-		else if (g_bc1_approx_mode == bc1_approx_mode::cBC1AMD)
+		else if (ctx.m_mode == bc1_approx_mode::cBC1AMD)
 		{
 			block_r[2] = interp_half_5_6_amd(block_r[0], block_r[1]); block_g[2] = interp_half_5_6_amd(block_g[0], block_g[1]); block_b[2] = interp_half_5_6_amd(block_b[0], block_b[1]);
 		}
@@ -2189,10 +2233,10 @@ namespace rgbcx
 		}
 	}
 
-	static inline void bc1_find_sels4_noerr(const color32* pSrc_pixels, uint32_t lr, uint32_t lg, uint32_t lb, uint32_t hr, uint32_t hg, uint32_t hb, uint8_t sels[16])
+	static inline void bc1_find_sels4_noerr(const bc1_approx_context& ctx, const color32* pSrc_pixels, uint32_t lr, uint32_t lg, uint32_t lb, uint32_t hr, uint32_t hg, uint32_t hb, uint8_t sels[16])
 	{
 		uint32_t block_r[4], block_g[4], block_b[4];
-		bc1_get_block_colors4(block_r, block_g, block_b, lr, lg, lb, hr, hg, hb);
+		bc1_get_block_colors4(ctx, block_r, block_g, block_b, lr, lg, lb, hr, hg, hb);
 
 		int ar = block_r[3] - block_r[0], ag = block_g[3] - block_g[0], ab = block_b[3] - block_b[0];
 
@@ -2220,10 +2264,10 @@ namespace rgbcx
 		}
 	}
 
-	static inline uint32_t bc1_find_sels4_fasterr(const color32* pSrc_pixels, uint32_t lr, uint32_t lg, uint32_t lb, uint32_t hr, uint32_t hg, uint32_t hb, uint8_t sels[16], uint32_t cur_err)
+	static inline uint32_t bc1_find_sels4_fasterr(const bc1_approx_context& ctx, const color32* pSrc_pixels, uint32_t lr, uint32_t lg, uint32_t lb, uint32_t hr, uint32_t hg, uint32_t hb, uint8_t sels[16], uint32_t cur_err)
 	{
 		uint32_t block_r[4], block_g[4], block_b[4];
-		bc1_get_block_colors4(block_r, block_g, block_b, lr, lg, lb, hr, hg, hb);
+		bc1_get_block_colors4(ctx, block_r, block_g, block_b, lr, lg, lb, hr, hg, hb);
 				
 		int ar = block_r[3] - block_r[0], ag = block_g[3] - block_g[0], ab = block_b[3] - block_b[0];
 
@@ -2268,10 +2312,10 @@ namespace rgbcx
 		return total_err;
 	}
 	
-	static inline uint32_t bc1_find_sels4_check2_err(const color32* pSrc_pixels, uint32_t lr, uint32_t lg, uint32_t lb, uint32_t hr, uint32_t hg, uint32_t hb, uint8_t sels[16], uint32_t cur_err)
+	static inline uint32_t bc1_find_sels4_check2_err(const bc1_approx_context& ctx, const color32* pSrc_pixels, uint32_t lr, uint32_t lg, uint32_t lb, uint32_t hr, uint32_t hg, uint32_t hb, uint8_t sels[16], uint32_t cur_err)
 	{
 		uint32_t block_r[4], block_g[4], block_b[4];
-		bc1_get_block_colors4(block_r, block_g, block_b, lr, lg, lb, hr, hg, hb);
+		bc1_get_block_colors4(ctx, block_r, block_g, block_b, lr, lg, lb, hr, hg, hb);
 				
 		int dr = block_r[3] - block_r[0], dg = block_g[3] - block_g[0], db = block_b[3] - block_b[0];
 
@@ -2315,10 +2359,10 @@ namespace rgbcx
 		return total_err;
 	}
 
-	static inline uint32_t bc1_find_sels4_fullerr(const color32* pSrc_pixels, uint32_t lr, uint32_t lg, uint32_t lb, uint32_t hr, uint32_t hg, uint32_t hb, uint8_t sels[16], uint32_t cur_err)
+	static inline uint32_t bc1_find_sels4_fullerr(const bc1_approx_context& ctx, const color32* pSrc_pixels, uint32_t lr, uint32_t lg, uint32_t lb, uint32_t hr, uint32_t hg, uint32_t hb, uint8_t sels[16], uint32_t cur_err)
 	{
 		uint32_t block_r[4], block_g[4], block_b[4];
-		bc1_get_block_colors4(block_r, block_g, block_b, lr, lg, lb, hr, hg, hb);
+		bc1_get_block_colors4(ctx, block_r, block_g, block_b, lr, lg, lb, hr, hg, hb);
 				
 		uint32_t total_err = 0;
 
@@ -2351,24 +2395,24 @@ namespace rgbcx
 		return total_err;
 	}
 
-	static inline uint32_t bc1_find_sels4(uint32_t flags, const color32* pSrc_pixels, uint32_t lr, uint32_t lg, uint32_t lb, uint32_t hr, uint32_t hg, uint32_t hb, uint8_t sels[16], uint32_t cur_err)
+	static inline uint32_t bc1_find_sels4(const bc1_approx_context& ctx, uint32_t flags, const color32* pSrc_pixels, uint32_t lr, uint32_t lg, uint32_t lb, uint32_t hr, uint32_t hg, uint32_t hb, uint8_t sels[16], uint32_t cur_err)
 	{
 		uint32_t err;
 
 		if (flags & cEncodeBC1UseFasterMSEEval)
-			err = bc1_find_sels4_fasterr(pSrc_pixels, lr, lg, lb, hr, hg, hb, sels, cur_err);
+			err = bc1_find_sels4_fasterr(ctx, pSrc_pixels, lr, lg, lb, hr, hg, hb, sels, cur_err);
 		else if (flags & cEncodeBC1UseFullMSEEval)
-			err = bc1_find_sels4_fullerr(pSrc_pixels, lr, lg, lb, hr, hg, hb, sels, cur_err);
+			err = bc1_find_sels4_fullerr(ctx, pSrc_pixels, lr, lg, lb, hr, hg, hb, sels, cur_err);
 		else
-			err = bc1_find_sels4_check2_err(pSrc_pixels, lr, lg, lb, hr, hg, hb, sels, cur_err);
+			err = bc1_find_sels4_check2_err(ctx, pSrc_pixels, lr, lg, lb, hr, hg, hb, sels, cur_err);
 
 		return err;
 	}
 		
-	static inline uint32_t bc1_find_sels3_fullerr(bool use_black, const color32* pSrc_pixels, uint32_t lr, uint32_t lg, uint32_t lb, uint32_t hr, uint32_t hg, uint32_t hb, uint8_t sels[16], uint32_t cur_err)
+	static inline uint32_t bc1_find_sels3_fullerr(const bc1_approx_context& ctx, bool use_black, const color32* pSrc_pixels, uint32_t lr, uint32_t lg, uint32_t lb, uint32_t hr, uint32_t hg, uint32_t hb, uint8_t sels[16], uint32_t cur_err)
 	{
 		uint32_t block_r[3], block_g[3], block_b[3];
-		bc1_get_block_colors3(block_r, block_g, block_b, lr, lg, lb, hr, hg, hb);
+		bc1_get_block_colors3(ctx, block_r, block_g, block_b, lr, lg, lb, hr, hg, hb);
 								
 		uint32_t total_err = 0;
 
@@ -2569,7 +2613,7 @@ namespace rgbcx
 		bool m_3color;
 	};
 	
-	static bool try_3color_block_useblack(const color32* pSrc_pixels, uint32_t flags, uint32_t &cur_err, bc1_encode_results &results)
+	static bool try_3color_block_useblack(const bc1_approx_context& ctx, const color32* pSrc_pixels, uint32_t flags, uint32_t &cur_err, bc1_encode_results &results)
 	{
 		int total_r = 0, total_g = 0, total_b = 0;
 		int max_r = 0, max_g = 0, max_b = 0;
@@ -2682,7 +2726,7 @@ namespace rgbcx
 		int hb = to_5(pSrc_pixels[high_c].b);
 
 		uint8_t trial_sels[16];
-		uint32_t trial_err = bc1_find_sels3_fullerr(true, pSrc_pixels, lr, lg, lb, hr, hg, hb, trial_sels, UINT32_MAX);
+		uint32_t trial_err = bc1_find_sels3_fullerr(ctx, true, pSrc_pixels, lr, lg, lb, hr, hg, hb, trial_sels, UINT32_MAX);
 
 		if (trial_err)
 		{
@@ -2693,13 +2737,13 @@ namespace rgbcx
 				int lr2, lg2, lb2, hr2, hg2, hb2;
 				if (!compute_least_squares_endpoints3_rgb(true, pSrc_pixels, trial_sels, &xl, &xh))
 				{
-					lr2 = g_bc1_match5_half[avg_r].m_hi;
-					lg2 = g_bc1_match6_half[avg_g].m_hi;
-					lb2 = g_bc1_match5_half[avg_b].m_hi;
+					lr2 = ctx.m_match5_half[avg_r].m_hi;
+					lg2 = ctx.m_match6_half[avg_g].m_hi;
+					lb2 = ctx.m_match5_half[avg_b].m_hi;
 
-					hr2 = g_bc1_match5_half[avg_r].m_lo;
-					hg2 = g_bc1_match6_half[avg_g].m_lo;
-					hb2 = g_bc1_match5_half[avg_b].m_lo;
+					hr2 = ctx.m_match5_half[avg_r].m_lo;
+					hg2 = ctx.m_match6_half[avg_g].m_lo;
+					hb2 = ctx.m_match5_half[avg_b].m_lo;
 				}
 				else
 				{
@@ -2710,7 +2754,7 @@ namespace rgbcx
 					break;
 								
 				uint8_t trial_sels2[16];
-				uint32_t trial_err2 = bc1_find_sels3_fullerr(true, pSrc_pixels, lr2, lg2, lb2, hr2, hg2, hb2, trial_sels2, trial_err);
+				uint32_t trial_err2 = bc1_find_sels3_fullerr(ctx, true, pSrc_pixels, lr2, lg2, lb2, hr2, hg2, hb2, trial_sels2, trial_err);
 												
 				if (trial_err2 < trial_err)
 				{
@@ -2743,12 +2787,12 @@ namespace rgbcx
 		return false;
 	}
 
-	static bool try_3color_block(const color32* pSrc_pixels, uint32_t flags, uint32_t &cur_err, 
+	static bool try_3color_block(const bc1_approx_context& ctx, const color32* pSrc_pixels, uint32_t flags, uint32_t &cur_err, 
 		int avg_r, int avg_g, int avg_b, int lr, int lg, int lb, int hr, int hg, int hb, int total_r, int total_g, int total_b, uint32_t total_orderings_to_try,
 		bc1_encode_results &results)
 	{
 		uint8_t trial_sels[16];
-		uint32_t trial_err = bc1_find_sels3_fullerr(false, pSrc_pixels, lr, lg, lb, hr, hg, hb, trial_sels, UINT32_MAX);
+		uint32_t trial_err = bc1_find_sels3_fullerr(ctx, false, pSrc_pixels, lr, lg, lb, hr, hg, hb, trial_sels, UINT32_MAX);
 
 		if (trial_err)
 		{
@@ -2759,13 +2803,13 @@ namespace rgbcx
 				int lr2, lg2, lb2, hr2, hg2, hb2;
 				if (!compute_least_squares_endpoints3_rgb(false, pSrc_pixels, trial_sels, &xl, &xh))
 				{
-					lr2 = g_bc1_match5_half[avg_r].m_hi;
-					lg2 = g_bc1_match6_half[avg_g].m_hi;
-					lb2 = g_bc1_match5_half[avg_b].m_hi;
+					lr2 = ctx.m_match5_half[avg_r].m_hi;
+					lg2 = ctx.m_match6_half[avg_g].m_hi;
+					lb2 = ctx.m_match5_half[avg_b].m_hi;
 
-					hr2 = g_bc1_match5_half[avg_r].m_lo;
-					hg2 = g_bc1_match6_half[avg_g].m_lo;
-					hb2 = g_bc1_match5_half[avg_b].m_lo;
+					hr2 = ctx.m_match5_half[avg_r].m_lo;
+					hg2 = ctx.m_match6_half[avg_g].m_lo;
+					hb2 = ctx.m_match5_half[avg_b].m_lo;
 				}
 				else
 				{
@@ -2776,7 +2820,7 @@ namespace rgbcx
 					break;
 												
 				uint8_t trial_sels2[16];
-				uint32_t trial_err2 = bc1_find_sels3_fullerr(false, pSrc_pixels, lr2, lg2, lb2, hr2, hg2, hb2, trial_sels2, trial_err);
+				uint32_t trial_err2 = bc1_find_sels3_fullerr(ctx, false, pSrc_pixels, lr2, lg2, lb2, hr2, hg2, hb2, trial_sels2, trial_err);
 												
 				if (trial_err2 < trial_err)
 				{
@@ -2850,13 +2894,13 @@ namespace rgbcx
 
 				if ((s == TOTAL_ORDER_3_0_16) || (s == TOTAL_ORDER_3_1_16) || (s == TOTAL_ORDER_3_2_16))
 				{
-					trial_lr = g_bc1_match5_half[avg_r].m_hi;
-					trial_lg = g_bc1_match6_half[avg_g].m_hi;
-					trial_lb = g_bc1_match5_half[avg_b].m_hi;
+					trial_lr = ctx.m_match5_half[avg_r].m_hi;
+					trial_lg = ctx.m_match6_half[avg_g].m_hi;
+					trial_lb = ctx.m_match5_half[avg_b].m_hi;
 
-					trial_hr = g_bc1_match5_half[avg_r].m_lo;
-					trial_hg = g_bc1_match6_half[avg_g].m_lo;
-					trial_hb = g_bc1_match5_half[avg_b].m_lo;
+					trial_hr = ctx.m_match5_half[avg_r].m_lo;
+					trial_hg = ctx.m_match6_half[avg_g].m_lo;
+					trial_hb = ctx.m_match5_half[avg_b].m_lo;
 				}
 				else
 				{
@@ -2867,7 +2911,7 @@ namespace rgbcx
 				}
 
 				uint8_t trial_sels2[16];
-				uint32_t trial_err2 = bc1_find_sels3_fullerr(false, pSrc_pixels, trial_lr, trial_lg, trial_lb, trial_hr, trial_hg, trial_hb, trial_sels2, UINT32_MAX);
+				uint32_t trial_err2 = bc1_find_sels3_fullerr(ctx, false, pSrc_pixels, trial_lr, trial_lg, trial_lb, trial_hr, trial_hg, trial_hb, trial_sels2, UINT32_MAX);
 				
 				if (trial_err2 < trial_err)
 				{
@@ -2906,7 +2950,7 @@ namespace rgbcx
 		return false;
 	}
 
-	void encode_bc1(uint32_t level, void* pDst, const uint8_t* pPixels, bool allow_3color, bool allow_transparent_texels_for_black)
+	void encode_bc1(const bc1_approx_context& ctx, uint32_t level, void* pDst, const uint8_t* pPixels, bool allow_3color, bool allow_transparent_texels_for_black)
 	{
 		uint32_t flags = 0, total_orderings4 = 1, total_orderings3 = 1;
 
@@ -3024,7 +3068,12 @@ namespace rgbcx
 			break;
 		}
 
-		encode_bc1(pDst, pPixels, flags, total_orderings4, total_orderings3);
+		encode_bc1(ctx, pDst, pPixels, flags, total_orderings4, total_orderings3);
+	}
+
+	void encode_bc1(uint32_t level, void* pDst, const uint8_t* pPixels, bool allow_3color, bool allow_transparent_texels_for_black)
+	{
+		encode_bc1(g_default_context, level, pDst, pPixels, allow_3color, allow_transparent_texels_for_black);
 	}
 
 	static inline void encode_bc1_pick_initial(const color32 *pSrc_pixels, uint32_t flags, bool grayscale_flag,
@@ -3412,7 +3461,7 @@ namespace rgbcx
 	};
 
 	// From icbc's high quality mode.
-	static inline void encode_bc1_endpoint_search(const color32 *pSrc_pixels, bool any_black_pixels,
+	static inline void encode_bc1_endpoint_search(const bc1_approx_context& ctx, const color32 *pSrc_pixels, bool any_black_pixels,
 		uint32_t flags, bc1_encode_results &results, uint32_t cur_err)
 	{
 		int &lr = results.lr, &lg = results.lg, &lb = results.lb, &hr = results.hr, &hg = results.hg, &hb = results.hb;
@@ -3450,13 +3499,13 @@ namespace rgbcx
 			uint32_t trial_err;
 			if (results.m_3color)
 			{
-				trial_err = bc1_find_sels3_fullerr(
+				trial_err = bc1_find_sels3_fullerr(ctx, 
 					((any_black_pixels) && ((flags & cEncodeBC1Use3ColorBlocksForBlackPixels) != 0)),
 					pSrc_pixels, trial_lr, trial_lg, trial_lb, trial_hr, trial_hg, trial_hb, trial_sels, cur_err);
 			}
 			else
 			{
-				trial_err = bc1_find_sels4(flags, pSrc_pixels, trial_lr, trial_lg, trial_lb, trial_hr, trial_hg, trial_hb, trial_sels, cur_err);
+				trial_err = bc1_find_sels4(ctx, flags, pSrc_pixels, trial_lr, trial_lg, trial_lb, trial_hr, trial_hg, trial_hb, trial_sels, cur_err);
 			}
 
 			if (trial_err < cur_err)
@@ -3477,7 +3526,7 @@ namespace rgbcx
 		}
 	}
 		
-	void encode_bc1(void* pDst, const uint8_t* pPixels, uint32_t flags, uint32_t total_orderings_to_try, uint32_t total_orderings_to_try3)
+	void encode_bc1(const bc1_approx_context& ctx, void* pDst, const uint8_t* pPixels, uint32_t flags, uint32_t total_orderings_to_try, uint32_t total_orderings_to_try3)
 	{
 		assert(g_initialized);
 				
@@ -3495,7 +3544,7 @@ namespace rgbcx
 
 		if (j == 0)
 		{
-			encode_bc1_solid_block(pDst, fr, fg, fb, (flags & (cEncodeBC1Use3ColorBlocks | cEncodeBC1Use3ColorBlocksForBlackPixels)) != 0);
+			encode_bc1_solid_block(ctx, pDst, fr, fg, fb, (flags & (cEncodeBC1Use3ColorBlocks | cEncodeBC1Use3ColorBlocksForBlackPixels)) != 0);
 			return;
 		}
 
@@ -3546,7 +3595,7 @@ namespace rgbcx
 
 			orig_lr = lr, orig_lg = lg, orig_lb = lb, orig_hr = hr, orig_hg = hg, orig_hb = hb;
 
-			bc1_find_sels4_noerr(pSrc_pixels, lr, lg, lb, hr, hg, hb, sels);
+			bc1_find_sels4_noerr(ctx, pSrc_pixels, lr, lg, lb, hr, hg, hb, sels);
 
 			const uint32_t total_ls_passes = flags & cEncodeBC1TwoLeastSquaresPasses ? 2 : 1;
 			for (uint32_t ls_pass = 0; ls_pass < total_ls_passes; ls_pass++)
@@ -3557,13 +3606,13 @@ namespace rgbcx
 				if (!compute_least_squares_endpoints4_rgb(pSrc_pixels, sels, &xl, &xh, total_r, total_g, total_b))
 				{
 					// All selectors equal - treat it as a solid block which should always be equal or better.
-					trial_lr = g_bc1_match5_equals_1[avg_r].m_hi;
-					trial_lg = g_bc1_match6_equals_1[avg_g].m_hi;
-					trial_lb = g_bc1_match5_equals_1[avg_b].m_hi;
+					trial_lr = ctx.m_match5_equals_1[avg_r].m_hi;
+					trial_lg = ctx.m_match6_equals_1[avg_g].m_hi;
+					trial_lb = ctx.m_match5_equals_1[avg_b].m_hi;
 
-					trial_hr = g_bc1_match5_equals_1[avg_r].m_lo;
-					trial_hg = g_bc1_match6_equals_1[avg_g].m_lo;
-					trial_hb = g_bc1_match5_equals_1[avg_b].m_lo;
+					trial_hr = ctx.m_match5_equals_1[avg_r].m_lo;
+					trial_hg = ctx.m_match6_equals_1[avg_g].m_lo;
+					trial_hb = ctx.m_match5_equals_1[avg_b].m_lo;
 
 					// In high/higher quality mode, let it try again in case the optimal tables have caused the sels to diverge.
 				}
@@ -3575,7 +3624,7 @@ namespace rgbcx
 				if ((lr == trial_lr) && (lg == trial_lg) && (lb == trial_lb) && (hr == trial_hr) && (hg == trial_hg) && (hb == trial_hb))
 					break;
 			
-				bc1_find_sels4_noerr(pSrc_pixels, trial_lr, trial_lg, trial_lb, trial_hr, trial_hg, trial_hb, sels);
+				bc1_find_sels4_noerr(ctx, pSrc_pixels, trial_lr, trial_lg, trial_lb, trial_hr, trial_hg, trial_hb, sels);
 
 				lr = trial_lr;
 				lg = trial_lg;
@@ -3608,7 +3657,7 @@ namespace rgbcx
 
 				int orig_round_lr = round_lr, orig_round_lg = round_lg, orig_round_lb = round_lb, orig_round_hr = round_hr, orig_round_hg = round_hg, orig_round_hb = round_hb;
 
-				uint32_t round_err = bc1_find_sels4(flags, pSrc_pixels, round_lr, round_lg, round_lb, round_hr, round_hg, round_hb, round_sels, UINT32_MAX);
+				uint32_t round_err = bc1_find_sels4(ctx, flags, pSrc_pixels, round_lr, round_lg, round_lb, round_hr, round_hg, round_hb, round_sels, UINT32_MAX);
 						
 				const uint32_t total_ls_passes = flags & cEncodeBC1TwoLeastSquaresPasses ? 2 : 1;
 				for (uint32_t ls_pass = 0; ls_pass < total_ls_passes; ls_pass++)
@@ -3619,13 +3668,13 @@ namespace rgbcx
 					if (!compute_least_squares_endpoints4_rgb(pSrc_pixels, round_sels, &xl, &xh, total_r, total_g, total_b))
 					{
 						// All selectors equal - treat it as a solid block which should always be equal or better.
-						trial_lr = g_bc1_match5_equals_1[avg_r].m_hi;
-						trial_lg = g_bc1_match6_equals_1[avg_g].m_hi;
-						trial_lb = g_bc1_match5_equals_1[avg_b].m_hi;
+						trial_lr = ctx.m_match5_equals_1[avg_r].m_hi;
+						trial_lg = ctx.m_match6_equals_1[avg_g].m_hi;
+						trial_lb = ctx.m_match5_equals_1[avg_b].m_hi;
 
-						trial_hr = g_bc1_match5_equals_1[avg_r].m_lo;
-						trial_hg = g_bc1_match6_equals_1[avg_g].m_lo;
-						trial_hb = g_bc1_match5_equals_1[avg_b].m_lo;
+						trial_hr = ctx.m_match5_equals_1[avg_r].m_lo;
+						trial_hg = ctx.m_match6_equals_1[avg_g].m_lo;
+						trial_hb = ctx.m_match5_equals_1[avg_b].m_lo;
 
 						// In high/higher quality mode, let it try again in case the optimal tables have caused the sels to diverge.
 					}
@@ -3638,7 +3687,7 @@ namespace rgbcx
 						break;
 			
 					uint8_t trial_sels[16];
-					uint32_t trial_err = bc1_find_sels4(flags, pSrc_pixels, trial_lr, trial_lg, trial_lb, trial_hr, trial_hg, trial_hb, trial_sels, round_err);
+					uint32_t trial_err = bc1_find_sels4(ctx, flags, pSrc_pixels, trial_lr, trial_lg, trial_lb, trial_hr, trial_hg, trial_hb, trial_sels, round_err);
 														
 					if (trial_err < round_err)
 					{
@@ -3749,13 +3798,13 @@ namespace rgbcx
 
 					if ((s == TOTAL_ORDER_4_0_16) || (s == TOTAL_ORDER_4_1_16) || (s == TOTAL_ORDER_4_2_16) || (s == TOTAL_ORDER_4_3_16))
 					{
-						trial_lr = g_bc1_match5_equals_1[avg_r].m_hi;
-						trial_lg = g_bc1_match6_equals_1[avg_g].m_hi;
-						trial_lb = g_bc1_match5_equals_1[avg_b].m_hi;
+						trial_lr = ctx.m_match5_equals_1[avg_r].m_hi;
+						trial_lg = ctx.m_match6_equals_1[avg_g].m_hi;
+						trial_lb = ctx.m_match5_equals_1[avg_b].m_hi;
 
-						trial_hr = g_bc1_match5_equals_1[avg_r].m_lo;
-						trial_hg = g_bc1_match6_equals_1[avg_g].m_lo;
-						trial_hb = g_bc1_match5_equals_1[avg_b].m_lo;
+						trial_hr = ctx.m_match5_equals_1[avg_r].m_lo;
+						trial_hg = ctx.m_match6_equals_1[avg_g].m_lo;
+						trial_hb = ctx.m_match5_equals_1[avg_b].m_lo;
 					}
 					else
 					{
@@ -3767,7 +3816,7 @@ namespace rgbcx
 										
 					uint8_t trial_sels[16];
 					
-					uint32_t trial_err = bc1_find_sels4(flags, pSrc_pixels, trial_lr, trial_lg, trial_lb, trial_hr, trial_hg, trial_hb, trial_sels, cur_err);
+					uint32_t trial_err = bc1_find_sels4(ctx, flags, pSrc_pixels, trial_lr, trial_lg, trial_lb, trial_hr, trial_hg, trial_hb, trial_sels, cur_err);
 
 					if (trial_err < cur_err)
 					{
@@ -3797,13 +3846,13 @@ namespace rgbcx
 			if (flags & cEncodeBC1Use3ColorBlocks)
 			{
 				assert(needs_block_error);
-				try_3color_block(pSrc_pixels, flags, cur_err, avg_r, avg_g, avg_b, orig_lr, orig_lg, orig_lb, orig_hr, orig_hg, orig_hb, total_r, total_g, total_b, total_orderings_to_try3, results);
+				try_3color_block(ctx, pSrc_pixels, flags, cur_err, avg_r, avg_g, avg_b, orig_lr, orig_lg, orig_lb, orig_hr, orig_hg, orig_hb, total_r, total_g, total_b, total_orderings_to_try3, results);
 			}
 
 			if ((any_black_pixels) && ((flags & cEncodeBC1Use3ColorBlocksForBlackPixels) != 0))
 			{
 				assert(needs_block_error);
-				try_3color_block_useblack(pSrc_pixels, flags, cur_err, results);
+				try_3color_block_useblack(ctx, pSrc_pixels, flags, cur_err, results);
 			}
 		}
 		
@@ -3811,7 +3860,7 @@ namespace rgbcx
 		{
 			assert(needs_block_error);
 
-			encode_bc1_endpoint_search(pSrc_pixels, any_black_pixels != 0, flags, results, cur_err);
+			encode_bc1_endpoint_search(ctx, pSrc_pixels, any_black_pixels != 0, flags, results, cur_err);
 		}
 
 		if (results.m_3color)
@@ -4003,7 +4052,12 @@ namespace rgbcx
 		pDst_bytes[7] = (uint8_t)(f >> 40U);
 	}
 
-	void encode_bc3(void* pDst, const uint8_t* pPixels, uint32_t flags, uint32_t total_orderings_to_try)
+	void encode_bc1(void* pDst, const uint8_t* pPixels, uint32_t flags, uint32_t total_orderings_to_try, uint32_t total_orderings_to_try3)
+	{
+		encode_bc1(g_default_context, pDst, pPixels, flags, total_orderings_to_try, total_orderings_to_try3);
+	}
+
+	void encode_bc3(const bc1_approx_context& ctx, void* pDst, const uint8_t* pPixels, uint32_t flags, uint32_t total_orderings_to_try)
 	{
 		assert(g_initialized);
 
@@ -4011,15 +4065,25 @@ namespace rgbcx
 		flags &= ~(cEncodeBC1Use3ColorBlocksForBlackPixels | cEncodeBC1Use3ColorBlocks);
 
 		encode_bc4(pDst, pPixels + 3, 4);
-		encode_bc1(static_cast<uint8_t*>(pDst) + 8, pPixels, flags, total_orderings_to_try);
+		encode_bc1(ctx, static_cast<uint8_t*>(pDst) + 8, pPixels, flags, total_orderings_to_try);
 	}
 
-	void encode_bc3(uint32_t level, void* pDst, const uint8_t* pPixels)
+	void encode_bc3(const bc1_approx_context& ctx, uint32_t level, void* pDst, const uint8_t* pPixels)
 	{
 		assert(g_initialized);
 
 		encode_bc4(pDst, pPixels + 3, 4);
-		encode_bc1(level, static_cast<uint8_t*>(pDst) + 8, pPixels, false, false);
+		encode_bc1(ctx, level, static_cast<uint8_t*>(pDst) + 8, pPixels, false, false);
+	}
+
+	void encode_bc3(void* pDst, const uint8_t* pPixels, uint32_t flags, uint32_t total_orderings_to_try)
+	{
+		encode_bc3(g_default_context, pDst, pPixels, flags, total_orderings_to_try);
+	}
+
+	void encode_bc3(uint32_t level, void* pDst, const uint8_t* pPixels)
+	{
+		encode_bc3(g_default_context, level, pDst, pPixels);
 	}
 
 	void encode_bc5(void* pDst, const uint8_t* pPixels, uint32_t chan0, uint32_t chan1, uint32_t stride)